@@ -0,0 +1,365 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WORLDCOIN_ARENAMAP_H
+#define WORLDCOIN_ARENAMAP_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <iterator>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Hash map with open addressing and arena-allocated entries.
+ *
+ * The table is a flat array of entry pointers probed linearly, next to an
+ * array of one control byte per slot holding 7 bits of the hash, so a lookup
+ * scans control bytes and only dereferences an entry on a tag match. That
+ * makes a slot 9 bytes instead of a separate heap node. Entries live in chunks
+ * handed out by a pooled arena and are recycled through a free list, so there
+ * is no per-entry heap allocation and memory usage can be accounted exactly.
+ *
+ * Entries never move: pointers and references to them stay valid until they
+ * are erased, as with std::unordered_map. Iterators are invalidated by
+ * insertion (which may rehash) but not by erasing other elements, so the
+ * `it = map.erase(it)` idiom works. Only the parts of the std::unordered_map
+ * interface that are actually used are provided.
+ */
+template <typename K, typename T, typename Hash>
+class arenamap
+{
+public:
+    typedef K key_type;
+    typedef T mapped_type;
+    typedef std::pair<const K, T> value_type;
+    typedef size_t size_type;
+
+private:
+    //! Control byte values: empty, erased, or 0x80 | 7 bits of the hash
+    enum : uint8_t { CTRL_EMPTY = 0, CTRL_TOMBSTONE = 1 };
+
+    typedef typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type Node;
+    static_assert(sizeof(Node) >= sizeof(Node*), "arena nodes must be able to hold a free list pointer");
+
+    //! Smallest non-empty table
+    static const size_t MIN_BUCKETS = 8;
+    //! Nodes in the first arena chunk; each further chunk doubles, up to MAX_CHUNK_NODES
+    static const size_t MIN_CHUNK_NODES = 8;
+    static const size_t MAX_CHUNK_NODES = 16384;
+
+    uint8_t* ctrl;          //!< nBuckets control bytes, followed by...
+    value_type** entries;   //!< ...nBuckets entry pointers, in the same allocation
+    size_t nBuckets;    //!< Always zero or a power of two
+    size_t nSize;       //!< Live entries
+    size_t nTombstones; //!< Erased slots that still break probe chains
+    Hash hasher;
+
+    std::vector<Node*> chunks;
+    std::vector<size_t> chunkNodes;
+    Node* freeList;
+    size_t nChunkUsed; //!< Nodes handed out from the last chunk
+
+    static uint8_t Tag(size_t hash) { return 0x80 | (hash >> (sizeof(size_t) * 8 - 7)); }
+    static bool IsLive(uint8_t c) { return c & 0x80; }
+
+    void* AllocateNode()
+    {
+        if (freeList) {
+            Node* node = freeList;
+            freeList = *reinterpret_cast<Node**>(node);
+            return node;
+        }
+        if (chunks.empty() || nChunkUsed == chunkNodes.back()) {
+            size_t nNodes = MIN_CHUNK_NODES;
+            if (!chunks.empty())
+                nNodes = chunkNodes.back() < MAX_CHUNK_NODES / 2 ? chunkNodes.back() * 2 : MAX_CHUNK_NODES;
+            chunks.reserve(chunks.size() + 1);
+            chunkNodes.reserve(chunkNodes.size() + 1);
+            Node* chunk = static_cast<Node*>(malloc(nNodes * sizeof(Node)));
+            if (!chunk)
+                throw std::bad_alloc();
+            chunks.push_back(chunk);
+            chunkNodes.push_back(nNodes);
+            nChunkUsed = 0;
+        }
+        return &chunks.back()[nChunkUsed++];
+    }
+
+    void FreeNode(value_type* entry)
+    {
+        entry->~value_type();
+        Node* node = reinterpret_cast<Node*>(entry);
+        *reinterpret_cast<Node**>(node) = freeList;
+        freeList = node;
+    }
+
+    void ReleaseArena()
+    {
+        for (Node* chunk : chunks)
+            free(chunk);
+        std::vector<Node*>().swap(chunks);
+        std::vector<size_t>().swap(chunkNodes);
+        freeList = nullptr;
+        nChunkUsed = 0;
+    }
+
+    //! Slot holding key, or nBuckets if absent
+    size_t FindSlot(const K& key, size_t hash) const
+    {
+        if (nSize == 0)
+            return nBuckets;
+        const size_t mask = nBuckets - 1;
+        const uint8_t tag = Tag(hash);
+        for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+            if (ctrl[i] == CTRL_EMPTY)
+                return nBuckets;
+            if (ctrl[i] == tag && entries[i]->first == key)
+                return i;
+        }
+    }
+
+    //! Allocate an empty table of n slots
+    static uint8_t* AllocateTable(size_t n)
+    {
+        // Pointers first, so that they are aligned.
+        uint8_t* block = static_cast<uint8_t*>(calloc(n, sizeof(value_type*) + 1));
+        if (!block)
+            throw std::bad_alloc();
+        return block;
+    }
+
+    //! Move all live entries into a fresh table of nNewBuckets slots
+    void Rehash(size_t nNewBuckets)
+    {
+        uint8_t* block = AllocateTable(nNewBuckets);
+        value_type** newEntries = reinterpret_cast<value_type**>(block);
+        uint8_t* newCtrl = block + nNewBuckets * sizeof(value_type*);
+        const size_t mask = nNewBuckets - 1;
+        for (size_t i = 0; i < nBuckets; i++) {
+            if (!IsLive(ctrl[i]))
+                continue;
+            const size_t hash = hasher(entries[i]->first);
+            size_t j = hash & mask;
+            while (newCtrl[j] != CTRL_EMPTY)
+                j = (j + 1) & mask;
+            newCtrl[j] = ctrl[i];
+            newEntries[j] = entries[i];
+        }
+        free(entries);
+        entries = newEntries;
+        ctrl = newCtrl;
+        nBuckets = nNewBuckets;
+        nTombstones = 0;
+    }
+
+    //! Make room for one more entry, keeping used slots at or below 3/4
+    void Reserve()
+    {
+        if ((nSize + nTombstones + 1) * 4 <= nBuckets * 3)
+            return;
+        size_t nNewBuckets = nBuckets ? nBuckets : MIN_BUCKETS;
+        // Only grow if live entries alone would still be over half full;
+        // otherwise rehashing in place clears enough tombstones.
+        while ((nSize + 1) * 2 > nNewBuckets)
+            nNewBuckets *= 2;
+        Rehash(nNewBuckets);
+    }
+
+    template <typename... Args>
+    std::pair<size_t, bool> EmplaceHashed(const K& key, size_t hash, Args&&... args)
+    {
+        size_t pos = FindSlot(key, hash);
+        if (pos != nBuckets)
+            return std::make_pair(pos, false);
+        Reserve();
+        const size_t mask = nBuckets - 1;
+        size_t i = hash & mask;
+        while (IsLive(ctrl[i]))
+            i = (i + 1) & mask;
+        const bool fTombstone = ctrl[i] == CTRL_TOMBSTONE;
+        void* node = AllocateNode();
+        try {
+            entries[i] = new (node) value_type(std::forward<Args>(args)...);
+        } catch (...) {
+            *reinterpret_cast<Node**>(node) = freeList;
+            freeList = static_cast<Node*>(node);
+            throw;
+        }
+        if (fTombstone)
+            nTombstones--;
+        ctrl[i] = Tag(hash);
+        nSize++;
+        return std::make_pair(i, true);
+    }
+
+public:
+    template <bool Const>
+    class Iterator : public std::iterator<std::forward_iterator_tag, typename std::conditional<Const, const value_type, value_type>::type>
+    {
+        friend class arenamap;
+        typedef typename std::conditional<Const, const arenamap*, arenamap*>::type map_pointer;
+        map_pointer map;
+        size_t pos;
+
+        Iterator(map_pointer mapIn, size_t posIn) : map(mapIn), pos(posIn) {}
+
+        void SkipEmpty()
+        {
+            while (pos < map->nBuckets && !IsLive(map->ctrl[pos]))
+                pos++;
+        }
+
+    public:
+        typedef typename std::conditional<Const, const value_type, value_type>::type entry_type;
+
+        Iterator() : map(nullptr), pos(0) {}
+        template <bool OtherConst, typename = typename std::enable_if<Const && !OtherConst>::type>
+        Iterator(const Iterator<OtherConst>& other) : map(other.map), pos(other.pos) {}
+
+        entry_type& operator*() const { return *map->entries[pos]; }
+        entry_type* operator->() const { return map->entries[pos]; }
+        Iterator& operator++() { pos++; SkipEmpty(); return *this; }
+        Iterator operator++(int) { Iterator copy(*this); ++*this; return copy; }
+        template <bool OtherConst>
+        bool operator==(const Iterator<OtherConst>& other) const { return pos == other.pos; }
+        template <bool OtherConst>
+        bool operator!=(const Iterator<OtherConst>& other) const { return pos != other.pos; }
+
+        template <bool> friend class Iterator;
+    };
+
+    typedef Iterator<false> iterator;
+    typedef Iterator<true> const_iterator;
+
+    arenamap() : ctrl(nullptr), entries(nullptr), nBuckets(0), nSize(0), nTombstones(0), freeList(nullptr), nChunkUsed(0) {}
+    ~arenamap()
+    {
+        clear();
+    }
+
+    arenamap(const arenamap&) = delete;
+    arenamap& operator=(const arenamap&) = delete;
+
+    iterator begin() { iterator it(this, 0); it.SkipEmpty(); return it; }
+    const_iterator begin() const { const_iterator it(this, 0); it.SkipEmpty(); return it; }
+    iterator end() { return iterator(this, nBuckets); }
+    const_iterator end() const { return const_iterator(this, nBuckets); }
+
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+    size_t bucket_count() const { return nBuckets; }
+
+    iterator find(const K& key) { return iterator(this, FindSlot(key, hasher(key))); }
+    const_iterator find(const K& key) const { return const_iterator(this, FindSlot(key, hasher(key))); }
+    size_t count(const K& key) const { return FindSlot(key, hasher(key)) != nBuckets ? 1 : 0; }
+
+    template <typename V>
+    std::pair<iterator, bool> emplace(const K& key, V&& value)
+    {
+        auto ret = EmplaceHashed(key, hasher(key), key, std::forward<V>(value));
+        return std::make_pair(iterator(this, ret.first), ret.second);
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(std::piecewise_construct_t, std::tuple<const K&> key, std::tuple<Args...> args)
+    {
+        const K& k = std::get<0>(key);
+        auto ret = EmplaceHashed(k, hasher(k), std::piecewise_construct, key, std::move(args));
+        return std::make_pair(iterator(this, ret.first), ret.second);
+    }
+
+    T& operator[](const K& key)
+    {
+        auto ret = EmplaceHashed(key, hasher(key), std::piecewise_construct, std::forward_as_tuple(key), std::tuple<>());
+        return entries[ret.first]->second;
+    }
+
+    iterator erase(const_iterator it)
+    {
+        assert(it.map == this && IsLive(ctrl[it.pos]));
+        FreeNode(entries[it.pos]);
+        ctrl[it.pos] = CTRL_TOMBSTONE;
+        nSize--;
+        nTombstones++;
+        iterator next(this, it.pos + 1);
+        next.SkipEmpty();
+        return next;
+    }
+
+    size_t erase(const K& key)
+    {
+        size_t pos = FindSlot(key, hasher(key));
+        if (pos == nBuckets)
+            return 0;
+        erase(const_iterator(this, pos));
+        return 1;
+    }
+
+    /**
+     * Drop the entries keep() returns false for and move the others into
+     * freshly allocated storage, returning the memory held by dropped and
+     * previously erased entries. keep() is called once per entry.
+     * Invalidates all iterators, pointers and references.
+     */
+    template <typename Predicate>
+    void compact(Predicate keep)
+    {
+        uint8_t* oldCtrl = ctrl;
+        value_type** oldEntries = entries;
+        const size_t nOldBuckets = nBuckets;
+        std::vector<Node*> oldChunks;
+        oldChunks.swap(chunks);
+        std::vector<size_t>().swap(chunkNodes);
+        ctrl = nullptr;
+        entries = nullptr;
+        nBuckets = 0;
+        nSize = 0;
+        nTombstones = 0;
+        freeList = nullptr;
+        nChunkUsed = 0;
+
+        for (size_t i = 0; i < nOldBuckets; i++) {
+            if (!IsLive(oldCtrl[i]))
+                continue;
+            value_type* entry = oldEntries[i];
+            if (keep(static_cast<const value_type&>(*entry)))
+                EmplaceHashed(entry->first, hasher(entry->first), entry->first, std::move(entry->second));
+            entry->~value_type();
+        }
+        free(oldEntries);
+        for (Node* chunk : oldChunks)
+            free(chunk);
+    }
+
+    //! Destroy all entries and return all memory
+    void clear()
+    {
+        for (size_t i = 0; i < nBuckets; i++) {
+            if (IsLive(ctrl[i]))
+                entries[i]->~value_type();
+        }
+        free(entries);
+        entries = nullptr;
+        ctrl = nullptr;
+        nBuckets = 0;
+        nSize = 0;
+        nTombstones = 0;
+        ReleaseArena();
+    }
+
+    //! Size of a table slot and of an arena node, for memory accounting
+    static constexpr size_t bucket_size() { return sizeof(value_type*) + 1; }
+    static constexpr size_t node_size() { return sizeof(Node); }
+    //! Sizes (in nodes) of all arena chunks allocated so far
+    const std::vector<size_t>& arena_chunks() const { return chunkNodes; }
+};
+
+#endif // WORLDCOIN_ARENAMAP_H
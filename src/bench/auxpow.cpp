@@ -0,0 +1,137 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <arith_uint256.h>
+#include <auxpow.h>
+#include <chainparams.h>
+#include <hash.h>
+#include <primitives/block.h>
+#include <script/script.h>
+#include <streams.h>
+#include <version.h>
+#include <worldcoin.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+/** Number of transactions of the parent block (log2), i.e. the coinbase merkle branch length. */
+static const unsigned PARENT_TX_DEPTH = 11;
+/** Number of merge-mined chains (log2), i.e. the chain merkle branch length. */
+static const unsigned CHAIN_DEPTH = 3;
+
+static uint256 MerkleBranchRoot(uint256 hash, const std::vector<uint256>& vBranch, int nIndex)
+{
+    for (const uint256& branch : vBranch) {
+        if (nIndex & 1)
+            hash = Hash(branch.begin(), branch.end(), hash.begin(), hash.end());
+        else
+            hash = Hash(hash.begin(), hash.end(), branch.begin(), branch.end());
+        nIndex >>= 1;
+    }
+    return hash;
+}
+
+static void WriteLE32(std::vector<unsigned char>& data, uint32_t n)
+{
+    for (int i = 0; i < 4; i++)
+        data.push_back((n >> (8 * i)) & 0xff);
+}
+
+/**
+ * Build a merge-mined header whose auxpow links it to a parent block of
+ * 2^PARENT_TX_DEPTH transactions, through a chain merkle tree shared with
+ * 2^CHAIN_DEPTH chains, as a typical merge-mining pool would produce.
+ */
+static CBlockHeader MakeAuxpowHeader(const Consensus::Params& params)
+{
+    CBlockHeader header;
+    header.SetBaseVersion(4, params.nAuxpowChainId);
+    header.SetAuxpowFlag(true);
+    header.hashPrevBlock = uint256S("0x1234");
+    header.hashMerkleRoot = uint256S("0x5678");
+    header.nTime = 1500000000;
+    header.nBits = 0x1d00ffff;
+
+    // Chain merkle tree; the slot of our chain is fixed by the nonce.
+    const uint32_t nNonce = 7;
+    const int nChainIndex = CAuxPow::getExpectedIndex(nNonce, params.nAuxpowChainId, CHAIN_DEPTH);
+    std::vector<uint256> vChainMerkleBranch;
+    for (unsigned i = 0; i < CHAIN_DEPTH; i++)
+        vChainMerkleBranch.push_back(ArithToUint256(arith_uint256(i + 1)));
+    const uint256 hashRoot = MerkleBranchRoot(header.GetHash(), vChainMerkleBranch, nChainIndex);
+
+    std::vector<unsigned char> data(std::begin(pchMergedMiningHeader), std::end(pchMergedMiningHeader));
+    data.insert(data.end(), hashRoot.begin(), hashRoot.end());
+    std::reverse(data.end() - 32, data.end());
+    WriteLE32(data, 1u << CHAIN_DEPTH);
+    WriteLE32(data, nNonce);
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << data;
+    CBaseMerkleTx coinbaseTx(MakeTransactionRef(std::move(coinbase)));
+    coinbaseTx.nIndex = 0;
+    for (unsigned i = 0; i < PARENT_TX_DEPTH; i++)
+        coinbaseTx.vMerkleBranch.push_back(ArithToUint256(arith_uint256(1000 + i)));
+
+    CPureBlockHeader parent;
+    parent.nVersion = 2;
+    parent.hashMerkleRoot = MerkleBranchRoot(coinbaseTx.GetHash(), coinbaseTx.vMerkleBranch, 0);
+    parent.nTime = header.nTime;
+    parent.nBits = header.nBits;
+    coinbaseTx.hashBlock = parent.GetHash();
+
+    // The fields of CAuxPow are private; assemble it through its serialization.
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << coinbaseTx << vChainMerkleBranch << nChainIndex << parent;
+    std::unique_ptr<CAuxPow> auxpow(new CAuxPow());
+    ss >> *auxpow;
+    header.SetAuxpow(std::move(auxpow));
+    return header;
+}
+
+static void AuxpowCheck(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    const CBlockHeader header = MakeAuxpowHeader(params);
+    const uint256 hash = header.GetHash();
+    assert(header.auxpow->check(hash, header.GetChainId(), params));
+
+    while (state.KeepRunning()) {
+        header.auxpow->check(hash, header.GetChainId(), params);
+    }
+}
+
+// The PoW check of a header before merge-mining: one scrypt hash.
+static void CheckAuxPowProofOfWorkLegacy(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    CBlockHeader header;
+    header.nVersion = 2;
+    header.nBits = 0x1d00ffff;
+    while (state.KeepRunning()) {
+        CheckAuxPowProofOfWork(header, chainParams->GetConsensus());
+        header.nNonce++;
+    }
+}
+
+// The PoW check of a merge-mined header: auxpow merkle branches plus the
+// scrypt hash of the parent block.
+static void CheckAuxPowProofOfWorkAuxpow(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const CBlockHeader header = MakeAuxpowHeader(chainParams->GetConsensus());
+    while (state.KeepRunning()) {
+        CheckAuxPowProofOfWork(header, chainParams->GetConsensus());
+    }
+}
+
+BENCHMARK(AuxpowCheck, 50 * 1000);
+BENCHMARK(CheckAuxPowProofOfWorkLegacy, 2000);
+BENCHMARK(CheckAuxPowProofOfWorkAuxpow, 2000);
@@ -5,6 +5,7 @@
 #include <bench/bench.h>
 #include <chainparams.h>
 #include <coins.h>
+#include <coinswriter.h>
 #include <consensus/merkle.h>
 #include <consensus/validation.h>
 #include <miner.h>
@@ -51,29 +52,38 @@ static CTxIn MineBlock(const CScript& coinbase_scriptPubKey)
 }
 
 
-static void AssembleBlock(benchmark::State& state)
+static const std::vector<unsigned char> OP_TRUE_SCRIPT{OP_TRUE};
+
+static CScriptWitness OpTrueWitness()
 {
-    const std::vector<unsigned char> op_true{OP_TRUE};
     CScriptWitness witness;
-    witness.stack.push_back(op_true);
+    witness.stack.push_back(OP_TRUE_SCRIPT);
+    return witness;
+}
 
+static CScript OpTrueScriptPubKey()
+{
     uint256 witness_program;
-    CSHA256().Write(&op_true[0], op_true.size()).Finalize(witness_program.begin());
+    CSHA256().Write(&OP_TRUE_SCRIPT[0], OP_TRUE_SCRIPT.size()).Finalize(witness_program.begin());
+    return CScript(OP_0) << std::vector<unsigned char>{witness_program.begin(), witness_program.end()};
+}
 
-    const CScript SCRIPT_PUB{CScript(OP_0) << std::vector<unsigned char>{witness_program.begin(), witness_program.end()}};
+static constexpr size_t NUM_BLOCKS{400};
 
+/** Set up a regtest chain of NUM_BLOCKS blocks paying to SCRIPT_PUB, and return the inputs spending their coinbases */
+static std::vector<CTxIn> SetupChain(const CScript& SCRIPT_PUB, boost::thread_group& thread_group, CScheduler& scheduler)
+{
     // Switch to regtest so we can mine faster
     // Also segwit is active, so we can include witness transactions
     SelectParams(CBaseChainParams::REGTEST);
 
     InitScriptExecutionCache();
 
-    boost::thread_group thread_group;
-    CScheduler scheduler;
     {
         ::pblocktree.reset(new CBlockTreeDB(1 << 20, true));
         ::pcoinsdbview.reset(new CCoinsViewDB(1 << 23, true));
-        ::pcoinsTip.reset(new CCoinsViewCache(pcoinsdbview.get()));
+        ::pcoinswriter.reset(new CCoinsViewWriter(pcoinsdbview.get(), pblocktree.get()));
+        ::pcoinsTip.reset(new CCoinsViewCache(pcoinswriter.get()));
 
         const CChainParams& chainparams = Params();
         thread_group.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
@@ -86,12 +96,43 @@ static void AssembleBlock(benchmark::State& state)
         assert(witness_enabled);
     }
 
+    std::vector<CTxIn> coinbases;
+    for (size_t b{0}; b < NUM_BLOCKS; ++b) {
+        coinbases.push_back(MineBlock(SCRIPT_PUB));
+    }
+    return coinbases;
+}
+
+static void TeardownChain(boost::thread_group& thread_group)
+{
+    thread_group.interrupt_all();
+    thread_group.join_all();
+    GetMainSignals().FlushBackgroundCallbacks();
+    GetMainSignals().UnregisterBackgroundSignalScheduler();
+
+    // Leave no chainstate behind for the next benchmark to trip over.
+    ::mempool.clear();
+    UnloadBlockIndex();
+    ::pcoinsTip.reset();
+    ::pcoinswriter.reset();
+    ::pcoinsdbview.reset();
+    ::pblocktree.reset();
+}
+
+static void AssembleBlock(benchmark::State& state)
+{
+    const CScriptWitness witness{OpTrueWitness()};
+    const CScript SCRIPT_PUB{OpTrueScriptPubKey()};
+
+    boost::thread_group thread_group;
+    CScheduler scheduler;
+    const std::vector<CTxIn> coinbases{SetupChain(SCRIPT_PUB, thread_group, scheduler)};
+
     // Collect some loose transactions that spend the coinbases of our mined blocks
-    constexpr size_t NUM_BLOCKS{400};
     std::array<CTransactionRef, NUM_BLOCKS - COINBASE_MATURITY + 1> txs;
     for (size_t b{0}; b < NUM_BLOCKS; ++b) {
         CMutableTransaction tx;
-        tx.vin.push_back(MineBlock(SCRIPT_PUB));
+        tx.vin.push_back(coinbases.at(b));
         tx.vin.back().scriptWitness = witness;
         tx.vout.emplace_back(1337, SCRIPT_PUB);
         if (NUM_BLOCKS - b >= COINBASE_MATURITY)
@@ -111,10 +152,60 @@ static void AssembleBlock(benchmark::State& state)
         PrepareBlock(SCRIPT_PUB);
     }
 
-    thread_group.interrupt_all();
-    thread_group.join_all();
-    GetMainSignals().FlushBackgroundCallbacks();
-    GetMainSignals().UnregisterBackgroundSignalScheduler();
+    TeardownChain(thread_group);
+}
+
+/**
+ * Assemble blocks from a mempool holding several blocks' worth of
+ * transactions, in chains as deep as the mempool allows. Between blocks the
+ * mempool keeps its block order, so this mostly measures taking packages
+ * from it.
+ */
+static void AssembleBlockDeepChains(benchmark::State& state)
+{
+    const CScriptWitness witness{OpTrueWitness()};
+    const CScript SCRIPT_PUB{OpTrueScriptPubKey()};
+
+    boost::thread_group thread_group;
+    CScheduler scheduler;
+    const std::vector<CTxIn> coinbases{SetupChain(SCRIPT_PUB, thread_group, scheduler)};
+
+    // Start a chain from each mature coinbase. The extra outputs make the
+    // transactions large enough for the chains to fill several blocks.
+    constexpr size_t NUM_OUTPUTS{20};
+    constexpr CAmount OUTPUT_VALUE{10000};
+    {
+        LOCK(::cs_main); // Required for ::AcceptToMemoryPool.
+
+        for (size_t c{0}; c + COINBASE_MATURITY < NUM_BLOCKS; ++c) {
+            CTxIn in{coinbases.at(c)};
+            CAmount value{::pcoinsTip->AccessCoin(in.prevout).out.nValue};
+            for (size_t d{0}; d < DEFAULT_ANCESTOR_LIMIT; ++d) {
+                const CAmount fee{1000 + static_cast<CAmount>((c * 7919 + d * 104729) % 50000)};
+                assert(value > fee + static_cast<CAmount>(NUM_OUTPUTS) * OUTPUT_VALUE);
+                CMutableTransaction tx;
+                tx.vin.push_back(in);
+                tx.vin.back().scriptWitness = witness;
+                tx.vout.assign(NUM_OUTPUTS, CTxOut(OUTPUT_VALUE, SCRIPT_PUB));
+                tx.vout[0].nValue = value - fee - static_cast<CAmount>(NUM_OUTPUTS - 1) * OUTPUT_VALUE;
+
+                CValidationState state;
+                const CTransactionRef txr{MakeTransactionRef(tx)};
+                bool ret{::AcceptToMemoryPool(::mempool, state, txr, nullptr /* pfMissingInputs */, nullptr /* plTxnReplaced */, false /* bypass_limits */, /* nAbsurdFee */ 0)};
+                assert(ret);
+
+                in = CTxIn{txr->GetHash(), 0};
+                value = txr->vout[0].nValue;
+            }
+        }
+    }
+
+    while (state.KeepRunning()) {
+        PrepareBlock(SCRIPT_PUB);
+    }
+
+    TeardownChain(thread_group);
 }
 
 BENCHMARK(AssembleBlock, 700);
+BENCHMARK(AssembleBlockDeepChains, 10);
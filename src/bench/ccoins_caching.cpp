@@ -5,8 +5,10 @@
 #include <bench/bench.h>
 #include <coins.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <wallet/crypter.h>
 
+#include <unordered_map>
 #include <vector>
 
 // FIXME: Dedup with SetupDummyInputs in test/transaction_tests.cpp.
@@ -85,3 +87,58 @@ static void CCoinsCaching(benchmark::State& state)
 }
 
 BENCHMARK(CCoinsCaching, 170 * 1000);
+
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsUnorderedMap;
+
+static std::vector<COutPoint> RandomOutpoints(size_t n)
+{
+    FastRandomContext rng(true);
+    std::vector<COutPoint> outpoints;
+    outpoints.reserve(n);
+    for (size_t i = 0; i < n; i++)
+        outpoints.emplace_back(rng.rand256(), rng.randrange(4));
+    return outpoints;
+}
+
+// Lookups in a large, warm cache, as ConnectBlock does for most inputs.
+template <typename Map>
+static void CoinsMapLookup(benchmark::State& state)
+{
+    const std::vector<COutPoint> outpoints = RandomOutpoints(200000);
+    Map map;
+    for (const COutPoint& outpoint : outpoints)
+        map[outpoint].coin = Coin(CTxOut(1, CScript() << OP_TRUE), 1, false);
+
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        for (int x = 0; x < 1000; ++x) {
+            auto it = map.find(outpoints[i]);
+            assert(it != map.end());
+            i = (i + 7919) % outpoints.size();
+        }
+    }
+}
+
+// Add and spend a block's worth of coins in a cache, as one block's
+// CCoinsViewCache does before it is flushed into pcoinsTip.
+template <typename Map>
+static void CoinsMapChurn(benchmark::State& state)
+{
+    const std::vector<COutPoint> outpoints = RandomOutpoints(4000);
+    Map map;
+    while (state.KeepRunning()) {
+        for (const COutPoint& outpoint : outpoints)
+            map.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(Coin(CTxOut(1, CScript()), 1, false)));
+        for (auto it = map.begin(); it != map.end(); it = map.erase(it)) {}
+    }
+}
+
+static void CCoinsMapLookup(benchmark::State& state) { CoinsMapLookup<CCoinsMap>(state); }
+static void CCoinsUnorderedMapLookup(benchmark::State& state) { CoinsMapLookup<CCoinsUnorderedMap>(state); }
+static void CCoinsMapChurn(benchmark::State& state) { CoinsMapChurn<CCoinsMap>(state); }
+static void CCoinsUnorderedMapChurn(benchmark::State& state) { CoinsMapChurn<CCoinsUnorderedMap>(state); }
+
+BENCHMARK(CCoinsMapLookup, 5000);
+BENCHMARK(CCoinsUnorderedMapLookup, 5000);
+BENCHMARK(CCoinsMapChurn, 2000);
+BENCHMARK(CCoinsUnorderedMapChurn, 2000);
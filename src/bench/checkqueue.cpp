@@ -6,6 +6,7 @@
 #include <util.h>
 #include <validation.h>
 #include <checkqueue.h>
+#include <crypto/sha256.h>
 #include <prevector.h>
 #include <vector>
 #include <boost/thread/thread.hpp>
@@ -60,3 +61,49 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.join_all();
 }
 BENCHMARK(CCheckQueueSpeedPrevectorJob, 1400);
+
+static const unsigned char HASH_JOB_DATA[1024] = {0};
+
+// This Benchmark shows how the CheckQueue scales with the number of threads
+// verifying (the workers plus the master), with checks that each cost about
+// as much as hashing a kilobyte. Counts above the number of cores show the
+// cost of oversubscription.
+static void CCheckQueueScaling(benchmark::State& state, int nThreads)
+{
+    struct HashJob {
+        bool operator()()
+        {
+            unsigned char hash[CSHA256::OUTPUT_SIZE];
+            CSHA256().Write(HASH_JOB_DATA, sizeof(HASH_JOB_DATA)).Finalize(hash);
+            return true;
+        }
+        void swap(HashJob& x){};
+    };
+    CCheckQueue<HashJob> queue {QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    for (auto x = 0; x < nThreads - 1; ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<HashJob> control(&queue);
+        for (size_t x = 0; x < BATCHES; ++x) {
+            std::vector<HashJob> vChecks(BATCH_SIZE);
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+#define CHECKQUEUE_SCALING_BENCHMARK(threads) \
+    static void CCheckQueueScaling##threads##Threads(benchmark::State& state) { CCheckQueueScaling(state, threads); } \
+    BENCHMARK(CCheckQueueScaling##threads##Threads, 100);
+
+CHECKQUEUE_SCALING_BENCHMARK(1)
+CHECKQUEUE_SCALING_BENCHMARK(2)
+CHECKQUEUE_SCALING_BENCHMARK(4)
+CHECKQUEUE_SCALING_BENCHMARK(8)
+CHECKQUEUE_SCALING_BENCHMARK(16)
+CHECKQUEUE_SCALING_BENCHMARK(32)
+CHECKQUEUE_SCALING_BENCHMARK(64)
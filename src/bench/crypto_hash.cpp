@@ -10,6 +10,7 @@
 #include <random.h>
 #include <uint256.h>
 #include <utiltime.h>
+#include <crypto/muhash.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
@@ -77,6 +78,28 @@ static void SipHash_32b(benchmark::State& state)
     }
 }
 
+static void MuHash(benchmark::State& state)
+{
+    MuHash3072 acc;
+    unsigned char key[32] = {0};
+    uint32_t i = 0;
+    while (state.KeepRunning()) {
+        key[0] = ++i;
+        acc.Insert(key, sizeof(key));
+    }
+}
+
+static void MuHashFinalize(benchmark::State& state)
+{
+    MuHash3072 acc;
+    unsigned char key[32] = {0};
+    unsigned char out[32];
+    while (state.KeepRunning()) {
+        acc.Remove(key, sizeof(key));
+        acc.Finalize(out);
+    }
+}
+
 static void FastRandom_32bit(benchmark::State& state)
 {
     FastRandomContext rng(true);
@@ -103,5 +126,7 @@ BENCHMARK(SHA512, 330);
 BENCHMARK(SHA256_32b, 4700 * 1000);
 BENCHMARK(SipHash_32b, 40 * 1000 * 1000);
 BENCHMARK(SHA256D64_1024, 7400);
+BENCHMARK(MuHash, 5000);
+BENCHMARK(MuHashFinalize, 10);
 BENCHMARK(FastRandom_32bit, 110 * 1000 * 1000);
 BENCHMARK(FastRandom_1bit, 440 * 1000 * 1000);
@@ -0,0 +1,64 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <pow.h>
+#include <random.h>
+
+#include <vector>
+
+static const size_t LWMA_CHAIN_LENGTH = 5000;
+
+static void BuildChain(std::vector<CBlockIndex>& blocks, std::vector<uint256>& hashes)
+{
+    FastRandomContext rng(true);
+    for (size_t i = 0; i < blocks.size(); i++) {
+        hashes[i] = rng.rand256();
+        blocks[i].phashBlock = &hashes[i];
+        blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+        blocks[i].nHeight = i;
+        blocks[i].nTime = i ? blocks[i - 1].nTime + rng.randrange(90) : 1500000000;
+        blocks[i].nBits = 0x1c000000 | (rng.rand32() & 0x7fffff) | 0x8000;
+        blocks[i].BuildSkip();
+    }
+}
+
+// Difficulty of the next block computed from the whole averaging window, as
+// done for every header before the window cache.
+static void LwmaFullWindow(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    std::vector<CBlockIndex> blocks(LWMA_CHAIN_LENGTH);
+    std::vector<uint256> hashes(blocks.size());
+    BuildChain(blocks, hashes);
+
+    size_t i = chainParams->GetConsensus().lwmaAveragingWindow;
+    while (state.KeepRunning()) {
+        Lwma3CalculateNextWorkRequired(&blocks[i], chainParams->GetConsensus());
+        if (++i == blocks.size())
+            i = chainParams->GetConsensus().lwmaAveragingWindow;
+    }
+}
+
+// Same, following the chain one block at a time through the window cache.
+static void LwmaCachedWindow(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    std::vector<CBlockIndex> blocks(LWMA_CHAIN_LENGTH);
+    std::vector<uint256> hashes(blocks.size());
+    BuildChain(blocks, hashes);
+
+    size_t i = chainParams->GetConsensus().lwmaAveragingWindow;
+    while (state.KeepRunning()) {
+        Lwma3CalculateNextWorkRequiredCached(&blocks[i], chainParams->GetConsensus());
+        if (++i == blocks.size())
+            i = chainParams->GetConsensus().lwmaAveragingWindow;
+    }
+}
+
+BENCHMARK(LwmaFullWindow, 400);
+BENCHMARK(LwmaCachedWindow, 40 * 1000);
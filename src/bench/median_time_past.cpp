@@ -0,0 +1,54 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chain.h>
+#include <random.h>
+
+#include <vector>
+
+// GetMedianTimePast() is queried for the tip or the parent of every header,
+// block and transaction that is validated (ContextualCheckBlockHeader,
+// CheckFinalTx, CheckSequenceLocks, the miner).
+
+static void BuildChain(std::vector<CBlockIndex>& blocks, bool fCache)
+{
+    FastRandomContext rng(true);
+    for (size_t i = 0; i < blocks.size(); i++) {
+        blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+        blocks[i].nHeight = i;
+        blocks[i].nTime = i ? blocks[i - 1].nTime + (int64_t)rng.randrange(90) - 20 : 1500000000;
+        if (fCache)
+            blocks[i].CacheMedianTimePast();
+    }
+}
+
+static void MedianTimePast(benchmark::State& state, bool fCache)
+{
+    std::vector<CBlockIndex> blocks(1000);
+    BuildChain(blocks, fCache);
+
+    size_t i = 0;
+    int64_t nSum = 0;
+    while (state.KeepRunning()) {
+        nSum += blocks[i].GetMedianTimePast();
+        if (++i == blocks.size())
+            i = 0;
+    }
+    assert(nSum != 0);
+}
+
+static void MedianTimePastComputed(benchmark::State& state)
+{
+    MedianTimePast(state, false);
+}
+
+static void MedianTimePastCached(benchmark::State& state)
+{
+    MedianTimePast(state, true);
+}
+
+BENCHMARK(MedianTimePastComputed, 5 * 1000 * 1000);
+BENCHMARK(MedianTimePastCached, 50 * 1000 * 1000);
@@ -0,0 +1,132 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <coinswriter.h>
+#include <consensus/validation.h>
+#include <key.h>
+#include <mempoolaccept.h>
+#include <random.h>
+#include <scheduler.h>
+#include <script/interpreter.h>
+#include <script/sigcache.h>
+#include <script/standard.h>
+#include <txdb.h>
+#include <txmempool.h>
+#include <validation.h>
+#include <validationinterface.h>
+
+#include <boost/thread.hpp>
+
+#include <vector>
+
+static constexpr int NUM_TXS = 2000;
+
+//! Signed, unrelated transactions, each spending a made-up confirmed coin
+static std::vector<CTransactionRef> CreateTransactions()
+{
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    std::vector<CTransactionRef> txs;
+    LOCK(cs_main);
+    for (int i = 0; i < NUM_TXS; i++) {
+        const COutPoint outpoint(GetRandHash(), 0);
+        pcoinsTip->AddCoin(outpoint, Coin(CTxOut(COIN, scriptPubKey), 1, false), false);
+
+        CMutableTransaction tx;
+        tx.vin.emplace_back(outpoint);
+        tx.vout.emplace_back(COIN - 10000, scriptPubKey);
+        std::vector<unsigned char> vchSig;
+        assert(key.Sign(SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, COIN, SigVersion::BASE), vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << vchSig << ToByteVector(key.GetPubKey());
+        txs.push_back(MakeTransactionRef(tx));
+    }
+    return txs;
+}
+
+static void MempoolAccept(benchmark::State& state, bool fPipeline)
+{
+    SelectParams(CBaseChainParams::MAIN);
+
+    boost::thread_group thread_group;
+    CScheduler scheduler;
+    {
+        ::pblocktree.reset(new CBlockTreeDB(1 << 20, true));
+        ::pcoinsdbview.reset(new CCoinsViewDB(1 << 23, true));
+        ::pcoinswriter.reset(new CCoinsViewWriter(pcoinsdbview.get(), pblocktree.get()));
+        ::pcoinsTip.reset(new CCoinsViewCache(pcoinswriter.get()));
+
+        const CChainParams& chainparams = Params();
+        thread_group.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+        GetMainSignals().RegisterBackgroundSignalScheduler(scheduler);
+        LoadGenesisBlock(chainparams);
+        CValidationState state;
+        ActivateBestChain(state, chainparams);
+        assert(::chainActive.Tip() != nullptr);
+    }
+
+    const std::vector<CTransactionRef> txs = CreateTransactions();
+    CMempoolAcceptPipeline pipeline(::mempool);
+    if (fPipeline)
+        pipeline.Start(std::max(1, GetNumCores() - 1));
+
+    while (state.KeepRunning()) {
+        // Start every round with cold caches, as for newly relayed transactions.
+        ::mempool.clear();
+        InitSignatureCache();
+        InitScriptExecutionCache();
+
+        if (fPipeline) {
+            std::vector<std::shared_ptr<CMempoolAcceptJob>> jobs;
+            for (const auto& tx : txs)
+                jobs.push_back(pipeline.Submit(tx));
+            for (const auto& job : jobs) {
+                pipeline.Wait(*job);
+                LOCK(::cs_main);
+                CValidationState vstate;
+                bool ret{pipeline.Accept(*job, vstate, nullptr, nullptr)};
+                assert(ret);
+            }
+        } else {
+            for (const auto& tx : txs) {
+                LOCK(::cs_main);
+                CValidationState vstate;
+                bool ret{::AcceptToMemoryPool(::mempool, vstate, tx, nullptr /* pfMissingInputs */, nullptr /* plTxnReplaced */, false /* bypass_limits */, /* nAbsurdFee */ 0)};
+                assert(ret);
+            }
+        }
+    }
+
+    pipeline.Stop();
+    ::mempool.clear();
+    thread_group.interrupt_all();
+    thread_group.join_all();
+    GetMainSignals().FlushBackgroundCallbacks();
+    GetMainSignals().UnregisterBackgroundSignalScheduler();
+
+    // Leave no chainstate behind for the next benchmark to trip over.
+    UnloadBlockIndex();
+    ::pcoinsTip.reset();
+    ::pcoinswriter.reset();
+    ::pcoinsdbview.reset();
+    ::pblocktree.reset();
+}
+
+static void MempoolAcceptSerial(benchmark::State& state)
+{
+    MempoolAccept(state, false);
+}
+
+static void MempoolAcceptPipeline(benchmark::State& state)
+{
+    MempoolAccept(state, true);
+}
+
+BENCHMARK(MempoolAcceptSerial, 2);
+BENCHMARK(MempoolAcceptPipeline, 2);
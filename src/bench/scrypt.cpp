@@ -0,0 +1,102 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <crypto/scrypt.h>
+#include <primitives/pureheader.h>
+#include <uint256.h>
+
+#include <vector>
+
+// Hash an 80-byte header with a scratchpad on the stack, as
+// scrypt_1024_1_1_256() used to for every call.
+static void ScryptStackScratchpad(benchmark::State& state)
+{
+    std::vector<char> in(80, 0);
+    char out[32];
+    while (state.KeepRunning()) {
+        char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
+        scrypt_1024_1_1_256_sp(in.data(), out, scratchpad);
+        in[0]++;
+    }
+}
+
+// Same through scrypt_1024_1_1_256(), which reuses the thread's scratchpad.
+static void ScryptThreadScratchpad(benchmark::State& state)
+{
+    std::vector<char> in(80, 0);
+    char out[32];
+    while (state.KeepRunning()) {
+        scrypt_1024_1_1_256(in.data(), out);
+        in[0]++;
+    }
+}
+
+static void ScryptGeneric(benchmark::State& state)
+{
+    std::vector<char> in(80, 0);
+    std::vector<char> scratchpad(SCRYPT_SCRATCHPAD_SIZE);
+    char out[32];
+    while (state.KeepRunning()) {
+        scrypt_1024_1_1_256_sp_generic(in.data(), out, scratchpad.data());
+        in[0]++;
+    }
+}
+
+#if defined(USE_SSE2)
+static void ScryptSSE2(benchmark::State& state)
+{
+    std::vector<char> in(80, 0);
+    std::vector<char> scratchpad(SCRYPT_SCRATCHPAD_SIZE);
+    char out[32];
+    while (state.KeepRunning()) {
+        scrypt_1024_1_1_256_sp_sse2(in.data(), out, scratchpad.data());
+        in[0]++;
+    }
+}
+#endif
+
+// Batches of headers through the widest multi-lane kernel available; one
+// iteration hashes the whole batch.
+static void ScryptMulti(benchmark::State& state, size_t count)
+{
+    std::vector<char> in(80 * count, 0);
+    std::vector<char> out(32 * count);
+    while (state.KeepRunning()) {
+        scrypt_1024_1_1_256_multi(in.data(), out.data(), count);
+        in[0]++;
+    }
+}
+
+static void ScryptMulti8(benchmark::State& state)
+{
+    ScryptMulti(state, 8);
+}
+
+static void ScryptMulti16(benchmark::State& state)
+{
+    ScryptMulti(state, 16);
+}
+
+static void PureHeaderGetPoWHash(benchmark::State& state)
+{
+    CPureBlockHeader header;
+    header.nVersion = 2;
+    header.nBits = 0x1d00ffff;
+    while (state.KeepRunning()) {
+        header.GetPoWHash();
+        header.nNonce++;
+    }
+}
+
+BENCHMARK(ScryptGeneric, 2000);
+#if defined(USE_SSE2)
+BENCHMARK(ScryptSSE2, 2000);
+#endif
+BENCHMARK(ScryptMulti8, 500);
+BENCHMARK(ScryptMulti16, 250);
+BENCHMARK(PureHeaderGetPoWHash, 2000);
+BENCHMARK(ScryptStackScratchpad, 2000);
+BENCHMARK(ScryptThreadScratchpad, 2000);
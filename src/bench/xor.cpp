@@ -0,0 +1,54 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <amount.h>
+#include <bench/bench.h>
+#include <clientversion.h>
+#include <coins.h>
+#include <random.h>
+#include <script/script.h>
+#include <streams.h>
+
+#include <vector>
+
+// The size of the obfuscation key of the block and chainstate databases
+static const size_t KEY_SIZE = 8;
+
+static std::vector<unsigned char> RandomBytes(size_t nSize)
+{
+    FastRandomContext rng(true);
+    std::vector<unsigned char> vch(nSize);
+    for (unsigned char& c : vch) {
+        c = rng.randbits(8);
+    }
+    return vch;
+}
+
+// XOR a large buffer, at an offset that isn't a multiple of the key size
+static void Xor(benchmark::State& state)
+{
+    const std::vector<unsigned char> key = RandomBytes(KEY_SIZE);
+    std::vector<unsigned char> data = RandomBytes(1000 * 1000);
+    while (state.KeepRunning()) {
+        XorBytes(data.data(), data.size(), key, 3);
+    }
+}
+
+// Deserialize an obfuscated coin, the way the chainstate database reads one
+static void XorReadCoin(benchmark::State& state)
+{
+    const std::vector<unsigned char> key = RandomBytes(KEY_SIZE);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << Coin(CTxOut(50 * COIN, CScript() << OP_DUP << OP_HASH160 << RandomBytes(20) << OP_EQUALVERIFY << OP_CHECKSIG), 100000, false);
+    ss.Xor(key);
+    const std::string value(ss.begin(), ss.end());
+    while (state.KeepRunning()) {
+        Coin coin;
+        CXorReader reader(SER_DISK, CLIENT_VERSION, value.data(), value.size(), key);
+        reader >> coin;
+    }
+}
+
+BENCHMARK(Xor, 1000);
+BENCHMARK(XorReadCoin, 1000 * 1000);
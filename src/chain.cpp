@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <chain.h>
+#include <headercache.h>
 #include <validation.h>
 
 using namespace std;
@@ -20,11 +21,15 @@ CBlockHeader CBlockIndex::GetBlockHeader(const Consensus::Params& consensusParam
     block.nVersion       = nVersion;   
    
     /* The CBlockIndex object's block header is missing the auxpow.
-       So if this is an auxpow block, read it from disk instead.  We only
-       have to read the actual *header*, not the full block.  */
+       So if this is an auxpow block, look it up in the header cache or
+       read it from disk instead.  We only have to read the actual *header*,
+       not the full block.  */
     if (block.IsAuxpow())
     {
-        ReadBlockHeaderFromDisk(block, this, consensusParams);
+        if (g_auxpow_header_cache.Get(GetBlockHash(), block))
+            return block;
+        if (ReadBlockHeaderFromDisk(block, this, consensusParams))
+            g_auxpow_header_cache.Insert(block);
         return block;
     }
 
@@ -162,6 +162,8 @@ enum BlockStatus: uint32_t {
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 
     BLOCK_OPT_WITNESS       =   128, //!< block data in blk*.data was received with a witness-enforcing client
+
+    BLOCK_POW_VERIFIED      =   256, //!< (aux)PoW of the block data in blk*.dat has been checked, skip it on reads
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -221,6 +223,9 @@ public:
     //! (memory only) Maximum nTime in the chain up to and including this block.
     unsigned int nTimeMax;
 
+    //! (memory only) Median time past of this block, set by CacheMedianTimePast(). Zero if not cached.
+    uint32_t nMedianTimePast;
+
     void SetNull()
     {
         phashBlock = nullptr;
@@ -236,6 +241,7 @@ public:
         nStatus = 0;
         nSequenceId = 0;
         nTimeMax = 0;
+        nMedianTimePast = 0;
 
         nVersion       = 0;
         hashMerkleRoot = uint256();
@@ -298,6 +304,19 @@ public:
     static constexpr int nMedianTimeSpan = 11;
 
     int64_t GetMedianTimePast() const
+    {
+        if (nMedianTimePast)
+            return (int64_t)nMedianTimePast;
+        return ComputeMedianTimePast();
+    }
+
+    //! Cache the median time past; pprev and the block times of the ancestors must be final.
+    void CacheMedianTimePast()
+    {
+        nMedianTimePast = ComputeMedianTimePast();
+    }
+
+    int64_t ComputeMedianTimePast() const
     {
         int64_t pmedian[nMedianTimeSpan];
         int64_t* pbegin = &pmedian[nMedianTimeSpan];
@@ -8,6 +8,9 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -25,12 +28,36 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker has its own deque, each behind its own lock. The master
+  * spreads added checks over the workers' deques; a worker takes work from
+  * the back of its own deque, and when that is empty, steals half of
+  * another's from the front. Workers thus rarely contend for a lock, and
+  * only go to sleep when every deque is empty.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! One worker's share of the queued checks
+    struct WorkerQueue
+    {
+        boost::mutex mutex;
+        std::deque<T> checks;
+    };
+
+    //! Deques for the master (index 0) and workers. Workers beyond the last
+    //! one share deques; every deque is only accessed under its lock.
+    static const unsigned int MAX_QUEUES = 65;
+    std::unique_ptr<WorkerQueue[]> queues;
+
+    //! Number of workers that have registered (excluding the master)
+    std::atomic<unsigned int> nWorkers;
+
+    //! Where the next Add() starts spreading checks
+    unsigned int nAddCursor;
+
+    //! Mutex to protect sleeping and waking up
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,87 +66,116 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! Bumped whenever checks are added, so idle workers can tell whether
+    //! they missed any while looking for work
+    std::atomic<uint64_t> nGeneration;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
-
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The number of workers that are (about to go) asleep
+    std::atomic<int> nIdle;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! Number of deques in use (the master's plus one per worker)
+    unsigned int QueueCount() const
+    {
+        const unsigned int nQueues = nWorkers.load() + 1;
+        return nQueues < MAX_QUEUES ? nQueues : MAX_QUEUES;
+    }
+
+    //! Move up to nMax checks from the back (own deque) or front (stealing) of a deque into vChecks
+    bool Take(WorkerQueue& queue, bool fOwn, std::vector<T>& vChecks)
+    {
+        boost::unique_lock<boost::mutex> lock(queue.mutex);
+        if (queue.checks.empty())
+            return false;
+        // Leave about half of the work for others to steal, so that all
+        // workers finish at about the same time.
+        const size_t nNow = std::max<size_t>(1, std::min<size_t>(nBatchSize, fOwn ? queue.checks.size() / 2 : (queue.checks.size() + 1) / 2));
+        vChecks.resize(nNow);
+        for (size_t i = 0; i < nNow; i++) {
+            // Swap jobs out instead of copying, to keep the lock short.
+            if (fOwn) {
+                vChecks[i].swap(queue.checks.back());
+                queue.checks.pop_back();
+            } else {
+                vChecks[i].swap(queue.checks.front());
+                queue.checks.pop_front();
+            }
+        }
+        return true;
+    }
+
+    //! Take a batch of work, from our own deque if possible
+    bool FindWork(unsigned int nOwn, unsigned int& nVictim, std::vector<T>& vChecks)
+    {
+        if (Take(queues[nOwn], true, vChecks))
+            return true;
+        const unsigned int nQueues = QueueCount();
+        for (unsigned int i = 0; i < nQueues; i++) {
+            nVictim = (nVictim + 1) % nQueues;
+            if (nVictim != nOwn && Take(queues[nVictim], false, vChecks))
+                return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        unsigned int nOwn = 0;
+        if (!fMaster) {
+            nOwn = 1 + (nWorkers++ % (MAX_QUEUES - 1));
+        }
+        unsigned int nVictim = nOwn;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
+            const uint64_t nGenerationSeen = nGeneration.load();
+            if (FindWork(nOwn, nVictim, vChecks)) {
+                // execute work
+                bool fOk = fAllOk.load(std::memory_order_relaxed);
+                for (T& check : vChecks)
+                    if (fOk)
+                        fOk = check();
+                const unsigned int nNow = vChecks.size();
+                vChecks.clear();
+                if (!fOk)
+                    fAllOk = false;
+                if (nTodo.fetch_sub(nNow) == nNow && !fMaster) {
+                    // We processed the last element; inform the master it can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster) {
+                // Nothing left to take, so only other workers' batches
+                // remain; nothing can be added while we wait.
+                while (nTodo != 0)
+                    condMaster.wait(lock);
+                bool fRet = fAllOk;
+                // reset the status for new work later
+                fAllOk = true;
+                // return the current status
+                return fRet;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
+            nIdle++;
+            while (nGeneration.load() == nGenerationSeen)
+                condWorker.wait(lock); // wait
+            nIdle--;
         } while (true);
     }
 
@@ -128,7 +184,8 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) :
+        queues(new WorkerQueue[MAX_QUEUES]), nWorkers(0), nAddCursor(0), nGeneration(0), nIdle(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
@@ -145,16 +202,33 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        // Spread the checks over the workers' deques, in contiguous runs,
+        // starting where the last call left off. Without workers, they go
+        // to the master's.
+        const unsigned int nQueues = QueueCount();
+        const unsigned int nTargets = nQueues > 1 ? nQueues - 1 : 1;
+        const size_t nPerQueue = (vChecks.size() + nTargets - 1) / nTargets;
+        for (size_t nBegin = 0; nBegin < vChecks.size(); nBegin += nPerQueue) {
+            WorkerQueue& queue = queues[nQueues > 1 ? 1 + nAddCursor++ % nTargets : 0];
+            boost::unique_lock<boost::mutex> lock(queue.mutex);
+            for (size_t i = nBegin; i < std::min(nBegin + nPerQueue, vChecks.size()); i++) {
+                queue.checks.emplace_back();
+                vChecks[i].swap(queue.checks.back());
+            }
+        }
+        // Either a worker going to sleep sees the new generation, or we see
+        // it is idle and wake it up.
+        nGeneration++;
+        if (nIdle.load() > 0) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (vChecks.size() == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
+        }
     }
 
     ~CCheckQueue()
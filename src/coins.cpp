@@ -5,12 +5,15 @@
 #include <coins.h>
 
 #include <consensus/consensus.h>
+#include <crypto/common.h>
 #include <random.h>
 
+#include <array>
+
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 std::vector<uint256> CCoinsView::GetHeadBlocks() const { return std::vector<uint256>(); }
-bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return false; }
+bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase) { return false; }
 CCoinsViewCursor *CCoinsView::Cursor() const { return nullptr; }
 
 bool CCoinsView::HaveCoin(const COutPoint &outpoint) const
@@ -25,13 +28,13 @@ bool CCoinsViewBacked::HaveCoin(const COutPoint &outpoint) const { return base->
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 std::vector<uint256> CCoinsViewBacked::GetHeadBlocks() const { return base->GetHeadBlocks(); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
-bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
+bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase) { return base->BatchWrite(mapCoins, hashBlock, fErase); }
 CCoinsViewCursor *CCoinsViewBacked::Cursor() const { return base->Cursor(); }
 size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0), nUseClock(0) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
@@ -39,12 +42,15 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
 
 CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const {
     CCoinsMap::iterator it = cacheCoins.find(outpoint);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        it->second.nLastUsed = nUseClock;
         return it;
+    }
     Coin tmp;
     if (!base->GetCoin(outpoint, tmp))
         return cacheCoins.end();
     CCoinsMap::iterator ret = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(tmp))).first;
+    ret->second.nLastUsed = nUseClock;
     if (ret->second.coin.IsSpent()) {
         // The parent only has an empty entry for this outpoint; we can consider our
         // version as fresh.
@@ -81,6 +87,7 @@ void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possi
     }
     it->second.coin = std::move(coin);
     it->second.flags |= CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
+    it->second.nLastUsed = nUseClock;
     cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
 }
 
@@ -142,8 +149,9 @@ void CCoinsViewCache::SetBestBlock(const uint256 &hashBlockIn) {
     hashBlock = hashBlockIn;
 }
 
-bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn) {
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = mapCoins.erase(it)) {
+bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn, bool fErase) {
+    nUseClock++;
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = fErase ? mapCoins.erase(it) : std::next(it)) {
         // Ignore non-dirty entries (optimization).
         if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) {
             continue;
@@ -156,9 +164,13 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                 // Otherwise we will need to create it in the parent
                 // and move the data up and mark it as dirty
                 CCoinsCacheEntry& entry = cacheCoins[it->first];
-                entry.coin = std::move(it->second.coin);
+                if (fErase)
+                    entry.coin = std::move(it->second.coin);
+                else
+                    entry.coin = it->second.coin;
                 cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
                 entry.flags = CCoinsCacheEntry::DIRTY;
+                entry.nLastUsed = nUseClock;
                 // We can mark it FRESH in the parent if it was FRESH in the child
                 // Otherwise it might have just been flushed from the parent's cache
                 // and already exist in the grandparent
@@ -185,9 +197,13 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
             } else {
                 // A normal modification.
                 cachedCoinsUsage -= itUs->second.coin.DynamicMemoryUsage();
-                itUs->second.coin = std::move(it->second.coin);
+                if (fErase)
+                    itUs->second.coin = std::move(it->second.coin);
+                else
+                    itUs->second.coin = it->second.coin;
                 cachedCoinsUsage += itUs->second.coin.DynamicMemoryUsage();
                 itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                itUs->second.nLastUsed = nUseClock;
                 // NOTE: It is possible the child has a FRESH flag here in
                 // the event the entry we found in the parent is pruned. But
                 // we must not copy that FRESH flag to the parent as that
@@ -200,13 +216,91 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
     return true;
 }
 
+static size_t CountDirty(const CCoinsMap& map)
+{
+    size_t count = 0;
+    for (const auto& entry : map) {
+        if (entry.second.flags & CCoinsCacheEntry::DIRTY)
+            count++;
+    }
+    return count;
+}
+
 bool CCoinsViewCache::Flush() {
-    bool fOk = base->BatchWrite(cacheCoins, hashBlock);
+    flushStats.nFlushes++;
+    flushStats.nCoinsWritten += CountDirty(cacheCoins);
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock, true);
     cacheCoins.clear();
     cachedCoinsUsage = 0;
     return fOk;
 }
 
+bool CCoinsViewCache::Sync(size_t nTargetUsage) {
+    flushStats.nSyncs++;
+    flushStats.nCoinsWritten += CountDirty(cacheCoins);
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock, false);
+    // Our entries now match the base view; spent ones carry no information.
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (it->second.coin.IsSpent()) {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            it = cacheCoins.erase(it);
+        } else {
+            it->second.flags = 0;
+            ++it;
+        }
+    }
+    if (DynamicMemoryUsage() > nTargetUsage)
+        Evict(nTargetUsage);
+    return fOk;
+}
+
+void CCoinsViewCache::Evict(size_t nTargetUsage) {
+    // Erased entries only return their memory to the map's arena, so
+    // eviction always ends with a repack. Estimate what each entry takes,
+    // at the average load of a freshly built table; as the table and the
+    // arena are allocated in rounded sizes, repeat until the target is met.
+    const size_t nEntryUsage = CCoinsMap::node_size() + 2 * CCoinsMap::bucket_size();
+    // Group entries by the log2 of the number of writes into this cache since
+    // they were last used, and evict the oldest groups first.
+    auto age_class = [this](const CCoinsCacheEntry& entry) { return CountBits(nUseClock - entry.nLastUsed); };
+    while (DynamicMemoryUsage() > nTargetUsage) {
+        std::array<size_t, 33> vClassUsage{};
+        for (const auto& entry : cacheCoins)
+            vClassUsage[age_class(entry.second)] += nEntryUsage + entry.second.coin.DynamicMemoryUsage();
+        // Evict every class from nCutoff up, and nPartial bytes' worth of
+        // the class below it.
+        size_t nExcess = DynamicMemoryUsage() - nTargetUsage;
+        int nCutoff = vClassUsage.size();
+        size_t nPartial = 0;
+        while (nExcess > 0 && nCutoff > 0) {
+            if (vClassUsage[nCutoff - 1] > nExcess) {
+                nPartial = nExcess;
+                break;
+            }
+            nCutoff--;
+            nExcess -= vClassUsage[nCutoff];
+        }
+
+        uint64_t nEvicted = 0;
+        cacheCoins.compact([&](const CCoinsMap::value_type& entry) {
+            const int nClass = age_class(entry.second);
+            if (entry.second.flags != 0 || nClass < nCutoff - 1)
+                return true;
+            if (nClass == nCutoff - 1) {
+                if (nPartial == 0)
+                    return true;
+                nPartial -= std::min(nPartial, nEntryUsage + entry.second.coin.DynamicMemoryUsage());
+            }
+            cachedCoinsUsage -= entry.second.coin.DynamicMemoryUsage();
+            nEvicted++;
+            return false;
+        });
+        flushStats.nCoinsEvicted += nEvicted;
+        if (nEvicted == 0)
+            break;
+    }
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
@@ -7,6 +7,7 @@
 #define WORLDCOIN_COINS_H
 
 #include <primitives/transaction.h>
+#include <arenamap.h>
 #include <compressor.h>
 #include <core_memusage.h>
 #include <hash.h>
@@ -104,6 +105,7 @@ struct CCoinsCacheEntry
 {
     Coin coin; // The actual cached data.
     unsigned char flags;
+    uint32_t nLastUsed; // The owning cache's use clock when this entry was last read or written.
 
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
@@ -115,11 +117,11 @@ struct CCoinsCacheEntry
          */
     };
 
-    CCoinsCacheEntry() : flags(0) {}
-    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
+    CCoinsCacheEntry() : flags(0), nLastUsed(0) {}
+    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0), nLastUsed(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+typedef arenamap<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -164,8 +166,9 @@ public:
     virtual std::vector<uint256> GetHeadBlocks() const;
 
     //! Do a bulk modification (multiple Coin changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    //! If fErase is true, the entries of mapCoins are consumed as they are
+    //! written; otherwise mapCoins is left untouched.
+    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase);
 
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
@@ -191,12 +194,21 @@ public:
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
 };
 
 
+/** How a CCoinsViewCache has been written to its base view */
+struct CCoinsCacheFlushStats
+{
+    uint64_t nFlushes = 0;      //!< Flush() calls, each of which empties the cache
+    uint64_t nSyncs = 0;        //!< Sync() calls, which keep unmodified entries
+    uint64_t nCoinsWritten = 0; //!< Modified entries written to the base view
+    uint64_t nCoinsEvicted = 0; //!< Unmodified entries Sync() dropped to stay within its budget
+};
+
 /** CCoinsView that adds a memory cache for transactions to another CCoinsView */
 class CCoinsViewCache : public CCoinsViewBacked
 {
@@ -211,6 +223,12 @@ protected:
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Advanced on every BatchWrite into this cache (i.e. once per connected
+     * block for pcoinsTip); entries are stamped with it when used. */
+    uint32_t nUseClock;
+
+    CCoinsCacheFlushStats flushStats;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -224,7 +242,7 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     void SetBestBlock(const uint256 &hashBlock);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase) override;
     CCoinsViewCursor* Cursor() const override {
         throw std::logic_error("CCoinsViewCache cursor iteration not supported.");
     }
@@ -268,6 +286,17 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications applied to this cache to its base like Flush(),
+     * but keep the unmodified entries. If the cache then uses more than
+     * nTargetUsage bytes, the least recently used entries are evicted and
+     * the rest repacked until it fits.
+     * If false is returned, the state of this cache (and its backing view) will be undefined.
+     */
+    bool Sync(size_t nTargetUsage);
+
+    const CCoinsCacheFlushStats& GetFlushStats() const { return flushStats; }
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
@@ -295,6 +324,7 @@ public:
 
 private:
     CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
+    void Evict(size_t nTargetUsage);
 };
 
 //! Utility function to add all of a transaction's outputs to a cache.
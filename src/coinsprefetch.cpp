@@ -0,0 +1,199 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coinsprefetch.h>
+
+#include <memusage.h>
+#include <primitives/block.h>
+#include <util.h>
+#include <validation.h>
+
+#include <algorithm>
+
+/** How many recently queued block hashes to remember for de-duplication */
+static const size_t PREFETCH_RECENT_BLOCKS = 64;
+
+CCoinsViewPrefetch::CCoinsViewPrefetch(CCoinsView* viewIn, const Consensus::Params& params, size_t nMaxUsageIn) :
+    CCoinsViewBacked(viewIn), consensusParams(params), nStagedUsage(0), nMaxUsage(nMaxUsageIn), nGeneration(0), fInterrupt(false),
+    nHits(0), nFetched(0), nDropped(0)
+{
+}
+
+CCoinsViewPrefetch::~CCoinsViewPrefetch()
+{
+    Stop();
+}
+
+bool CCoinsViewPrefetch::GetCoin(const COutPoint& outpoint, Coin& coin) const
+{
+    {
+        WaitableLock lock(cs);
+        auto it = mapStaged.find(outpoint);
+        if (it != mapStaged.end()) {
+            // The cache above keeps the coin from now on.
+            nStagedUsage -= it->second.DynamicMemoryUsage();
+            coin = std::move(it->second);
+            mapStaged.erase(it);
+            nHits++;
+            return true;
+        }
+    }
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewPrefetch::HaveCoin(const COutPoint& outpoint) const
+{
+    {
+        WaitableLock lock(cs);
+        if (mapStaged.count(outpoint))
+            return true;
+    }
+    return base->HaveCoin(outpoint);
+}
+
+bool CCoinsViewPrefetch::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool fErase)
+{
+    {
+        WaitableLock lock(cs);
+        nGeneration++;
+        nDropped += mapStaged.size();
+        mapStaged.clear();
+        nStagedUsage = 0;
+        if (!threads.empty()) {
+            LogPrint(BCLog::BENCH, "    - Coins prefetch: %u hits, %u fetched, %u dropped\n", nHits, nFetched, nDropped);
+        }
+    }
+    bool ret = base->BatchWrite(mapCoins, hashBlock, fErase);
+    {
+        // Lookups that started before the write finished may have seen
+        // either state of the database; discard them as well.
+        WaitableLock lock(cs);
+        nGeneration++;
+        mapStaged.clear();
+        nStagedUsage = 0;
+    }
+    return ret;
+}
+
+size_t CCoinsViewPrefetch::EstimateSize() const
+{
+    return base->EstimateSize();
+}
+
+size_t CCoinsViewPrefetch::DynamicMemoryUsage() const
+{
+    WaitableLock lock(cs);
+    return DynamicMemoryUsageLocked();
+}
+
+size_t CCoinsViewPrefetch::DynamicMemoryUsageLocked() const
+{
+    return memusage::DynamicUsage(mapStaged) + nStagedUsage;
+}
+
+void CCoinsViewPrefetch::Start(int nThreads)
+{
+    assert(threads.empty());
+    {
+        WaitableLock lock(cs);
+        fInterrupt = false;
+    }
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([this] { TraceThread("coinsprefetch", [this] { ThreadPrefetch(); }); });
+    }
+}
+
+void CCoinsViewPrefetch::Stop()
+{
+    {
+        WaitableLock lock(cs);
+        fInterrupt = true;
+        queue.clear();
+    }
+    condQueue.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+    WaitableLock lock(cs);
+    nGeneration++;
+    mapStaged.clear();
+    nStagedUsage = 0;
+}
+
+void CCoinsViewPrefetch::Prefetch(const std::vector<std::pair<uint256, CDiskBlockPos>>& vBlocks)
+{
+    {
+        WaitableLock lock(cs);
+        if (threads.empty() || fInterrupt)
+            return;
+        for (const auto& block : vBlocks) {
+            if (std::find(recent.begin(), recent.end(), block.first) != recent.end())
+                continue;
+            queue.push_back(block);
+            recent.push_back(block.first);
+            if (recent.size() > PREFETCH_RECENT_BLOCKS)
+                recent.pop_front();
+        }
+    }
+    condQueue.notify_all();
+}
+
+void CCoinsViewPrefetch::ThreadPrefetch()
+{
+    while (true) {
+        CDiskBlockPos pos;
+        {
+            WaitableLock lock(cs);
+            condQueue.wait(lock, [this] { return fInterrupt || !queue.empty(); });
+            if (fInterrupt)
+                return;
+            pos = queue.front().second;
+            queue.pop_front();
+        }
+
+        // The (aux)PoW of stored blocks was checked before they were written,
+        // and whatever we read here is used as a cache hint only.
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pos, consensusParams, false))
+            continue;
+        FetchBlockInputs(block);
+    }
+}
+
+void CCoinsViewPrefetch::FetchBlockInputs(const CBlock& block)
+{
+    for (const CTransactionRef& tx : block.vtx) {
+        if (tx->IsCoinBase())
+            continue;
+        for (const CTxIn& txin : tx->vin) {
+            uint64_t nGenerationBefore;
+            {
+                WaitableLock lock(cs);
+                if (fInterrupt)
+                    return;
+                if (mapStaged.count(txin.prevout))
+                    continue;
+                // Keep to the budget; the coins handed out, or dropped by
+                // the next flush, make room again.
+                if (DynamicMemoryUsageLocked() >= nMaxUsage)
+                    return;
+                nGenerationBefore = nGeneration;
+            }
+
+            // Coins created by earlier blocks of the batch are not in the
+            // database yet; the cache above will find those itself.
+            Coin coin;
+            if (!base->GetCoin(txin.prevout, coin) || coin.IsSpent())
+                continue;
+
+            const size_t nUsage = coin.DynamicMemoryUsage();
+            WaitableLock lock(cs);
+            if (nGenerationBefore == nGeneration && mapStaged.emplace(txin.prevout, std::move(coin)).second) {
+                nStagedUsage += nUsage;
+                nFetched++;
+            }
+        }
+    }
+}
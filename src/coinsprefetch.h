@@ -0,0 +1,89 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WORLDCOIN_COINSPREFETCH_H
+#define WORLDCOIN_COINSPREFETCH_H
+
+#include <chain.h>
+#include <coins.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <deque>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Consensus { struct Params; }
+class CBlock;
+
+/** Default number of coins prefetch threads (0 disables prefetching) */
+static const int DEFAULT_COINS_PREFETCH_THREADS = 2;
+/** Maximum number of prefetch threads */
+static const int MAX_COINS_PREFETCH_THREADS = 8;
+/** Share of the in-memory coins cache set aside for prefetched coins, in percent */
+static const int COINS_PREFETCH_CACHE_PERCENT = 10;
+
+/**
+ * CCoinsView layer that sits between pcoinsTip and the database, and warms up
+ * the inputs of blocks that are about to be connected.
+ *
+ * Background threads read queued blocks from disk and look up their prevouts
+ * in the database, staging the results. Lookups from the cache above are
+ * served from the staging area first; each staged coin is handed out once.
+ * Any write through this view invalidates everything staged so far, so a
+ * coin read before a flush can never be returned after it. Prefetching stops
+ * while the staged coins take up their memory budget.
+ */
+class CCoinsViewPrefetch final : public CCoinsViewBacked
+{
+private:
+    const Consensus::Params& consensusParams;
+
+    mutable CWaitableCriticalSection cs;
+    CConditionVariable condQueue;
+    mutable std::unordered_map<COutPoint, Coin, SaltedOutpointHasher> mapStaged;
+    //! Dynamic memory usage of the coins in mapStaged
+    mutable size_t nStagedUsage;
+    //! Memory budget of the staged coins
+    const size_t nMaxUsage;
+    //! Bumped before and after every write to the base view
+    uint64_t nGeneration;
+    std::deque<std::pair<uint256, CDiskBlockPos>> queue;
+    //! Recently queued blocks, so that consecutive steps don't queue them twice
+    std::deque<uint256> recent;
+    bool fInterrupt;
+    std::vector<std::thread> threads;
+
+    mutable uint64_t nHits;
+    uint64_t nFetched;
+    uint64_t nDropped;
+
+    void ThreadPrefetch();
+    size_t DynamicMemoryUsageLocked() const;
+
+public:
+    CCoinsViewPrefetch(CCoinsView* viewIn, const Consensus::Params& params, size_t nMaxUsageIn);
+    ~CCoinsViewPrefetch();
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override;
+    bool HaveCoin(const COutPoint& outpoint) const override;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool fErase) override;
+    size_t EstimateSize() const override;
+
+    //! Memory taken by the staged coins
+    size_t DynamicMemoryUsage() const;
+
+    //! Start nThreads prefetch threads
+    void Start(int nThreads);
+    //! Stop and join the prefetch threads, dropping anything staged
+    void Stop();
+    //! Queue blocks for prefetching, in the order they will be connected
+    void Prefetch(const std::vector<std::pair<uint256, CDiskBlockPos>>& vBlocks);
+    //! Look up and stage the inputs of a block (called by the prefetch threads)
+    void FetchBlockInputs(const CBlock& block);
+};
+
+#endif // WORLDCOIN_COINSPREFETCH_H
@@ -0,0 +1,171 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coinstats.h>
+
+#include <chain.h>
+#include <serialize.h>
+#include <streams.h>
+#include <sync.h>
+#include <util.h>
+#include <validation.h>
+#include <version.h>
+
+#include <memory>
+#include <vector>
+
+#include <boost/thread/thread.hpp> // boost::this_thread::interruption_point
+
+CCoinsStatsHasher::CCoinsStatsHasher(CCoinsStats& statsIn) : stats(statsIn), ss(SER_GETHASH, PROTOCOL_VERSION), ss3(SER_GETHASH, PROTOCOL_VERSION)
+{
+    ss << stats.hashBlock;
+    ss3 << stats.hashBlock << stats.nChainTx;
+}
+
+static uint64_t GetBogoSize(const CScript& scriptPubKey)
+{
+    return 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+           2 /* scriptPubKey len */ + scriptPubKey.size() /* scriptPubKey */;
+}
+
+void CCoinsStatsHasher::ApplyOutputs()
+{
+    assert(!outputs.empty());
+    ss << prevkey;
+    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase ? 1u : 0u);
+    ss3 << prevkey;
+    stats.nTransactions++;
+    for (const auto& output : outputs) {
+        ss << VARINT(output.first + 1);
+        ss << output.second.out.scriptPubKey;
+        ss << VARINT(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
+        // Every output carries its own height and coinbase flag, so that
+        // all fields of each Coin are committed to, even where a snapshot
+        // file makes them differ between outputs of one transaction.
+        ss3 << VARINT(output.first + 1);
+        ss3 << VARINT(output.second.nHeight * 2 + (output.second.fCoinBase ? 1u : 0u));
+        ss3 << output.second.out.scriptPubKey;
+        ss3 << VARINT(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
+        stats.nTransactionOutputs++;
+        stats.nTotalAmount += output.second.out.nValue;
+        stats.nBogoSize += GetBogoSize(output.second.out.scriptPubKey);
+    }
+    ss << VARINT(0u);
+    ss3 << VARINT(0u);
+    outputs.clear();
+}
+
+void CCoinsStatsHasher::Add(const COutPoint& outpoint, Coin&& coin)
+{
+    if (!outputs.empty() && outpoint.hash != prevkey) {
+        ApplyOutputs();
+    }
+    prevkey = outpoint.hash;
+    outputs[outpoint.n] = std::move(coin);
+}
+
+void CCoinsStatsHasher::Finalize()
+{
+    if (!outputs.empty()) {
+        ApplyOutputs();
+    }
+    stats.hashSerialized = ss.GetHash();
+    stats.hashSerialized3 = ss3.GetHash();
+}
+
+bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
+    assert(pcursor);
+
+    stats.hashBlock = pcursor->GetBestBlock();
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindex = LookupBlockIndex(stats.hashBlock);
+        stats.nHeight = pindex ? pindex->nHeight : 0;
+        stats.nChainTx = pindex ? pindex->nChainTx : 0;
+    }
+    CCoinsStatsHasher hasher(stats);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        COutPoint key;
+        Coin coin;
+        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            hasher.Add(key, std::move(coin));
+        } else {
+            return error("%s: unable to read value", __func__);
+        }
+        pcursor->Next();
+    }
+    hasher.Finalize();
+    stats.nDiskSize = view->EstimateSize();
+    return true;
+}
+
+//! The bytes a coin contributes to the MuHash of the set
+static void SerializeCoin(CDataStream& ss, const COutPoint& outpoint, const Coin& coin)
+{
+    ss << outpoint;
+    ss << (uint32_t)(coin.nHeight * 2 + coin.fCoinBase);
+    ss << coin.out;
+}
+
+void CCoinsRollingStats::Add(const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    SerializeCoin(ss, outpoint, coin);
+    muhash.Insert((const unsigned char*)ss.data(), ss.size());
+    nTransactionOutputs++;
+    nBogoSize += GetBogoSize(coin.out.scriptPubKey);
+    nTotalAmount += coin.out.nValue;
+}
+
+void CCoinsRollingStats::Remove(const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    SerializeCoin(ss, outpoint, coin);
+    muhash.Remove((const unsigned char*)ss.data(), ss.size());
+    // A delta may go below zero; it wraps around and comes back when applied.
+    nTransactionOutputs--;
+    nBogoSize -= GetBogoSize(coin.out.scriptPubKey);
+    nTotalAmount -= coin.out.nValue;
+}
+
+CCoinsRollingStats& CCoinsRollingStats::operator+=(const CCoinsRollingStats& delta)
+{
+    muhash *= delta.muhash;
+    nTransactionOutputs += delta.nTransactionOutputs;
+    nBogoSize += delta.nBogoSize;
+    nTotalAmount += delta.nTotalAmount;
+    return *this;
+}
+
+uint256 CCoinsRollingStats::GetHash() const
+{
+    MuHash3072 copy = muhash;
+    unsigned char hash[32];
+    copy.Finalize(hash);
+    return uint256(std::vector<unsigned char>(hash, hash + sizeof(hash)));
+}
+
+bool ComputeCoinsRollingStats(CCoinsView* view, CCoinsRollingStats& stats)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
+    assert(pcursor);
+
+    stats = CCoinsRollingStats();
+    stats.hashBlock = pcursor->GetBestBlock();
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        COutPoint key;
+        Coin coin;
+        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            stats.Add(key, coin);
+        } else {
+            return error("%s: unable to read value", __func__);
+        }
+        pcursor->Next();
+    }
+    return true;
+}
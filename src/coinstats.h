@@ -0,0 +1,119 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WORLDCOIN_COINSTATS_H
+#define WORLDCOIN_COINSTATS_H
+
+#include <amount.h>
+#include <coins.h>
+#include <crypto/muhash.h>
+#include <hash.h>
+#include <serialize.h>
+#include <uint256.h>
+
+#include <map>
+#include <stdint.h>
+
+class CCoinsView;
+
+struct CCoinsStats
+{
+    int nHeight;
+    uint256 hashBlock;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nBogoSize;
+    uint256 hashSerialized;
+    //! Like hashSerialized, but covering the heights, coinbase flags and nChainTx too
+    uint256 hashSerialized3;
+    uint64_t nDiskSize;
+    CAmount nTotalAmount;
+    //! nChainTx of hashBlock, which hashSerialized3 commits to
+    unsigned int nChainTx;
+
+    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0), nChainTx(0) {}
+};
+
+/**
+ * Accumulates CCoinsStats (including hash_serialized_2 and hash_serialized_3)
+ * over coins fed in database order, i.e. with all outputs of a transaction
+ * next to each other.
+ *
+ * hash_serialized_2 is kept as it always was, but its height and coinbase
+ * field is only ever 0 or 1, so it doesn't commit to either. Anything that
+ * has to trust a UTXO set by its hash uses hash_serialized_3.
+ */
+class CCoinsStatsHasher
+{
+private:
+    CCoinsStats& stats;
+    CHashWriter ss;
+    CHashWriter ss3;
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
+
+    void ApplyOutputs();
+
+public:
+    //! Start hashing the coins of stats.hashBlock, whose nChainTx is stats.nChainTx
+    explicit CCoinsStatsHasher(CCoinsStats& statsIn);
+
+    void Add(const COutPoint& outpoint, Coin&& coin);
+    //! Account for the last transaction and set stats.hashSerialized and stats.hashSerialized3
+    void Finalize();
+};
+
+//! Calculate statistics about the unspent transaction output set
+bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats);
+
+/**
+ * Statistics about the unspent transaction output set that can be kept up to
+ * date as coins are added and spent, instead of scanning the whole set. The
+ * set is hashed with MuHash3072, so the result doesn't depend on the order
+ * coins were added in. The same class holds the change made by one block.
+ */
+class CCoinsRollingStats
+{
+public:
+    //! The block the statistics are for (unused for a delta)
+    uint256 hashBlock;
+    MuHash3072 muhash;
+    uint64_t nTransactionOutputs;
+    uint64_t nBogoSize;
+    CAmount nTotalAmount;
+
+    CCoinsRollingStats() : nTransactionOutputs(0), nBogoSize(0), nTotalAmount(0) {}
+
+    void Add(const COutPoint& outpoint, const Coin& coin);
+    void Remove(const COutPoint& outpoint, const Coin& coin);
+    //! Apply the change described by a delta. hashBlock is left to the caller.
+    CCoinsRollingStats& operator+=(const CCoinsRollingStats& delta);
+    //! The MuHash of the set. This is slow, see MuHash3072::Finalize.
+    uint256 GetHash() const;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        unsigned char data[MuHash3072::SERIALIZED_SIZE];
+        muhash.ToBytes(data);
+        s << hashBlock;
+        s.write((const char*)data, sizeof(data));
+        s << nTransactionOutputs << nBogoSize << nTotalAmount;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        unsigned char data[MuHash3072::SERIALIZED_SIZE];
+        s >> hashBlock;
+        s.read((char*)data, sizeof(data));
+        s >> nTransactionOutputs >> nBogoSize >> nTotalAmount;
+        muhash.FromBytes(data);
+    }
+};
+
+//! Compute the rolling statistics of a view from scratch
+bool ComputeCoinsRollingStats(CCoinsView* view, CCoinsRollingStats& stats);
+
+#endif // WORLDCOIN_COINSTATS_H
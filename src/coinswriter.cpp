@@ -0,0 +1,235 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coinswriter.h>
+
+#include <memusage.h>
+#include <txdb.h>
+#include <util.h>
+#include <utiltime.h>
+
+CCoinsViewWriter::CCoinsViewWriter(CCoinsView* viewIn, CBlockTreeDB* blocktreeIn) :
+    CCoinsViewBacked(viewIn), blocktree(blocktreeIn), fInterrupt(false), state(State::IDLE), fFailed(false),
+    nLastFile(0), fBlockIndex(false), cachedCoinsUsage(0), fCoins(false)
+{
+}
+
+CCoinsViewWriter::~CCoinsViewWriter()
+{
+    Stop();
+}
+
+bool CCoinsViewWriter::GetCoin(const COutPoint& outpoint, Coin& coin) const
+{
+    {
+        // The writing thread only reads mapCoins, so lookups can go on
+        // while it is being written out.
+        WaitableLock lock(cs);
+        CCoinsMap::const_iterator it = mapCoins.find(outpoint);
+        if (it != mapCoins.end()) {
+            if (it->second.coin.IsSpent())
+                return false;
+            coin = it->second.coin;
+            return true;
+        }
+    }
+    // Not part of the pending write, so the database has the current state.
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewWriter::HaveCoin(const COutPoint& outpoint) const
+{
+    Coin coin;
+    return GetCoin(outpoint, coin);
+}
+
+uint256 CCoinsViewWriter::GetBestBlock() const
+{
+    {
+        WaitableLock lock(cs);
+        if (fCoins)
+            return hashBlock;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewWriter::BatchWrite(CCoinsMap& mapCoinsIn, const uint256& hashBlockIn, bool fErase)
+{
+    WaitableLock lock(cs);
+    if (!WaitForWriter(lock))
+        return false;
+    for (CCoinsMap::iterator it = mapCoinsIn.begin(); it != mapCoinsIn.end(); ) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            CCoinsCacheEntry& entry = mapCoins[it->first];
+            cachedCoinsUsage -= entry.coin.DynamicMemoryUsage();
+            if (fErase) {
+                entry.coin = std::move(it->second.coin);
+            } else {
+                entry.coin = it->second.coin;
+            }
+            entry.flags = CCoinsCacheEntry::DIRTY;
+            cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
+        }
+        it = fErase ? mapCoinsIn.erase(it) : std::next(it);
+    }
+    hashBlock = hashBlockIn;
+    fCoins = true;
+    state = State::STAGED;
+    return true;
+}
+
+size_t CCoinsViewWriter::EstimateSize() const
+{
+    return base->EstimateSize();
+}
+
+size_t CCoinsViewWriter::DynamicMemoryUsage() const
+{
+    WaitableLock lock(cs);
+    return memusage::DynamicUsage(mapCoins) + cachedCoinsUsage;
+}
+
+bool CCoinsViewWriter::StageBlockIndex(std::vector<std::pair<int, CBlockFileInfo>> vFilesIn, int nLastFileIn, std::vector<CBlockIndex> vBlocksIn)
+{
+    WaitableLock lock(cs);
+    if (!WaitForWriter(lock))
+        return false;
+    // Entries staged earlier are older than these, so write them first.
+    vFiles.insert(vFiles.end(), vFilesIn.begin(), vFilesIn.end());
+    vBlocks.insert(vBlocks.end(), vBlocksIn.begin(), vBlocksIn.end());
+    nLastFile = nLastFileIn;
+    fBlockIndex = true;
+    state = State::STAGED;
+    return true;
+}
+
+bool CCoinsViewWriter::Commit(std::function<void()> fnCommittedIn, bool fWait, std::function<void()> fnFailedIn)
+{
+    WaitableLock lock(cs);
+    if (!WaitForWriter(lock))
+        return false;
+    if (state == State::STAGED) {
+        fnCommitted = std::move(fnCommittedIn);
+        state = State::WRITING;
+        if (thread.joinable() && !fInterrupt) {
+            // A write waited for reports its failure through the result.
+            if (!fWait)
+                fnFailed = std::move(fnFailedIn);
+            condWriter.notify_all();
+            if (!fWait)
+                return true;
+        } else {
+            Write(lock);
+        }
+    }
+    return WaitForWriter(lock);
+}
+
+bool CCoinsViewWriter::WaitForWriter(WaitableLock& lock)
+{
+    condWriter.wait(lock, [this] { return state != State::WRITING; });
+    return !fFailed;
+}
+
+bool CCoinsViewWriter::WriteStaged()
+{
+    if (fBlockIndex) {
+        std::vector<std::pair<int, const CBlockFileInfo*>> vFileInfo;
+        vFileInfo.reserve(vFiles.size());
+        for (const auto& file : vFiles)
+            vFileInfo.emplace_back(file.first, &file.second);
+        std::vector<const CBlockIndex*> vBlockIndex;
+        vBlockIndex.reserve(vBlocks.size());
+        for (const CBlockIndex& index : vBlocks)
+            vBlockIndex.push_back(&index);
+        if (!blocktree->WriteBatchSync(vFileInfo, nLastFile, vBlockIndex)) {
+            LogPrintf("%s: failed to write to block index database\n", __func__);
+            return false;
+        }
+    }
+    // The chainstate may refer to the block index entries just written.
+    if (fCoins && !base->BatchWrite(mapCoins, hashBlock, false)) {
+        LogPrintf("%s: failed to write to coin database\n", __func__);
+        return false;
+    }
+    return true;
+}
+
+void CCoinsViewWriter::Write(WaitableLock& lock)
+{
+    const size_t nCoins = mapCoins.size();
+    const size_t nBlocks = vBlocks.size();
+    int64_t nStart = GetTimeMicros();
+    bool fSuccess;
+    lock.unlock();
+    try {
+        fSuccess = WriteStaged();
+        if (fSuccess && fnCommitted)
+            fnCommitted();
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+        fSuccess = false;
+    }
+    lock.lock();
+    LogPrint(BCLog::BENCH, "    - Chainstate write: %u coins, %u block index entries in %.2fms\n",
+        nCoins, nBlocks, (GetTimeMicros() - nStart) / 1000.0);
+    if (fSuccess) {
+        vFiles.clear();
+        vBlocks.clear();
+        fBlockIndex = false;
+        mapCoins.clear();
+        cachedCoinsUsage = 0;
+        fCoins = false;
+    } else {
+        // Keep serving the unwritten coins; the node shuts down anyway.
+        fFailed = true;
+    }
+    fnCommitted = nullptr;
+    state = fSuccess ? State::IDLE : State::STAGED;
+    condWriter.notify_all();
+}
+
+void CCoinsViewWriter::ThreadWriter()
+{
+    WaitableLock lock(cs);
+    while (true) {
+        condWriter.wait(lock, [this] { return fInterrupt || state == State::WRITING; });
+        if (fInterrupt)
+            return;
+        Write(lock);
+        // Don't leave the failure to be noticed by the next flush, which
+        // may be a long way off.
+        std::function<void()> fn = std::move(fnFailed);
+        fnFailed = nullptr;
+        if (fFailed && fn) {
+            lock.unlock();
+            fn();
+            lock.lock();
+        }
+    }
+}
+
+void CCoinsViewWriter::Start()
+{
+    assert(!thread.joinable());
+    {
+        WaitableLock lock(cs);
+        fInterrupt = false;
+    }
+    thread = std::thread([this] { TraceThread("chainstatewriter", [this] { ThreadWriter(); }); });
+}
+
+void CCoinsViewWriter::Stop()
+{
+    {
+        // Writes handed to the thread are finished first; from then on
+        // Commit() writes on the calling thread.
+        WaitableLock lock(cs);
+        WaitForWriter(lock);
+        fInterrupt = true;
+    }
+    condWriter.notify_all();
+    if (thread.joinable())
+        thread.join();
+}
@@ -0,0 +1,105 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WORLDCOIN_COINSWRITER_H
+#define WORLDCOIN_COINSWRITER_H
+
+#include <chain.h>
+#include <coins.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class CBlockTreeDB;
+
+/** Default for -chainstatewriter */
+static const bool DEFAULT_CHAINSTATE_WRITER = true;
+
+/**
+ * CCoinsView layer that commits chainstate and block index updates to disk
+ * from a background thread.
+ *
+ * A flush first stages the dirty block index entries and the dirty coins
+ * handed down by the cache above, and then commits them with Commit(). The
+ * block index batch is written before the coins batch, exactly as a
+ * synchronous flush would, and the coins go through CCoinsViewDB::BatchWrite
+ * so the head blocks markers keep a crash mid-write recoverable.
+ *
+ * Until the write has completed, lookups are answered from the staged coins
+ * first, so everything above sees the state as of the last flush even while
+ * the database is still behind. Only one write is in flight at a time: staging
+ * the next one waits for the previous to finish. Without a running thread,
+ * Commit() writes on the calling thread.
+ */
+class CCoinsViewWriter final : public CCoinsViewBacked
+{
+private:
+    CBlockTreeDB* blocktree;
+
+    mutable CWaitableCriticalSection cs;
+    CConditionVariable condWriter;
+    std::thread thread;
+    bool fInterrupt;
+
+    //! Whether a write is staged, being written, or neither
+    enum class State { IDLE, STAGED, WRITING } state;
+    //! Set once a write has failed; no further writes are accepted
+    bool fFailed;
+
+    // The staged (or in-flight) write
+    std::vector<std::pair<int, CBlockFileInfo>> vFiles;
+    int nLastFile;
+    std::vector<CBlockIndex> vBlocks;
+    bool fBlockIndex;
+    CCoinsMap mapCoins;
+    //! Dynamic memory usage of the coins in mapCoins
+    size_t cachedCoinsUsage;
+    uint256 hashBlock;
+    bool fCoins;
+    std::function<void()> fnCommitted;
+    //! Called on the writer thread if its write fails
+    std::function<void()> fnFailed;
+
+    //! Wait until no write is in flight, returning false if one failed
+    bool WaitForWriter(WaitableLock& lock);
+    //! Write out the staged batches (called without cs held)
+    bool WriteStaged();
+    //! Run WriteStaged and record its result
+    void Write(WaitableLock& lock);
+    void ThreadWriter();
+
+public:
+    CCoinsViewWriter(CCoinsView* viewIn, CBlockTreeDB* blocktreeIn);
+    ~CCoinsViewWriter();
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override;
+    bool HaveCoin(const COutPoint& outpoint) const override;
+    uint256 GetBestBlock() const override;
+    bool BatchWrite(CCoinsMap& mapCoinsIn, const uint256& hashBlockIn, bool fErase) override;
+    size_t EstimateSize() const override;
+
+    //! Memory taken by the staged (or in-flight) coins
+    size_t DynamicMemoryUsage() const;
+
+    //! Stage block file and block index updates for the next Commit()
+    bool StageBlockIndex(std::vector<std::pair<int, CBlockFileInfo>> vFilesIn, int nLastFileIn, std::vector<CBlockIndex> vBlocksIn);
+    /**
+     * Write out everything staged. fnCommittedIn runs (on the writing thread)
+     * once it is on disk. Unless fWait is set, this returns as soon as the
+     * write is handed to the background thread; the result reports earlier
+     * failures only, and fnFailedIn runs on that thread if the write fails.
+     */
+    bool Commit(std::function<void()> fnCommittedIn, bool fWait, std::function<void()> fnFailedIn = nullptr);
+
+    //! Start the background writer thread
+    void Start();
+    //! Finish any in-flight write and stop the writer thread
+    void Stop();
+};
+
+#endif // WORLDCOIN_COINSWRITER_H
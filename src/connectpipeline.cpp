@@ -0,0 +1,214 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <connectpipeline.h>
+
+#include <consensus/validation.h>
+#include <primitives/block.h>
+#include <util.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <algorithm>
+
+CConnectPipeline::CConnectPipeline(const Consensus::Params& params) :
+    consensusParams(params), nDepth(0), fInterrupt(false), nStartMicros(0)
+{
+}
+
+CConnectPipeline::~CConnectPipeline()
+{
+    Stop();
+}
+
+bool CConnectPipeline::Contains(const uint256& hash) const
+{
+    return setInFlight.count(hash) ||
+        std::any_of(readQueue.begin(), readQueue.end(), [&hash](const std::pair<uint256, CDiskBlockPos>& entry) { return entry.first == hash; }) ||
+        std::any_of(ready.begin(), ready.end(), [&hash](const std::pair<uint256, std::shared_ptr<const CBlock>>& entry) { return entry.first == hash; });
+}
+
+void CConnectPipeline::Start(int nDepthIn)
+{
+    assert(threads.empty());
+    {
+        WaitableLock lock(cs);
+        fInterrupt = false;
+        nDepth = nDepthIn;
+        stats = ConnectPipelineStats();
+        nStartMicros = GetTimeMicros();
+    }
+    threads.emplace_back([this] { TraceThread("blockread", [this] { ThreadRead(); }); });
+    threads.emplace_back([this] { TraceThread("blockcheck", [this] { ThreadCheck(); }); });
+}
+
+void CConnectPipeline::Stop()
+{
+    {
+        WaitableLock lock(cs);
+        fInterrupt = true;
+    }
+    cond.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+    WaitableLock lock(cs);
+    readQueue.clear();
+    checkQueue.clear();
+    ready.clear();
+    setInFlight.clear();
+}
+
+void CConnectPipeline::Schedule(const std::vector<std::pair<uint256, CDiskBlockPos>>& vBlocks)
+{
+    {
+        WaitableLock lock(cs);
+        if (threads.empty() || fInterrupt)
+            return;
+        std::set<uint256> setScheduled;
+        for (const auto& block : vBlocks)
+            setScheduled.insert(block.first);
+
+        // Forget blocks we are no longer about to connect (after a reorg, or
+        // blocks that turned out invalid), so they don't take up room.
+        readQueue.clear();
+        for (auto it = checkQueue.begin(); it != checkQueue.end(); ) {
+            if (setScheduled.count(it->first)) {
+                ++it;
+                continue;
+            }
+            setInFlight.erase(it->first);
+            it = checkQueue.erase(it);
+            stats.nDropped++;
+        }
+        for (auto it = ready.begin(); it != ready.end(); ) {
+            if (setScheduled.count(it->first)) {
+                ++it;
+                continue;
+            }
+            it = ready.erase(it);
+            stats.nDropped++;
+        }
+
+        for (const auto& block : vBlocks) {
+            if (!Contains(block.first))
+                readQueue.push_back(block);
+        }
+    }
+    cond.notify_all();
+}
+
+std::shared_ptr<const CBlock> CConnectPipeline::Take(const uint256& hash)
+{
+    WaitableLock lock(cs);
+    if (threads.empty())
+        return nullptr;
+
+    // Reading a block nobody has started on is no slower right here.
+    auto itQueued = std::find_if(readQueue.begin(), readQueue.end(), [&hash](const std::pair<uint256, CDiskBlockPos>& entry) { return entry.first == hash; });
+    if (itQueued != readQueue.end()) {
+        readQueue.erase(itQueued);
+        stats.nMisses++;
+        return nullptr;
+    }
+
+    bool fWaited = false;
+    if (setInFlight.count(hash)) {
+        fWaited = true;
+        cond.wait(lock, [this, &hash] { return fInterrupt || !setInFlight.count(hash); });
+    }
+    auto itReady = std::find_if(ready.begin(), ready.end(), [&hash](const std::pair<uint256, std::shared_ptr<const CBlock>>& entry) { return entry.first == hash; });
+    if (itReady == ready.end()) {
+        stats.nMisses++;
+        return nullptr;
+    }
+    std::shared_ptr<const CBlock> pblock = std::move(itReady->second);
+    ready.erase(itReady);
+    if (fWaited) {
+        stats.nWaits++;
+    } else {
+        stats.nHits++;
+    }
+    // There is room for another block now.
+    cond.notify_all();
+    return pblock;
+}
+
+ConnectPipelineStats CConnectPipeline::GetStats() const
+{
+    WaitableLock lock(cs);
+    ConnectPipelineStats ret = stats;
+    ret.nDepth = threads.empty() ? 0 : nDepth;
+    ret.read.nQueued = readQueue.size();
+    ret.check.nQueued = checkQueue.size();
+    ret.nReady = ready.size();
+    ret.nElapsedMicros = threads.empty() ? 0 : GetTimeMicros() - nStartMicros;
+    return ret;
+}
+
+void CConnectPipeline::ThreadRead()
+{
+    while (true) {
+        std::pair<uint256, CDiskBlockPos> next;
+        {
+            WaitableLock lock(cs);
+            cond.wait(lock, [this] { return fInterrupt || (!readQueue.empty() && setInFlight.size() + ready.size() < (size_t)nDepth); });
+            if (fInterrupt)
+                return;
+            next = readQueue.front();
+            readQueue.pop_front();
+            setInFlight.insert(next.first);
+        }
+
+        // The proof of work is left to the check stage, with the rest of
+        // CheckBlock(), so that the two stages share the work.
+        const int64_t nStart = GetTimeMicros();
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        const bool fRead = ReadBlockFromDisk(*pblock, next.second, consensusParams, false) && pblock->GetHash() == next.first;
+
+        {
+            WaitableLock lock(cs);
+            stats.read.nBusyMicros += GetTimeMicros() - nStart;
+            stats.read.nProcessed++;
+            if (fRead) {
+                checkQueue.emplace_back(next.first, std::move(pblock));
+            } else {
+                setInFlight.erase(next.first);
+            }
+        }
+        cond.notify_all();
+    }
+}
+
+void CConnectPipeline::ThreadCheck()
+{
+    while (true) {
+        std::pair<uint256, std::shared_ptr<CBlock>> next;
+        {
+            WaitableLock lock(cs);
+            cond.wait(lock, [this] { return fInterrupt || !checkQueue.empty(); });
+            if (fInterrupt)
+                return;
+            next = std::move(checkQueue.front());
+            checkQueue.pop_front();
+        }
+
+        // On success this marks the block as checked, so ConnectBlock() does
+        // not repeat the work. Failures are left for ConnectTip() to report.
+        const int64_t nStart = GetTimeMicros();
+        CValidationState state;
+        const bool fValid = CheckBlock(*next.second, state, consensusParams);
+
+        {
+            WaitableLock lock(cs);
+            stats.check.nBusyMicros += GetTimeMicros() - nStart;
+            stats.check.nProcessed++;
+            // Schedule() may have dropped the block meanwhile.
+            if (setInFlight.erase(next.first) && fValid)
+                ready.emplace_back(next.first, std::move(next.second));
+        }
+        cond.notify_all();
+    }
+}
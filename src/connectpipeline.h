@@ -0,0 +1,108 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WORLDCOIN_CONNECTPIPELINE_H
+#define WORLDCOIN_CONNECTPIPELINE_H
+
+#include <chain.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <deque>
+#include <memory>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Consensus { struct Params; }
+class CBlock;
+
+/** Default for -connectpipelinedepth (0 disables the pipeline) */
+static const int DEFAULT_CONNECT_PIPELINE_DEPTH = 8;
+/** Maximum number of blocks the pipeline may hold */
+static const int MAX_CONNECT_PIPELINE_DEPTH = 64;
+
+/** Counters for one stage of the connect pipeline */
+struct ConnectPipelineStageStats
+{
+    size_t nQueued = 0;      //!< Blocks waiting for this stage
+    uint64_t nProcessed = 0; //!< Blocks this stage has finished
+    int64_t nBusyMicros = 0; //!< Time this stage spent working
+};
+
+struct ConnectPipelineStats
+{
+    int nDepth = 0;
+    ConnectPipelineStageStats read;  //!< Reading and deserializing blocks
+    ConnectPipelineStageStats check; //!< Context-free CheckBlock()
+    size_t nReady = 0;       //!< Blocks checked and waiting to be connected
+    uint64_t nHits = 0;      //!< Blocks ConnectTip() found ready
+    uint64_t nWaits = 0;     //!< Blocks ConnectTip() had to wait for
+    uint64_t nMisses = 0;    //!< Blocks ConnectTip() had to read itself
+    uint64_t nDropped = 0;   //!< Blocks read or checked but never connected
+    int64_t nElapsedMicros = 0; //!< Time since the pipeline was started
+};
+
+/**
+ * Reads and checks the blocks that ActivateBestChainStep() is about to
+ * connect, so that ConnectTip() finds them ready.
+ *
+ * The read stage loads and deserializes blocks from disk, and the check stage
+ * runs the context-free CheckBlock() on them, each on its own thread, while
+ * the message handler thread connects the block before them. A block that
+ * fails a check is dropped here; ConnectTip() then reads it itself and
+ * reports the failure as before. At most nDepth blocks are in the pipeline.
+ */
+class CConnectPipeline
+{
+private:
+    const Consensus::Params& consensusParams;
+
+    mutable CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    int nDepth;
+    bool fInterrupt;
+    std::vector<std::thread> threads;
+
+    //! Blocks to read, in the order they will be connected
+    std::deque<std::pair<uint256, CDiskBlockPos>> readQueue;
+    //! Blocks read and waiting for the check stage
+    std::deque<std::pair<uint256, std::shared_ptr<CBlock>>> checkQueue;
+    //! Blocks checked and waiting to be connected
+    std::deque<std::pair<uint256, std::shared_ptr<const CBlock>>> ready;
+    //! Blocks being read or checked, or waiting for the check stage
+    std::set<uint256> setInFlight;
+
+    ConnectPipelineStats stats;
+    int64_t nStartMicros;
+
+    //! Whether hash is somewhere in the pipeline
+    bool Contains(const uint256& hash) const;
+    void ThreadRead();
+    void ThreadCheck();
+
+public:
+    explicit CConnectPipeline(const Consensus::Params& params);
+    ~CConnectPipeline();
+
+    //! Start the stage threads, holding at most nDepthIn blocks
+    void Start(int nDepthIn);
+    //! Stop and join the stage threads, dropping all blocks
+    void Stop();
+    /**
+     * Set the blocks to be connected next, in order. Blocks in the pipeline
+     * that are no longer among them are dropped.
+     */
+    void Schedule(const std::vector<std::pair<uint256, CDiskBlockPos>>& vBlocks);
+    /**
+     * Take a block out of the pipeline, waiting for it if one of the stages
+     * is working on it. Returns nullptr if the caller should read it itself.
+     */
+    std::shared_ptr<const CBlock> Take(const uint256& hash);
+
+    ConnectPipelineStats GetStats() const;
+};
+
+#endif // WORLDCOIN_CONNECTPIPELINE_H
@@ -0,0 +1,192 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/muhash.h>
+
+#include <crypto/chacha20.h>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
+
+#include <assert.h>
+#include <string.h>
+
+namespace {
+
+/** 2^3072 - MAX_PRIME_DIFF is the largest prime below 2^3072 */
+const uint32_t MAX_PRIME_DIFF = 1103717;
+
+typedef Num3072::limb_t limb_t;
+typedef Num3072::double_limb_t double_limb_t;
+const int LIMB_SIZE = Num3072::LIMB_SIZE;
+
+/** Set r to r + a, returning the carry out of the top limb */
+limb_t AddSmall(limb_t* r, size_t n, double_limb_t a)
+{
+    for (size_t i = 0; i < n && a; i++) {
+        a += r[i];
+        r[i] = (limb_t)a;
+        a >>= LIMB_SIZE;
+    }
+    return (limb_t)a;
+}
+
+limb_t ReadLimb(const unsigned char* data)
+{
+    return LIMB_SIZE == 64 ? (limb_t)ReadLE64(data) : (limb_t)ReadLE32(data);
+}
+
+void WriteLimb(unsigned char* out, limb_t limb)
+{
+    if (LIMB_SIZE == 64) {
+        WriteLE64(out, (uint64_t)limb);
+    } else {
+        WriteLE32(out, (uint32_t)limb);
+    }
+}
+
+} // namespace
+
+Num3072::Num3072()
+{
+    SetToOne();
+}
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (size_t i = 0; i < LIMBS; i++) {
+        limbs[i] = ReadLimb(data + sizeof(limb_t) * i);
+    }
+    FullReduce();
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    for (size_t i = 0; i < LIMBS; i++) {
+        WriteLimb(out + sizeof(limb_t) * i, limbs[i]);
+    }
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    memset(limbs + 1, 0, (LIMBS - 1) * sizeof(limbs[0]));
+}
+
+bool Num3072::IsOverflow() const
+{
+    // The prime is all ones but for its lowest limb.
+    if (limbs[0] <= (limb_t)-1 - MAX_PRIME_DIFF) return false;
+    for (size_t i = 1; i < LIMBS; i++) {
+        if (limbs[i] != (limb_t)-1) return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // Subtracting the prime is adding MAX_PRIME_DIFF and dropping 2^3072.
+    if (IsOverflow()) {
+        AddSmall(limbs, LIMBS, MAX_PRIME_DIFF);
+    }
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    // Schoolbook product into 2 * LIMBS limbs.
+    limb_t tmp[2 * LIMBS] = {0};
+    for (size_t i = 0; i < LIMBS; i++) {
+        double_limb_t carry = 0;
+        for (size_t j = 0; j < LIMBS; j++) {
+            carry += tmp[i + j] + (double_limb_t)limbs[i] * a.limbs[j];
+            tmp[i + j] = (limb_t)carry;
+            carry >>= LIMB_SIZE;
+        }
+        tmp[i + LIMBS] = (limb_t)carry;
+    }
+
+    // As 2^3072 = MAX_PRIME_DIFF (mod p), fold the high half into the low one,
+    // and then whatever carries out of that, until nothing does.
+    double_limb_t carry = 0;
+    for (size_t i = 0; i < LIMBS; i++) {
+        carry += tmp[i] + (double_limb_t)tmp[i + LIMBS] * MAX_PRIME_DIFF;
+        limbs[i] = (limb_t)carry;
+        carry >>= LIMB_SIZE;
+    }
+    while (carry) {
+        carry = AddSmall(limbs, LIMBS, carry * MAX_PRIME_DIFF);
+    }
+    FullReduce();
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // By Fermat's little theorem, a^(p-2) is the inverse of a. The exponent
+    // is all ones but for its lowest limb.
+    const limb_t nLowLimb = (limb_t)-1 - MAX_PRIME_DIFF - 1;
+    Num3072 r;
+    for (size_t i = LIMBS; i-- > 0;) {
+        const limb_t nLimb = i == 0 ? nLowLimb : (limb_t)-1;
+        for (int bit = LIMB_SIZE - 1; bit >= 0; bit--) {
+            r.Multiply(r);
+            if ((nLimb >> bit) & 1) {
+                r.Multiply(*this);
+            }
+        }
+    }
+    return r;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(hash);
+    unsigned char expanded[Num3072::BYTE_SIZE];
+    ChaCha20(hash, sizeof(hash)).Output(expanded, sizeof(expanded));
+    return Num3072(expanded);
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char (&out)[32])
+{
+    numerator.Divide(denominator);
+    denominator.SetToOne();
+    unsigned char data[Num3072::BYTE_SIZE];
+    numerator.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(out);
+}
+
+void MuHash3072::ToBytes(unsigned char (&out)[SERIALIZED_SIZE]) const
+{
+    numerator.ToBytes(*reinterpret_cast<unsigned char (*)[Num3072::BYTE_SIZE]>(out));
+    denominator.ToBytes(*reinterpret_cast<unsigned char (*)[Num3072::BYTE_SIZE]>(out + Num3072::BYTE_SIZE));
+}
+
+void MuHash3072::FromBytes(const unsigned char (&data)[SERIALIZED_SIZE])
+{
+    numerator = Num3072(*reinterpret_cast<const unsigned char (*)[Num3072::BYTE_SIZE]>(data));
+    denominator = Num3072(*reinterpret_cast<const unsigned char (*)[Num3072::BYTE_SIZE]>(data + Num3072::BYTE_SIZE));
+}
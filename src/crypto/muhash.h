@@ -0,0 +1,79 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WORLDCOIN_CRYPTO_MUHASH_H
+#define WORLDCOIN_CRYPTO_MUHASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** A number modulo the prime 2^3072 - 1103717, in little-endian limbs. */
+class Num3072
+{
+public:
+#ifdef __SIZEOF_INT128__
+    typedef uint64_t limb_t;
+    typedef unsigned __int128 double_limb_t;
+#else
+    typedef uint32_t limb_t;
+    typedef uint64_t double_limb_t;
+#endif
+    static const int LIMB_SIZE = 8 * sizeof(limb_t);
+    static const size_t LIMBS = 3072 / LIMB_SIZE;
+    static const size_t BYTE_SIZE = 384;
+    limb_t limbs[LIMBS];
+
+    //! Initialize to 1
+    Num3072();
+    //! Read 384 little-endian bytes, reducing them if need be
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]) const;
+
+    void Multiply(const Num3072& a);
+    void Divide(const Num3072& a);
+    void SetToOne();
+
+private:
+    bool IsOverflow() const;
+    void FullReduce();
+    Num3072 GetInverse() const;
+};
+
+/**
+ * A set hash: the hash of a multiset of byte strings, that doesn't depend on
+ * the order they were added in, and that can be updated when some are added
+ * or removed without looking at the others.
+ *
+ * Every element is hashed to a number modulo a 3072-bit prime (SHA256, then
+ * expanded with ChaCha20), and the set hash is the SHA256 of their product.
+ * Removed elements are multiplied into a separate denominator, so that the
+ * one costly division only happens when the hash is finalized. Two MuHash3072
+ * objects can be combined by multiplying them.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    static const size_t SERIALIZED_SIZE = 2 * Num3072::BYTE_SIZE;
+
+    //! The hash of the empty set
+    MuHash3072() {}
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+    //! Combine with the elements (and removals) of another set
+    MuHash3072& operator*=(const MuHash3072& mul);
+    //! Write the 32-byte hash of the set. This is slow (a few tens of ms).
+    void Finalize(unsigned char (&out)[32]);
+
+    void ToBytes(unsigned char (&out)[SERIALIZED_SIZE]) const;
+    void FromBytes(const unsigned char (&data)[SERIALIZED_SIZE]);
+};
+
+#endif // WORLDCOIN_CRYPTO_MUHASH_H
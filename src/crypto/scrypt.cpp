@@ -27,13 +27,39 @@
  * online backup system.
  */
 
+#if defined(HAVE_CONFIG_H)
+#include "config/worldcoin-config.h"
+#endif
+
 #include "crypto/scrypt.h"
+#include "crypto/common.h"
 #include "crypto/hmac_sha256.h"
+#include <assert.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <atomic>
+#include <memory>
 #include <openssl/sha.h>
 
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
+namespace scrypt_avx2
+{
+void scrypt_1024_1_1_256_sp_8way(const char *input, char *output, char *scratchpad);
+}
+
+namespace scrypt_avx512
+{
+void scrypt_1024_1_1_256_sp_16way(const char *input, char *output, char *scratchpad);
+}
+
 #if defined(USE_SSE2) && !defined(USE_SSE2_ALWAYS)
 #ifdef _MSC_VER
 // MSVC 64bit is unable to use inline asm
@@ -252,8 +278,222 @@ void scrypt_detect_sse2()
 }
 #endif
 
+namespace
+{
+/** Widest multi-lane kernel; the per-thread scratchpad is sized for it. */
+const size_t SCRYPT_MAX_LANES = 16;
+/** Scratchpad bytes used per lane once the buffer is 64-byte aligned. */
+const size_t SCRYPT_LANE_SIZE = SCRYPT_SCRATCHPAD_SIZE - 63;
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+std::atomic<bool> g_huge_pages(false);
+
+/**
+ * Scratchpad memory kept for the lifetime of a thread, so that hashing does
+ * not put 128 KiB on the stack (or the heap, for the multi-lane kernels) for
+ * every header. With ScryptUseHugePages(true) the buffer is mapped as huge
+ * pages if the system has them reserved, or advised for transparent huge
+ * pages otherwise, so that the random accesses of scrypt's second loop do
+ * not miss the TLB.
+ */
+class ScryptScratchpad
+{
+private:
+    char* data;
+    size_t size;
+    std::unique_ptr<char[]> heap;
+
+public:
+    ScryptScratchpad() : data(nullptr), size(0) {}
+    ~ScryptScratchpad()
+    {
+#ifndef WIN32
+        if (data && !heap) munmap(data, size);
+#endif
+    }
+
+    /** Return a 64-byte aligned buffer of SCRYPT_MAX_LANES * SCRYPT_LANE_SIZE bytes. */
+    char* Get()
+    {
+        if (data) return data;
+        const size_t nSize = SCRYPT_MAX_LANES * SCRYPT_LANE_SIZE;
+#ifndef WIN32
+        if (g_huge_pages) {
+            const size_t nMapSize = (nSize + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+            void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+            p = mmap(nullptr, nMapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+            if (p == MAP_FAILED) {
+                p = mmap(nullptr, nMapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+                if (p != MAP_FAILED) madvise(p, nMapSize, MADV_HUGEPAGE);
+#endif
+            }
+            if (p != MAP_FAILED) {
+                data = (char*)p;
+                size = nMapSize;
+                return data;
+            }
+        }
+#endif
+        heap.reset(new char[nSize + 63]);
+        data = (char*)(((uintptr_t)heap.get() + 63) & ~(uintptr_t)63);
+        size = nSize;
+        return data;
+    }
+};
+
+#ifdef HAVE_THREAD_LOCAL
+thread_local ScryptScratchpad g_scratchpad;
+#endif
+
+/** The calling thread's scratchpad, or nullptr if it is not available. */
+char* ThreadScratchpad()
+{
+#ifdef HAVE_THREAD_LOCAL
+    return g_scratchpad.Get();
+#else
+    return nullptr;
+#endif
+}
+} // namespace
+
+void ScryptUseHugePages(bool fUse)
+{
+    g_huge_pages = fUse;
+}
+
 void scrypt_1024_1_1_256(const char *input, char *output)
 {
-	char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
-    scrypt_1024_1_1_256_sp(input, output, scratchpad);
+    char* scratchpad = ThreadScratchpad();
+    if (scratchpad) {
+        scrypt_1024_1_1_256_sp(input, output, scratchpad);
+    } else {
+        char stack_scratchpad[SCRYPT_SCRATCHPAD_SIZE];
+        scrypt_1024_1_1_256_sp(input, output, stack_scratchpad);
+    }
+}
+
+namespace
+{
+typedef void (*ScryptMultiFn)(const char *input, char *output, char *scratchpad);
+
+/** Multi-lane kernels, left unset until ScryptAutoDetect() finds CPU support. */
+ScryptMultiFn scrypt_8way = nullptr;
+ScryptMultiFn scrypt_16way = nullptr;
+
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+// We can't use cpuid.h's __get_cpuid as it does not support subleafs.
+void inline cpuid(uint32_t leaf, uint32_t subleaf, uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d)
+{
+#ifdef __GNUC__
+    __cpuid_count(leaf, subleaf, a, b, c, d);
+#else
+  __asm__ ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "0"(leaf), "2"(subleaf));
+#endif
+}
+
+/** Return the OS-enabled state components from XCR0. */
+uint32_t XCR0()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return a;
+}
+#endif
+
+/** Hash blocks of `lanes` headers at a time with `fn`, returning how many were hashed. */
+size_t ScryptMultiRun(ScryptMultiFn fn, size_t lanes, const char *input, char *output, size_t count)
+{
+    if (!fn || count < lanes) return 0;
+    std::unique_ptr<char[]> heap_scratchpad;
+    char* scratchpad = ThreadScratchpad();
+    if (!scratchpad) {
+        heap_scratchpad.reset(new char[lanes * SCRYPT_LANE_SIZE + 63]);
+        scratchpad = heap_scratchpad.get();
+    }
+    size_t done = 0;
+    while (count - done >= lanes) {
+        fn(input + 80 * done, output + 32 * done, scratchpad);
+        done += lanes;
+    }
+    return done;
+}
+
+/** Check the multi-lane kernels against the generic implementation. */
+bool SelfTest()
+{
+    char input[16 * 80];
+    char expected[16 * 32];
+    char output[16 * 32];
+    std::unique_ptr<char[]> scratchpad(new char[SCRYPT_SCRATCHPAD_SIZE]);
+    for (size_t i = 0; i < sizeof(input); i++) {
+        input[i] = (char)(i * 7 + 3);
+    }
+    for (size_t i = 0; i < 16; i++) {
+        scrypt_1024_1_1_256_sp_generic(input + 80 * i, expected + 32 * i, scratchpad.get());
+    }
+
+    ScryptMultiFn fns[] = {scrypt_8way, scrypt_16way};
+    size_t lanes[] = {8, 16};
+    for (size_t n = 0; n < 2; n++) {
+        memset(output, 0, sizeof(output));
+        if (ScryptMultiRun(fns[n], lanes[n], input, output, lanes[n]) &&
+            memcmp(output, expected, 32 * lanes[n]) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
+std::string ScryptAutoDetect()
+{
+    std::string ret = "standard";
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+    bool have_avx2 = false;
+    bool have_avx512f = false;
+    uint32_t xcr0 = 0;
+
+    (void)have_avx2;
+    (void)have_avx512f;
+
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, 0, eax, ebx, ecx, edx);
+    bool have_xsave = (ecx >> 27) & 1;
+    bool have_avx = (ecx >> 28) & 1;
+    if (have_xsave && have_avx) {
+        xcr0 = XCR0();
+        cpuid(7, 0, eax, ebx, ecx, edx);
+        // AVX2 needs the YMM state enabled; AVX-512 additionally needs opmask and ZMM state.
+        have_avx2 = ((ebx >> 5) & 1) && (xcr0 & 0x06) == 0x06;
+        have_avx512f = ((ebx >> 16) & 1) && (xcr0 & 0xe6) == 0xe6;
+    }
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_WORLDCOIN_INTERNAL)
+    if (have_avx2) {
+        scrypt_8way = scrypt_avx2::scrypt_1024_1_1_256_sp_8way;
+        ret = "avx2(8way)";
+    }
+#endif
+#if defined(ENABLE_AVX512F) && !defined(BUILD_WORLDCOIN_INTERNAL)
+    if (have_avx512f) {
+        scrypt_16way = scrypt_avx512::scrypt_1024_1_1_256_sp_16way;
+        ret = scrypt_8way ? ret + ",avx512f(16way)" : "avx512f(16way)";
+    }
+#endif
+#endif
+
+    assert(SelfTest());
+    return ret;
+}
+
+void scrypt_1024_1_1_256_multi(const char *input, char *output, size_t count)
+{
+    size_t done = ScryptMultiRun(scrypt_16way, 16, input, output, count);
+    done += ScryptMultiRun(scrypt_8way, 8, input + 80 * done, output + 32 * done, count - done);
+    for (; done < count; done++) {
+        scrypt_1024_1_1_256(input + 80 * done, output + 32 * done);
+    }
 }
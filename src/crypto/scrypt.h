@@ -2,12 +2,32 @@
 #define SCRYPT_H
 #include <stdlib.h>
 #include <stdint.h>
+#include <string>
 
 static const int SCRYPT_SCRATCHPAD_SIZE = 131072 + 63;
 
 void scrypt_1024_1_1_256(const char *input, char *output);
 void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad);
 
+/** Compute multiple scrypt(1024, 1, 1) hashes of 80-byte block headers.
+ *  input:   pointer to a count*80 byte input buffer
+ *  output:  pointer to a count*32 byte output buffer
+ *  count:   the number of hashes to compute.
+ *  Uses the widest multi-lane kernel selected by ScryptAutoDetect() and hashes
+ *  any remainder one at a time.
+ */
+void scrypt_1024_1_1_256_multi(const char *input, char *output, size_t count);
+
+/** Autodetect the best available multi-lane scrypt implementation.
+ *  Returns the name of the implementation.
+ */
+std::string ScryptAutoDetect();
+
+/** Back the per-thread scratchpads allocated from now on with huge pages
+ *  (MAP_HUGETLB, or transparent huge pages as a fallback) where supported.
+ */
+void ScryptUseHugePages(bool fUse);
+
 #if defined(USE_SSE2)
 #if defined(_M_X64) || defined(__x86_64__) || defined(_M_AMD64) || (defined(MAC_OSX) && defined(__i386__))
 #define USE_SSE2_ALWAYS 1
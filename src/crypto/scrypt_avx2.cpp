@@ -0,0 +1,111 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include <crypto/scrypt.h>
+
+namespace scrypt_avx2 {
+namespace {
+
+/** Number of independent headers hashed side by side, one per 32-bit lane. */
+static const int LANES = 8;
+
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline RotL(__m256i x, int n) { return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n)); }
+
+/** One quarter-round of Salsa20, operating on the same word of every lane. */
+void inline __attribute__((always_inline)) Quarter(__m256i& a, __m256i& b, __m256i& c, __m256i& d)
+{
+    b = Xor(b, RotL(Add(a, d), 7));
+    c = Xor(c, RotL(Add(b, a), 9));
+    d = Xor(d, RotL(Add(c, b), 13));
+    a = Xor(a, RotL(Add(d, c), 18));
+}
+
+/** Lane-interleaved version of xor_salsa8() from scrypt.cpp. */
+void inline __attribute__((always_inline)) XorSalsa8(__m256i B[16], const __m256i Bx[16])
+{
+    __m256i x[16];
+    for (int i = 0; i < 16; i++) {
+        x[i] = B[i] = Xor(B[i], Bx[i]);
+    }
+    for (int i = 0; i < 8; i += 2) {
+        /* Operate on columns. */
+        Quarter(x[0], x[4], x[8], x[12]);
+        Quarter(x[5], x[9], x[13], x[1]);
+        Quarter(x[10], x[14], x[2], x[6]);
+        Quarter(x[15], x[3], x[7], x[11]);
+        /* Operate on rows. */
+        Quarter(x[0], x[1], x[2], x[3]);
+        Quarter(x[5], x[6], x[7], x[4]);
+        Quarter(x[10], x[11], x[8], x[9]);
+        Quarter(x[15], x[12], x[13], x[14]);
+    }
+    for (int i = 0; i < 16; i++) {
+        B[i] = Add(B[i], x[i]);
+    }
+}
+
+} // namespace
+
+void scrypt_1024_1_1_256_sp_8way(const char* input, char* output, char* scratchpad)
+{
+    alignas(32) uint32_t W[32][LANES];
+    uint8_t B[LANES][128];
+    __m256i X[32];
+    __m256i* V;
+
+    // V[i * 32 + k] holds word k of the i-th scratchpad entry for all lanes.
+    V = (__m256i*)(((uintptr_t)(scratchpad) + 63) & ~(uintptr_t)(63));
+
+    for (int l = 0; l < LANES; l++) {
+        PBKDF2_SHA256((const uint8_t*)input + 80 * l, 80, (const uint8_t*)input + 80 * l, 80, 1, B[l], 128);
+        for (int k = 0; k < 32; k++) {
+            W[k][l] = le32dec(&B[l][4 * k]);
+        }
+    }
+    for (int k = 0; k < 32; k++) {
+        X[k] = _mm256_load_si256((const __m256i*)W[k]);
+    }
+
+    for (int i = 0; i < 1024; i++) {
+        for (int k = 0; k < 32; k++) {
+            _mm256_store_si256(&V[i * 32 + k], X[k]);
+        }
+        XorSalsa8(&X[0], &X[16]);
+        XorSalsa8(&X[16], &X[0]);
+    }
+
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i mask = _mm256_set1_epi32(1023);
+    for (int i = 0; i < 1024; i++) {
+        // Each lane picks its own scratchpad entry, so gather word k of
+        // entry j[l] from lane l: offset (j[l] * 32 + k) * LANES + l.
+        __m256i idx = Add(_mm256_slli_epi32(_mm256_and_si256(X[16], mask), 8), lane);
+        for (int k = 0; k < 32; k++) {
+            X[k] = Xor(X[k], _mm256_i32gather_epi32((const int*)V, Add(idx, _mm256_set1_epi32(k * LANES)), 4));
+        }
+        XorSalsa8(&X[0], &X[16]);
+        XorSalsa8(&X[16], &X[0]);
+    }
+
+    for (int k = 0; k < 32; k++) {
+        _mm256_store_si256((__m256i*)W[k], X[k]);
+    }
+    for (int l = 0; l < LANES; l++) {
+        for (int k = 0; k < 32; k++) {
+            le32enc(&B[l][4 * k], W[k][l]);
+        }
+        PBKDF2_SHA256((const uint8_t*)input + 80 * l, 80, B[l], 128, 1, (uint8_t*)output + 32 * l, 32);
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,111 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX512F
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include <crypto/scrypt.h>
+
+namespace scrypt_avx512 {
+namespace {
+
+/** Number of independent headers hashed side by side, one per 32-bit lane. */
+static const int LANES = 16;
+
+__m512i inline Add(__m512i x, __m512i y) { return _mm512_add_epi32(x, y); }
+__m512i inline Xor(__m512i x, __m512i y) { return _mm512_xor_si512(x, y); }
+template<int N> __m512i inline RotL(__m512i x) { return _mm512_rol_epi32(x, N); }
+
+/** One quarter-round of Salsa20, operating on the same word of every lane. */
+void inline __attribute__((always_inline)) Quarter(__m512i& a, __m512i& b, __m512i& c, __m512i& d)
+{
+    b = Xor(b, RotL<7>(Add(a, d)));
+    c = Xor(c, RotL<9>(Add(b, a)));
+    d = Xor(d, RotL<13>(Add(c, b)));
+    a = Xor(a, RotL<18>(Add(d, c)));
+}
+
+/** Lane-interleaved version of xor_salsa8() from scrypt.cpp. */
+void inline __attribute__((always_inline)) XorSalsa8(__m512i B[16], const __m512i Bx[16])
+{
+    __m512i x[16];
+    for (int i = 0; i < 16; i++) {
+        x[i] = B[i] = Xor(B[i], Bx[i]);
+    }
+    for (int i = 0; i < 8; i += 2) {
+        /* Operate on columns. */
+        Quarter(x[0], x[4], x[8], x[12]);
+        Quarter(x[5], x[9], x[13], x[1]);
+        Quarter(x[10], x[14], x[2], x[6]);
+        Quarter(x[15], x[3], x[7], x[11]);
+        /* Operate on rows. */
+        Quarter(x[0], x[1], x[2], x[3]);
+        Quarter(x[5], x[6], x[7], x[4]);
+        Quarter(x[10], x[11], x[8], x[9]);
+        Quarter(x[15], x[12], x[13], x[14]);
+    }
+    for (int i = 0; i < 16; i++) {
+        B[i] = Add(B[i], x[i]);
+    }
+}
+
+} // namespace
+
+void scrypt_1024_1_1_256_sp_16way(const char* input, char* output, char* scratchpad)
+{
+    alignas(64) uint32_t W[32][LANES];
+    uint8_t B[LANES][128];
+    __m512i X[32];
+    __m512i* V;
+
+    // V[i * 32 + k] holds word k of the i-th scratchpad entry for all lanes.
+    V = (__m512i*)(((uintptr_t)(scratchpad) + 63) & ~(uintptr_t)(63));
+
+    for (int l = 0; l < LANES; l++) {
+        PBKDF2_SHA256((const uint8_t*)input + 80 * l, 80, (const uint8_t*)input + 80 * l, 80, 1, B[l], 128);
+        for (int k = 0; k < 32; k++) {
+            W[k][l] = le32dec(&B[l][4 * k]);
+        }
+    }
+    for (int k = 0; k < 32; k++) {
+        X[k] = _mm512_load_si512((const __m512i*)W[k]);
+    }
+
+    for (int i = 0; i < 1024; i++) {
+        for (int k = 0; k < 32; k++) {
+            _mm512_store_si512(&V[i * 32 + k], X[k]);
+        }
+        XorSalsa8(&X[0], &X[16]);
+        XorSalsa8(&X[16], &X[0]);
+    }
+
+    const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i mask = _mm512_set1_epi32(1023);
+    for (int i = 0; i < 1024; i++) {
+        // Each lane picks its own scratchpad entry, so gather word k of
+        // entry j[l] from lane l: offset (j[l] * 32 + k) * LANES + l.
+        __m512i idx = Add(_mm512_slli_epi32(_mm512_and_si512(X[16], mask), 9), lane);
+        for (int k = 0; k < 32; k++) {
+            X[k] = Xor(X[k], _mm512_i32gather_epi32(Add(idx, _mm512_set1_epi32(k * LANES)), (const int*)V, 4));
+        }
+        XorSalsa8(&X[0], &X[16]);
+        XorSalsa8(&X[16], &X[0]);
+    }
+
+    for (int k = 0; k < 32; k++) {
+        _mm512_store_si512((__m512i*)W[k], X[k]);
+    }
+    for (int l = 0; l < LANES; l++) {
+        for (int k = 0; k < 32; k++) {
+            le32enc(&B[l][4 * k], W[k][l]);
+        }
+        PBKDF2_SHA256((const uint8_t*)input + 80 * l, 80, B[l], 128, 1, (uint8_t*)output + 32 * l, 32);
+    }
+}
+
+}
+
+#endif
@@ -149,7 +149,13 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     // The base-case obfuscation key, which is a noop.
     obfuscate_key = std::vector<unsigned char>(OBFUSCATE_KEY_NUM_BYTES, '\000');
 
-    bool key_exists = Read(OBFUSCATE_KEY_KEY, obfuscate_key);
+    // Read() undoes the obfuscation with obfuscate_key as it deserializes,
+    // so the stored key can't be read into obfuscate_key itself.
+    std::vector<unsigned char> stored_key;
+    bool key_exists = Read(OBFUSCATE_KEY_KEY, stored_key);
+    if (key_exists) {
+        obfuscate_key = stored_key;
+    }
 
     if (!key_exists && obfuscate && IsEmpty()) {
         // Initialize non-degenerate obfuscation if it won't upset
@@ -158,8 +158,7 @@ public:
     template<typename V> bool GetValue(V& value) {
         leveldb::Slice slValue = piter->value();
         try {
-            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-            ssValue.Xor(dbwrapper_private::GetObfuscateKey(parent));
+            CXorReader ssValue(SER_DISK, CLIENT_VERSION, slValue.data(), slValue.size(), dbwrapper_private::GetObfuscateKey(parent));
             ssValue >> value;
         } catch (const std::exception&) {
             return false;
@@ -244,8 +243,7 @@ public:
             dbwrapper_private::HandleError(status);
         }
         try {
-            CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
-            ssValue.Xor(obfuscate_key);
+            CXorReader ssValue(SER_DISK, CLIENT_VERSION, strValue.data(), strValue.size(), obfuscate_key);
             ssValue >> value;
         } catch (const std::exception&) {
             return false;
@@ -0,0 +1,103 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <headercache.h>
+
+#include <clientversion.h>
+#include <memusage.h>
+#include <streams.h>
+
+CAuxpowHeaderCache g_auxpow_header_cache(DEFAULT_AUXPOW_HEADER_CACHE_SIZE << 20);
+
+CAuxpowHeaderCache::CAuxpowHeaderCache(size_t nMaxUsageIn)
+    : nUsage(0), nMaxUsage(nMaxUsageIn), nHits(0), nMisses(0)
+{
+}
+
+size_t CAuxpowHeaderCache::EntryUsage(const std::vector<unsigned char>& data)
+{
+    // One list node, one hash table node plus its bucket slot, and the data itself.
+    return memusage::MallocUsage(sizeof(EntryList::value_type) + 2 * sizeof(void*)) +
+           memusage::MallocUsage(sizeof(std::pair<const uint256, EntryList::iterator>) + sizeof(void*)) + sizeof(void*) +
+           memusage::DynamicUsage(data);
+}
+
+void CAuxpowHeaderCache::Trim()
+{
+    while (nUsage > nMaxUsage && !entries.empty()) {
+        const EntryList::value_type& last = entries.back();
+        nUsage -= EntryUsage(last.second);
+        index.erase(last.first);
+        entries.pop_back();
+    }
+}
+
+void CAuxpowHeaderCache::SetMaxUsage(size_t nMaxUsageIn)
+{
+    LOCK(cs);
+    nMaxUsage = nMaxUsageIn;
+    Trim();
+}
+
+bool CAuxpowHeaderCache::Get(const uint256& hash, CBlockHeader& header)
+{
+    std::vector<unsigned char> data;
+    {
+        LOCK(cs);
+        auto it = index.find(hash);
+        if (it == index.end()) {
+            ++nMisses;
+            return false;
+        }
+        ++nHits;
+        entries.splice(entries.begin(), entries, it->second);
+        data = it->second->second;
+    }
+
+    // Deserialize outside the lock; the bytes were produced by Insert().
+    CDataStream ss(data, SER_DISK, CLIENT_VERSION);
+    ss >> header;
+    return true;
+}
+
+void CAuxpowHeaderCache::Insert(const CBlockHeader& header)
+{
+    if (!header.auxpow) {
+        return;
+    }
+
+    const uint256 hash = header.GetHash();
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << header;
+    std::vector<unsigned char> data(ss.begin(), ss.end());
+
+    LOCK(cs);
+    if (index.count(hash)) {
+        return;
+    }
+    nUsage += EntryUsage(data);
+    entries.emplace_front(hash, std::move(data));
+    index.emplace(hash, entries.begin());
+    Trim();
+}
+
+void CAuxpowHeaderCache::Clear()
+{
+    LOCK(cs);
+    entries.clear();
+    index.clear();
+    nUsage = 0;
+}
+
+CAuxpowHeaderCache::Stats CAuxpowHeaderCache::GetStats() const
+{
+    LOCK(cs);
+    Stats stats;
+    stats.nEntries = entries.size();
+    stats.nUsage = nUsage;
+    stats.nMaxUsage = nMaxUsage;
+    stats.nHits = nHits;
+    stats.nMisses = nMisses;
+    return stats;
+}
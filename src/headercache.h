@@ -0,0 +1,81 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WORLDCOIN_HEADERCACHE_H
+#define WORLDCOIN_HEADERCACHE_H
+
+#include <primitives/block.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <list>
+#include <stdint.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/** Default for -auxpowheadercache, the auxpow header cache size in MiB. */
+static const unsigned int DEFAULT_AUXPOW_HEADER_CACHE_SIZE = 32;
+
+/**
+ * Bounded LRU cache of serialized auxpow block headers, keyed by block hash.
+ *
+ * CBlockIndex does not keep the CAuxPow of merge-mined blocks, so
+ * CBlockIndex::GetBlockHeader() would otherwise have to read every auxpow
+ * header it returns from the block files. Entries are stored serialized to
+ * keep them compact, and the memory usage of the cache is accounted for
+ * entry by entry.
+ */
+class CAuxpowHeaderCache
+{
+public:
+    struct Stats
+    {
+        size_t nEntries;
+        size_t nUsage;
+        size_t nMaxUsage;
+        uint64_t nHits;
+        uint64_t nMisses;
+    };
+
+private:
+    typedef std::list<std::pair<uint256, std::vector<unsigned char>>> EntryList;
+
+    struct HashHasher
+    {
+        size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
+    };
+
+    mutable CCriticalSection cs;
+    //! Entries ordered from most to least recently used.
+    EntryList entries GUARDED_BY(cs);
+    std::unordered_map<uint256, EntryList::iterator, HashHasher> index GUARDED_BY(cs);
+    size_t nUsage GUARDED_BY(cs);
+    size_t nMaxUsage GUARDED_BY(cs);
+    uint64_t nHits GUARDED_BY(cs);
+    uint64_t nMisses GUARDED_BY(cs);
+
+    static size_t EntryUsage(const std::vector<unsigned char>& data);
+    void Trim() EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+public:
+    explicit CAuxpowHeaderCache(size_t nMaxUsageIn);
+
+    /** Change the memory budget, evicting entries if it shrank. */
+    void SetMaxUsage(size_t nMaxUsageIn);
+
+    /** Look up the header of the block with the given hash. */
+    bool Get(const uint256& hash, CBlockHeader& header);
+
+    /** Add an auxpow header; non-auxpow headers are fully described by the index and ignored. */
+    void Insert(const CBlockHeader& header);
+
+    void Clear();
+
+    Stats GetStats() const;
+};
+
+extern CAuxpowHeaderCache g_auxpow_header_cache;
+
+#endif // WORLDCOIN_HEADERCACHE_H
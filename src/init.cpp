@@ -14,14 +14,20 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
+#include <coinsprefetch.h>
+#include <coinswriter.h>
+#include <connectpipeline.h>
 #include <compat/sanity.h>
 #include <consensus/validation.h>
+#include <crypto/scrypt.h>
 #include <fs.h>
+#include <headercache.h>
 #include <httpserver.h>
 #include <httprpc.h>
 #include <index/txindex.h>
 #include <key.h>
 #include <validation.h>
+#include <mempoolaccept.h>
 #include <miner.h>
 #include <netbase.h>
 #include <net.h>
@@ -38,6 +44,7 @@
 #include <script/sigcache.h>
 #include <scheduler.h>
 #include <shutdown.h>
+#include <templatecache.h>
 #include <timedata.h>
 #include <txdb.h>
 #include <txmempool.h>
@@ -72,6 +79,7 @@ bool fFeeEstimatesInitialized = false;
 static const bool DEFAULT_PROXYRANDOMIZE = true;
 static const bool DEFAULT_REST_ENABLE = false;
 static const bool DEFAULT_STOPAFTERBLOCKIMPORT = false;
+static const bool DEFAULT_SCRYPT_HUGE_PAGES = false;
 
 std::unique_ptr<CConnman> g_connman;
 std::unique_ptr<PeerLogicValidation> peerLogic;
@@ -210,7 +218,12 @@ void Shutdown()
     // Because these depend on each-other, we make sure that neither can be
     // using the other before destroying them.
     if (peerLogic) UnregisterValidationInterface(peerLogic.get());
+    if (g_template_cache) {
+        UnregisterValidationInterface(g_template_cache.get());
+        g_template_cache->Stop();
+    }
     if (g_connman) g_connman->Stop();
+    if (g_mempool_accept_pipeline) g_mempool_accept_pipeline->Stop();
     if (g_txindex) g_txindex->Stop();
 
     if (g_auxpow_miner != nullptr) {
@@ -227,6 +240,8 @@ void Shutdown()
     // After the threads that potentially access these pointers have been stopped,
     // destruct and reset all to nullptr.
     peerLogic.reset();
+    g_mempool_accept_pipeline.reset();
+    g_template_cache.reset();
     g_connman.reset();
     g_txindex.reset();
 
@@ -266,7 +281,10 @@ void Shutdown()
         if (pcoinsTip != nullptr) {
             FlushStateToDisk();
         }
+        g_connect_pipeline.reset();
         pcoinsTip.reset();
+        pcoinsprefetch.reset();
+        pcoinswriter.reset();
         pcoinscatcher.reset();
         pcoinsdbview.reset();
         pblocktree.reset();
@@ -364,14 +382,20 @@ void SetupServerArgs()
     gArgs.AddArg("-version", "Print version and exit", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-alertnotify=<cmd>", "Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-assumevalid=<hex>", strprintf("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s)", defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-auxpowheadercache=<n>", strprintf("Keep up to <n> MiB of merge-mined block headers in memory for serving headers (default: %u)", DEFAULT_AUXPOW_HEADER_CACHE_SIZE), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocksdir=<dir>", "Specify blocks directory (default: <datadir>/blocks)", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocknotify=<cmd>", "Execute command when the best block changes (%s in cmd is replaced by block hash)", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blockreconstructionextratxn=<n>", strprintf("Extra transactions to keep in memory for compact block reconstructions (default: %u)", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocksonly", strprintf("Whether to operate in a blocks only mode (default: %u)", DEFAULT_BLOCKSONLY), true, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-chainstatewriter", strprintf("Write the chain state and block index to disk from a background thread, so validation does not wait for it (default: %u)", DEFAULT_CHAINSTATE_WRITER), true, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-coinstatsindex", strprintf("Keep statistics and a MuHash of the UTXO set up to date with the chain tip, used by the gettxoutsetinfo rpc call with \"muhash\" (default: %u)", DEFAULT_COINSTATSINDEX), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-coinsprefetchthreads=<n>", strprintf("Set the number of threads that prefetch the inputs of blocks about to be connected (0 to %d, default: %d)", MAX_COINS_PREFETCH_THREADS, DEFAULT_COINS_PREFETCH_THREADS), true, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-connectpipelinedepth=<n>", strprintf("Read and check up to <n> blocks ahead of the one being connected, on separate threads (0 to %d, 0 = disable, default: %d)", MAX_CONNECT_PIPELINE_DEPTH, DEFAULT_CONNECT_PIPELINE_DEPTH), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-conf=<file>", strprintf("Specify configuration file. Relative paths will be prefixed by datadir location. (default: %s)", WORLDCOIN_CONF_FILENAME), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-datadir=<dir>", "Specify data directory", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbcache=<n>", strprintf("Set database cache size in megabytes (%d to %d, default: %d)", nMinDbCache, nMaxDbCache, nDefaultDbCache), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-dbcacheretain=<n>", strprintf("Percentage of the in-memory UTXO cache that unmodified coins may keep using after the chain state is written to disk (0 to %d, 0 = empty the cache, default: %d)", MAX_DB_CACHE_RETAIN, DEFAULT_DB_CACHE_RETAIN), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-debuglogfile=<file>", strprintf("Specify location of debug log file. Relative paths will be prefixed by a net-specific datadir location. (-nodebuglogfile to disable; default: %s)", DEFAULT_DEBUGLOGFILE), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-includeconf=<file>", "Specify additional configuration file, relative to the -datadir path (only useable from configuration file, not command line)", false, OptionsCategory::OPTIONS);
@@ -382,6 +406,7 @@ void SetupServerArgs()
     gArgs.AddArg("-minimumchainwork=<hex>", strprintf("Minimum work assumed to exist on a valid chain in hex (default: %s, testnet: %s)", defaultChainParams->GetConsensus().nMinimumChainWork.GetHex(), testnetChainParams->GetConsensus().nMinimumChainWork.GetHex()), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)",
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-mempoolacceptpipeline", strprintf("Verify the scripts of relayed transactions on the script verification threads before adding them to the mempool (default: %u)", DEFAULT_MEMPOOL_ACCEPT_PIPELINE), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-persistmempool", strprintf("Whether to save the mempool on shutdown and load on restart (default: %u)", DEFAULT_PERSIST_MEMPOOL), false, OptionsCategory::OPTIONS);
 #ifndef WIN32
     gArgs.AddArg("-pid=<file>", strprintf("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)", WORLDCOIN_PID_FILENAME), false, OptionsCategory::OPTIONS);
@@ -393,6 +418,7 @@ void SetupServerArgs()
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >=%u = automatically prune block files to stay under the specified target size in MiB)", MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-reindex", "Rebuild chain state and block index from the blk*.dat files on disk", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-reindex-chainstate", "Rebuild chain state from the currently indexed blocks", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-scrypthugepages", strprintf("Back the per-thread scrypt scratchpads with huge pages where available (default: %u)", DEFAULT_SCRYPT_HUGE_PAGES), false, OptionsCategory::OPTIONS);
 #ifndef WIN32
     gArgs.AddArg("-sysperms", "Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)", false, OptionsCategory::OPTIONS);
 #else
@@ -503,9 +529,13 @@ void SetupServerArgs()
     gArgs.AddArg("-whitelistrelay", strprintf("Accept relayed transactions received from whitelisted peers even when not relaying transactions (default: %d)", DEFAULT_WHITELISTRELAY), false, OptionsCategory::NODE_RELAY);
 
 
+    gArgs.AddArg("-auxpowtemplatecache=<n>", strprintf("Keep up to <n> MiB of blocks created by createauxblock and getauxblock for their submission (default: %u)", DEFAULT_AUXPOW_TEMPLATE_CACHE), false, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockmaxweight=<n>", strprintf("Set maximum BIP141 block weight (default: %d)", DEFAULT_BLOCK_MAX_WEIGHT), false, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-blocktemplatecache", strprintf("Keep a block template ready for the mining RPCs, rebuilt on its own thread (default: %u)", DEFAULT_BLOCK_TEMPLATE_CACHE), false, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-blocktemplaterefresh=<n>", strprintf("Rebuild the ready block template after mempool changes at most every <n> milliseconds (default: %d)", DEFAULT_BLOCK_TEMPLATE_REFRESH), false, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockmintxfee=<amt>", strprintf("Set lowest fee rate (in %s/kB) for transactions to be included in block creation. (default: %s)", CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)), false, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockversion=<n>", "Override block version to test forking scenarios", true, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-genproclimit=<n>", strprintf("Set the number of threads searching for a block's nonce in the generate RPCs (0 = number of cores, default: %d)", DEFAULT_GENERATE_THREADS), true, OptionsCategory::BLOCK_CREATION);
 
     gArgs.AddArg("-rest", strprintf("Accept public REST requests (default: %u)", DEFAULT_REST_ENABLE), false, OptionsCategory::RPC);
     gArgs.AddArg("-rpcallowip=<ip>", "Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times", false, OptionsCategory::RPC);
@@ -1201,6 +1231,9 @@ bool AppInitSanityChecks()
     // Initialize elliptic curve code
     std::string sha256_algo = SHA256AutoDetect();
     LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    ScryptUseHugePages(gArgs.GetBoolArg("-scrypthugepages", DEFAULT_SCRYPT_HUGE_PAGES));
+    std::string scrypt_algo = ScryptAutoDetect();
+    LogPrintf("Using the '%s' multi-lane scrypt implementation\n", scrypt_algo);
     RandomInit();
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1267,8 +1300,23 @@ bool AppInitMain()
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i=0; i<nScriptCheckThreads-1; i++)
+        for (int i=0; i<nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+        }
+        // Header PoW is only checked in bursts during header sync, so a few
+        // threads will do.
+        for (int i=0; i<std::min(nScriptCheckThreads-1, MAX_POWCHECK_THREADS); i++) {
+            threadGroup.create_thread(&ThreadPowCheck);
+        }
+        // CheckBlock() only needs a hand while it computes the merkle root,
+        // so don't start a transaction checking thread per core.
+        for (int i=0; i<std::min(nScriptCheckThreads-1, MAX_TXCHECK_THREADS); i++) {
+            threadGroup.create_thread(&ThreadTxCheck);
+        }
+        if (gArgs.GetBoolArg("-mempoolacceptpipeline", DEFAULT_MEMPOOL_ACCEPT_PIPELINE)) {
+            g_mempool_accept_pipeline.reset(new CMempoolAcceptPipeline(mempool));
+            g_mempool_accept_pipeline->Start(nScriptCheckThreads - 1);
+        }
     }
 
     // Start the lightweight task scheduler thread
@@ -1287,7 +1335,7 @@ bool AppInitMain()
     RegisterZMQRPCCommands(tableRPC);
 #endif
 
-    g_auxpow_miner.reset(new AuxpowMiner());
+    g_auxpow_miner.reset(new AuxpowMiner(std::max<int64_t>(0, gArgs.GetArg("-auxpowtemplatecache", DEFAULT_AUXPOW_TEMPLATE_CACHE)) << 20));
 
     /* Start the RPC server already.  It will be started in "warmup" mode
      * and not really process calls already (but it will signify connections
@@ -1438,6 +1486,12 @@ bool AppInitMain()
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
+    // Set part of it aside for the coins prefetched for the next blocks, so
+    // that those never push the cache into a flush that drops them.
+    int nPrefetchThreads = std::max(0, std::min<int>(gArgs.GetArg("-coinsprefetchthreads", DEFAULT_COINS_PREFETCH_THREADS), MAX_COINS_PREFETCH_THREADS));
+    int64_t nCoinPrefetchCache = nPrefetchThreads > 0 ? nCoinCacheUsage * COINS_PREFETCH_CACHE_PERCENT / 100 : 0;
+    nCoinCacheUsage -= nCoinPrefetchCache;
+    nCoinCacheRetain = std::max(0, std::min<int>(gArgs.GetArg("-dbcacheretain", DEFAULT_DB_CACHE_RETAIN), MAX_DB_CACHE_RETAIN));
     int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
@@ -1446,6 +1500,12 @@ bool AppInitMain()
     }
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
+    if (nCoinPrefetchCache > 0) {
+        LogPrintf("* Using %.1fMiB for prefetched coins\n", nCoinPrefetchCache * (1.0 / 1024 / 1024));
+    }
+    int64_t nAuxpowHeaderCache = std::max<int64_t>(0, gArgs.GetArg("-auxpowheadercache", DEFAULT_AUXPOW_HEADER_CACHE_SIZE)) << 20;
+    g_auxpow_header_cache.SetMaxUsage(nAuxpowHeaderCache);
+    LogPrintf("* Using %.1fMiB for auxpow header cache\n", nAuxpowHeaderCache * (1.0 / 1024 / 1024));
 
     bool fLoaded = false;
     while (!fLoaded && !ShutdownRequested()) {
@@ -1461,6 +1521,8 @@ bool AppInitMain()
             try {
                 UnloadBlockIndex();
                 pcoinsTip.reset();
+                pcoinsprefetch.reset();
+                pcoinswriter.reset();
                 pcoinsdbview.reset();
                 pcoinscatcher.reset();
                 // new CBlockTreeDB tries to delete the existing file, which
@@ -1528,7 +1590,9 @@ bool AppInitMain()
                 }
 
                 // The on-disk coinsdb is now in a good state, create the cache
-                pcoinsTip.reset(new CCoinsViewCache(pcoinscatcher.get()));
+                pcoinswriter.reset(new CCoinsViewWriter(pcoinscatcher.get(), pblocktree.get()));
+                pcoinsprefetch.reset(new CCoinsViewPrefetch(pcoinswriter.get(), chainparams.GetConsensus(), nCoinPrefetchCache));
+                pcoinsTip.reset(new CCoinsViewCache(pcoinsprefetch.get()));
 
                 bool is_coinsview_empty = fReset || fReindexChainState || pcoinsTip->GetBestBlock().IsNull();
                 if (!is_coinsview_empty) {
@@ -1611,6 +1675,40 @@ bool AppInitMain()
         return false;
     }
 
+    if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+        uiInterface.InitMessage(_("Loading UTXO set statistics..."));
+        if (!LoadCoinsRollingStats()) {
+            return InitError(_("Unable to compute the UTXO set statistics"));
+        }
+    }
+
+    if (nPrefetchThreads > 0) {
+        LogPrintf("Using %d coins prefetch threads\n", nPrefetchThreads);
+        LOCK(cs_main);
+        pcoinsprefetch->Start(nPrefetchThreads);
+    }
+
+    if (gArgs.GetBoolArg("-chainstatewriter", DEFAULT_CHAINSTATE_WRITER)) {
+        LOCK(cs_main);
+        pcoinswriter->Start();
+    }
+
+    {
+        int nPipelineDepth = std::max(0, std::min<int>(gArgs.GetArg("-connectpipelinedepth", DEFAULT_CONNECT_PIPELINE_DEPTH), MAX_CONNECT_PIPELINE_DEPTH));
+        if (nPipelineDepth > 0) {
+            LogPrintf("Reading and checking up to %d blocks ahead of the chain tip\n", nPipelineDepth);
+            LOCK(cs_main);
+            g_connect_pipeline.reset(new CConnectPipeline(chainparams.GetConsensus()));
+            g_connect_pipeline->Start(nPipelineDepth);
+        }
+    }
+
+    if (gArgs.GetBoolArg("-blocktemplatecache", DEFAULT_BLOCK_TEMPLATE_CACHE)) {
+        g_template_cache.reset(new CBlockTemplateCache());
+        RegisterValidationInterface(g_template_cache.get());
+        g_template_cache->Start(std::max<int64_t>(0, gArgs.GetArg("-blocktemplaterefresh", DEFAULT_BLOCK_TEMPLATE_REFRESH)));
+    }
+
     fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fsbridge::fopen(est_path, "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
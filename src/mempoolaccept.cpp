@@ -0,0 +1,208 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <mempoolaccept.h>
+
+#include <consensus/validation.h>
+#include <txmempool.h>
+#include <util.h>
+#include <utiltime.h>
+#include <validation.h>
+
+std::unique_ptr<CMempoolAcceptPipeline> g_mempool_accept_pipeline;
+
+CMempoolAcceptPipeline::CMempoolAcceptPipeline(CTxMemPool& poolIn) :
+    pool(poolIn), fInterrupt(false)
+{
+}
+
+CMempoolAcceptPipeline::~CMempoolAcceptPipeline()
+{
+    Stop();
+}
+
+void CMempoolAcceptPipeline::Start(int nThreads)
+{
+    assert(threads.empty());
+    {
+        WaitableLock lock(cs);
+        fInterrupt = false;
+        stats = MempoolAcceptPipelineStats();
+    }
+    for (int i = 0; i < nThreads; i++)
+        threads.emplace_back([this] { TraceThread("txverify", [this] { ThreadVerify(); }); });
+}
+
+void CMempoolAcceptPipeline::Stop()
+{
+    {
+        WaitableLock lock(cs);
+        fInterrupt = true;
+    }
+    cond.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+
+    std::deque<std::shared_ptr<CMempoolAcceptJob>> vDropped;
+    {
+        WaitableLock lock(cs);
+        vDropped.swap(queue);
+        setInFlight.clear();
+    }
+    for (const auto& job : vDropped)
+        Finish(*job, CMempoolAcceptJob::SKIPPED);
+}
+
+void CMempoolAcceptPipeline::Finish(CMempoolAcceptJob& job, CMempoolAcceptJob::State nState)
+{
+    {
+        WaitableLock lock(cs);
+        switch (nState) {
+        case CMempoolAcceptJob::VERIFIED: stats.nVerified++; break;
+        case CMempoolAcceptJob::FAILED: stats.nFailed++; break;
+        default: stats.nSkipped++; break;
+        }
+        job.nState.store(nState, std::memory_order_release);
+    }
+    cond.notify_all();
+    if (job.fnReady)
+        job.fnReady();
+}
+
+void CMempoolAcceptPipeline::ThreadVerify()
+{
+    while (true) {
+        std::shared_ptr<CMempoolAcceptJob> job;
+        {
+            WaitableLock lock(cs);
+            cond.wait(lock, [this] { return fInterrupt || !queue.empty(); });
+            if (fInterrupt)
+                return;
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        const int64_t nStart = GetTimeMicros();
+        const bool fValid = PreVerifyMempoolTransaction(*job->tx, job->vCoins, job->nBlockFlags);
+        job->vCoins.clear();
+        {
+            WaitableLock lock(cs);
+            stats.nBusyMicros += GetTimeMicros() - nStart;
+            for (const CTxIn& txin : job->tx->vin)
+                setInFlight.erase(txin.prevout);
+        }
+        Finish(*job, fValid ? CMempoolAcceptJob::VERIFIED : CMempoolAcceptJob::FAILED);
+    }
+}
+
+std::shared_ptr<CMempoolAcceptJob> CMempoolAcceptPipeline::Submit(const CTransactionRef& tx, std::function<void()> fnReady, bool fVerify)
+{
+    std::shared_ptr<CMempoolAcceptJob> job = std::make_shared<CMempoolAcceptJob>(tx);
+    job->fnReady = std::move(fnReady);
+
+    bool fSkip = !fVerify || tx->IsCoinBase();
+    bool fFailed = false;
+    if (!fSkip) {
+        LOCK2(cs_main, pool.cs);
+        fSkip = pool.exists(tx->GetHash());
+        job->vCoins.reserve(tx->vin.size());
+        CCoinsViewMemPool viewMemPool(pcoinsTip.get(), pool);
+        for (const CTxIn& txin : tx->vin) {
+            if (fSkip)
+                break;
+            // Conflicts with the mempool are most likely double spends, or
+            // else replacements, which are rare enough to do the slow way.
+            if (pool.mapNextTx.count(txin.prevout)) {
+                fSkip = true;
+                break;
+            }
+            const bool fCached = pcoinsTip->HaveCoinInCache(txin.prevout);
+            Coin coin;
+            if (!viewMemPool.GetCoin(txin.prevout, coin) || coin.IsSpent()) {
+                fSkip = true;
+            } else {
+                job->vCoins.push_back(std::move(coin));
+            }
+            if (!fCached && !pool.exists(txin.prevout.hash))
+                job->vUncache.push_back(txin.prevout);
+        }
+        // Don't spend a worker on what AcceptToMemoryPool() would reject
+        // before it ever got to the scripts.
+        if (!fSkip) {
+            job->nBlockFlags = GetMempoolBlockScriptFlags();
+            fSkip = fFailed = !PreCheckMempoolTransaction(*tx, job->vCoins, pool);
+        }
+    }
+
+    {
+        WaitableLock lock(cs);
+        stats.nSubmitted++;
+        if (!fSkip && !threads.empty() && !fInterrupt) {
+            std::vector<COutPoint> vInserted;
+            for (const CTxIn& txin : tx->vin) {
+                if (!setInFlight.insert(txin.prevout).second) {
+                    fSkip = true;
+                    break;
+                }
+                vInserted.push_back(txin.prevout);
+            }
+            if (fSkip) {
+                for (const COutPoint& prevout : vInserted)
+                    setInFlight.erase(prevout);
+            } else {
+                queue.push_back(job);
+            }
+        } else {
+            fSkip = true;
+        }
+    }
+
+    if (fSkip) {
+        job->vCoins.clear();
+        Finish(*job, fFailed ? CMempoolAcceptJob::FAILED : CMempoolAcceptJob::SKIPPED);
+    } else {
+        cond.notify_all();
+    }
+    return job;
+}
+
+void CMempoolAcceptPipeline::Wait(const CMempoolAcceptJob& job) const
+{
+    WaitableLock lock(cs);
+    cond.wait(lock, [&job] { return job.IsReady(); });
+}
+
+bool CMempoolAcceptPipeline::Accept(const CMempoolAcceptJob& job, CValidationState& state, bool* pfMissingInputs,
+                                    std::list<CTransactionRef>* plTxnReplaced)
+{
+    AssertLockHeld(cs_main);
+    assert(job.IsReady());
+
+    const bool fVerified = job.GetState() == CMempoolAcceptJob::VERIFIED;
+    if (fVerified)
+        CachePreVerifiedTransaction(*job.tx, job.nBlockFlags);
+
+    const bool fAccepted = AcceptToMemoryPool(pool, state, job.tx, pfMissingInputs, plTxnReplaced, false /* bypass_limits */, 0 /* nAbsurdFee */);
+    if (!fAccepted) {
+        // Don't let rejected transactions fill the coins cache through the
+        // snapshot, as AcceptToMemoryPool() takes care to avoid itself.
+        for (const COutPoint& prevout : job.vUncache)
+            pcoinsTip->Uncache(prevout);
+    } else if (fVerified) {
+        WaitableLock lock(cs);
+        stats.nHits++;
+    }
+    return fAccepted;
+}
+
+MempoolAcceptPipelineStats CMempoolAcceptPipeline::GetStats() const
+{
+    WaitableLock lock(cs);
+    MempoolAcceptPipelineStats ret = stats;
+    ret.nThreads = threads.size();
+    ret.nQueued = queue.size();
+    return ret;
+}
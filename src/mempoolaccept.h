@@ -0,0 +1,144 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WORLDCOIN_MEMPOOLACCEPT_H
+#define WORLDCOIN_MEMPOOLACCEPT_H
+
+#include <coins.h>
+#include <primitives/transaction.h>
+#include <sync.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <set>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+class CTxMemPool;
+class CValidationState;
+
+/** Default for -mempoolacceptpipeline */
+static const bool DEFAULT_MEMPOOL_ACCEPT_PIPELINE = true;
+
+/**
+ * A transaction on its way through the mempool accept pipeline. It holds a
+ * snapshot of the coins the transaction spends, taken when it was submitted,
+ * and whether its scripts passed against them.
+ */
+class CMempoolAcceptJob
+{
+public:
+    enum State {
+        PENDING,  //!< Waiting for or being verified
+        VERIFIED, //!< Checks and scripts passed against the snapshot
+        FAILED,   //!< Checks or scripts failed
+        SKIPPED,  //!< Not verified ahead; AcceptToMemoryPool() does it all
+    };
+
+    const CTransactionRef tx;
+
+    explicit CMempoolAcceptJob(const CTransactionRef& txIn) : tx(txIn), nState(PENDING), nBlockFlags(0) {}
+
+    State GetState() const { return nState.load(std::memory_order_acquire); }
+    bool IsReady() const { return GetState() != PENDING; }
+
+private:
+    friend class CMempoolAcceptPipeline;
+
+    std::atomic<State> nState;
+    //! The coins spent by tx, in the order of its inputs
+    std::vector<Coin> vCoins;
+    //! Inputs that were not in the coins cache before the snapshot
+    std::vector<COutPoint> vUncache;
+    //! Script flags of the block after the tip at the time of the snapshot
+    unsigned int nBlockFlags;
+    //! Called once the job is ready
+    std::function<void()> fnReady;
+};
+
+struct MempoolAcceptPipelineStats
+{
+    int nThreads = 0;
+    size_t nQueued = 0;      //!< Jobs waiting for a worker
+    uint64_t nSubmitted = 0;
+    uint64_t nVerified = 0;  //!< Jobs whose checks passed
+    uint64_t nFailed = 0;    //!< Jobs whose checks failed
+    uint64_t nSkipped = 0;   //!< Jobs not verified ahead, e.g. with missing or conflicting inputs
+    uint64_t nHits = 0;      //!< Verified jobs accepted without running their scripts again
+    int64_t nBusyMicros = 0; //!< Time the workers spent verifying
+};
+
+/**
+ * Runs the expensive, context-free part of AcceptToMemoryPool() for
+ * unrelated transactions concurrently.
+ *
+ * Submit() takes a snapshot of the coins a transaction spends from the chain
+ * tip and the mempool, and runs the cheap checks AcceptToMemoryPool() does
+ * before the scripts against it, holding cs_main for that only. The worker
+ * threads then run the scripts against the snapshot without any lock. Accept() does the remaining checks and the
+ * mempool insertion under cs_main as AcceptToMemoryPool() always did; for a
+ * verified job it finds the script result in the script execution cache.
+ *
+ * A coin is fixed by its outpoint, so a stale snapshot can only ever be
+ * missing coins, never have the wrong ones, and AcceptToMemoryPool() checks
+ * the inputs are still there. Transactions whose inputs are missing, or are
+ * already spent in the mempool or by another job in flight, are not verified
+ * ahead: they are likely orphans or double spends, and are left to
+ * AcceptToMemoryPool() entirely.
+ */
+class CMempoolAcceptPipeline
+{
+private:
+    CTxMemPool& pool;
+
+    mutable CWaitableCriticalSection cs;
+    mutable CConditionVariable cond;
+    bool fInterrupt;
+    std::vector<std::thread> threads;
+
+    //! Jobs waiting for a worker, oldest first
+    std::deque<std::shared_ptr<CMempoolAcceptJob>> queue;
+    //! Outpoints spent by jobs that are queued or being verified
+    std::set<COutPoint> setInFlight;
+
+    MempoolAcceptPipelineStats stats;
+
+    void ThreadVerify();
+    void Finish(CMempoolAcceptJob& job, CMempoolAcceptJob::State nState);
+
+public:
+    explicit CMempoolAcceptPipeline(CTxMemPool& poolIn);
+    ~CMempoolAcceptPipeline();
+
+    //! Start nThreads worker threads
+    void Start(int nThreads);
+    //! Stop and join the worker threads; jobs still queued are skipped
+    void Stop();
+
+    /**
+     * Snapshot the inputs of tx and queue it for verification. fnReady, if
+     * set, is called from the thread that makes the job ready. Without
+     * fVerify, e.g. for a transaction we already have, the job is skipped
+     * right away; it still keeps its place among the peer's transactions.
+     */
+    std::shared_ptr<CMempoolAcceptJob> Submit(const CTransactionRef& tx, std::function<void()> fnReady = nullptr, bool fVerify = true);
+    //! Wait until the job is ready
+    void Wait(const CMempoolAcceptJob& job) const;
+    /**
+     * Accept the transaction of a ready job to the mempool; the arguments are
+     * those of AcceptToMemoryPool().
+     */
+    bool Accept(const CMempoolAcceptJob& job, CValidationState& state, bool* pfMissingInputs,
+                std::list<CTransactionRef>* plTxnReplaced);
+
+    MempoolAcceptPipelineStats GetStats() const;
+};
+
+extern std::unique_ptr<CMempoolAcceptPipeline> g_mempool_accept_pipeline;
+
+#endif // WORLDCOIN_MEMPOOLACCEPT_H
@@ -5,6 +5,7 @@
 #ifndef WORLDCOIN_MEMUSAGE_H
 #define WORLDCOIN_MEMUSAGE_H
 
+#include <arenamap.h>
 #include <indirectmap.h>
 
 #include <stdlib.h>
@@ -165,6 +166,17 @@ static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z>& m)
     return MallocUsage(sizeof(unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
 }
 
+// arenamap allocates its slot array, its arena chunks and two word-per-chunk
+// bookkeeping vectors, and nothing else
+template<typename X, typename Y, typename Z>
+static inline size_t DynamicUsage(const arenamap<X, Y, Z>& m)
+{
+    size_t usage = MallocUsage(m.bucket_size() * m.bucket_count()) + 2 * DynamicUsage(m.arena_chunks());
+    for (size_t nodes : m.arena_chunks())
+        usage += MallocUsage(m.node_size() * nodes);
+    return usage;
+}
+
 }
 
 #endif // WORLDCOIN_MEMUSAGE_H
@@ -221,7 +221,7 @@ bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost
 //   segwit activation)
 // - serialized size (in case -blockmaxsize is in use)
 // - Namecoin maturity conditions
-bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& package)
+bool BlockAssembler::TestPackageTransactions(const std::vector<CTxMemPool::txiter>& package)
 {
     for (CTxMemPool::txiter it : package) {
         if (!IsFinalTx(it->GetTx(), nHeight, nLockTimeCutoff))
@@ -251,13 +251,13 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     }
 }
 
-int BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded,
-        indexed_modified_transaction_set &mapModifiedTx)
+static int UpdateModifiedForAdded(const CTxMemPool& pool, const CTxMemPool::setEntries& alreadyAdded,
+        indexed_modified_transaction_set &mapModifiedTx) EXCLUSIVE_LOCKS_REQUIRED(pool.cs)
 {
     int nDescendantsUpdated = 0;
     for (CTxMemPool::txiter it : alreadyAdded) {
         CTxMemPool::setEntries descendants;
-        mempool.CalculateDescendants(it, descendants);
+        pool.CalculateDescendants(it, descendants);
         // Insert all descendants (not yet in block) into the modified set
         for (CTxMemPool::txiter desc : descendants) {
             if (alreadyAdded.count(desc))
@@ -278,6 +278,12 @@ int BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& already
     return nDescendantsUpdated;
 }
 
+int BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded,
+        indexed_modified_transaction_set &mapModifiedTx)
+{
+    return UpdateModifiedForAdded(mempool, alreadyAdded, mapModifiedTx);
+}
+
 // Skip entries in mapTx that are already in a block or are present
 // in mapModifiedTx (which implies that the mapTx ancestor state is
 // stale due to ancestor inclusion in the block)
@@ -316,6 +322,17 @@ void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, std::ve
 // transaction package to work on next.
 void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated)
 {
+    // As long as nothing gets in the way, the loop below selects the packages
+    // of the block order the mempool keeps, so take those first. The loop
+    // only has to take over from the first package that does not fit.
+    std::vector<CTxMemPool::BlockOrderPackage> vOrder;
+    const bool fUpdated = UpdateBlockOrder(mempool, vOrder);
+    LogPrint(BCLog::BENCH, "%s: block order %s (%u packages)\n", __func__, fUpdated ? "updated" : "computed", vOrder.size());
+    const bool fDone = addBlockOrderPackages(vOrder, nPackagesSelected);
+    mempool.SetBlockOrder(std::move(vOrder));
+    if (fDone)
+        return;
+
     // mapModifiedTx will store sorted packages after they are modified
     // because some of their txs are already in the block
     indexed_modified_transaction_set mapModifiedTx;
@@ -415,8 +432,12 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         onlyUnconfirmed(ancestors);
         ancestors.insert(iter);
 
+        // Sort the entries in a valid order.
+        std::vector<CTxMemPool::txiter> sortedEntries;
+        SortForBlock(ancestors, sortedEntries);
+
         // Test if all tx's are Final
-        if (!TestPackageTransactions(ancestors)) {
+        if (!TestPackageTransactions(sortedEntries)) {
             if (fUsingModified) {
                 mapModifiedTx.get<ancestor_score>().erase(modit);
                 failedTx.insert(iter);
@@ -427,10 +448,6 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         // This transaction will make it in; reset the failed counter.
         nConsecutiveFailed = 0;
 
-        // Package can be added. Sort the entries in a valid order.
-        std::vector<CTxMemPool::txiter> sortedEntries;
-        SortForBlock(ancestors, sortedEntries);
-
         for (size_t i=0; i<sortedEntries.size(); ++i) {
             AddToBlock(sortedEntries[i]);
             // Erase from the modified set, if present
@@ -444,6 +461,193 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     }
 }
 
+bool BlockAssembler::addBlockOrderPackages(const std::vector<CTxMemPool::BlockOrderPackage>& vOrder, int &nPackagesSelected)
+{
+    for (const CTxMemPool::BlockOrderPackage& package : vOrder) {
+        if (package.nModFees < blockMinFeeRate.GetFee(package.nSize)) {
+            // Everything else we might consider has a lower fee rate
+            return true;
+        }
+        if (!TestPackage(package.nSize, package.nSigOpCost) || !TestPackageTransactions(package.vTx))
+            return false;
+        for (CTxMemPool::txiter it : package.vTx)
+            AddToBlock(it);
+        ++nPackagesSelected;
+    }
+    return true;
+}
+
+// The block order is the sequence of packages addPackageTxs() selects when
+// the block has no limits. The mempool keeps it between blocks, and only
+// drops it for changes other than new transactions. A new transaction has no
+// descendants, so it changes no other package; all that matters is where it
+// is taken itself.
+
+/** Most transactions with in-mempool parents merged into the block order before it is computed anew instead */
+static const size_t MAX_BLOCK_ORDER_MERGED_CHILDREN = 32;
+
+std::vector<CTxMemPool::BlockOrderPackage> ComputeBlockOrder(CTxMemPool& pool)
+{
+    AssertLockHeld(pool.cs);
+    std::vector<CTxMemPool::BlockOrderPackage> vOrder;
+    indexed_modified_transaction_set mapModifiedTx;
+    CTxMemPool::setEntries inOrder;
+
+    // The loop of addPackageTxs(), without the block and its limits
+    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = pool.mapTx.get<ancestor_score>().begin();
+    const CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator miEnd = pool.mapTx.get<ancestor_score>().end();
+    while (mi != miEnd || !mapModifiedTx.empty()) {
+        if (mi != miEnd) {
+            CTxMemPool::txiter it = pool.mapTx.project<0>(mi);
+            if (mapModifiedTx.count(it) || inOrder.count(it)) {
+                ++mi;
+                continue;
+            }
+        }
+
+        modtxscoreiter modit = mapModifiedTx.get<ancestor_score>().begin();
+        CTxMemPoolModifiedEntry best = mi == miEnd ? *modit : CTxMemPoolModifiedEntry(pool.mapTx.project<0>(mi));
+        if (mi != miEnd) {
+            if (modit != mapModifiedTx.get<ancestor_score>().end() &&
+                    CompareTxMemPoolEntryByAncestorFee()(*modit, best)) {
+                best = *modit;
+            } else {
+                ++mi;
+            }
+        }
+
+        CTxMemPool::setEntries ancestors;
+        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        pool.CalculateMemPoolAncestors(*best.iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        for (CTxMemPool::setEntries::iterator it = ancestors.begin(); it != ancestors.end(); ) {
+            if (inOrder.count(*it))
+                it = ancestors.erase(it);
+            else
+                ++it;
+        }
+        ancestors.insert(best.iter);
+
+        CTxMemPool::BlockOrderPackage package;
+        package.vTx.assign(ancestors.begin(), ancestors.end());
+        std::sort(package.vTx.begin(), package.vTx.end(), CompareTxIterByAncestorCount());
+        package.nSize = best.nSizeWithAncestors;
+        package.nModFees = best.nModFeesWithAncestors;
+        package.nSigOpCost = best.nSigOpCostWithAncestors;
+        for (CTxMemPool::txiter it : package.vTx) {
+            inOrder.insert(it);
+            mapModifiedTx.erase(it);
+        }
+        vOrder.push_back(std::move(package));
+
+        UpdateModifiedForAdded(pool, ancestors, mapModifiedTx);
+    }
+    return vOrder;
+}
+
+/** The package as addPackageTxs() compares it with others */
+static CTxMemPoolModifiedEntry BlockOrderEntry(const CTxMemPool::BlockOrderPackage& package)
+{
+    CTxMemPoolModifiedEntry entry(package.vTx.back());
+    entry.nSizeWithAncestors = package.nSize;
+    entry.nModFeesWithAncestors = package.nModFees;
+    entry.nSigOpCostWithAncestors = package.nSigOpCost;
+    return entry;
+}
+
+static CTxMemPool::BlockOrderPackage SingleBlockOrderPackage(CTxMemPool::txiter it)
+{
+    CTxMemPool::BlockOrderPackage package;
+    package.vTx.push_back(it);
+    package.nSize = it->GetTxSize();
+    package.nModFees = it->GetModifiedFee();
+    package.nSigOpCost = it->GetSigOpCost();
+    return package;
+}
+
+/**
+ * Merge the transactions added to pool since vOrder was computed into it.
+ * Returns false if that cannot be done exactly.
+ */
+static bool MergeIntoBlockOrder(CTxMemPool& pool, std::vector<CTxMemPool::BlockOrderPackage>& vOrder,
+                                const std::vector<CTxMemPool::txiter>& vAdded) EXCLUSIVE_LOCKS_REQUIRED(pool.cs)
+{
+    std::vector<CTxMemPool::txiter> vStandalone;
+    std::vector<CTxMemPool::txiter> vChildren;
+    for (CTxMemPool::txiter it : vAdded) {
+        if (pool.GetMemPoolParents(it).empty())
+            vStandalone.push_back(it);
+        else
+            vChildren.push_back(it);
+    }
+    if (vChildren.size() > MAX_BLOCK_ORDER_MERGED_CHILDREN)
+        return false;
+
+    // A transaction without parents is taken at the first step where it beats
+    // the package taken so far. Merge them in, best first.
+    if (!vStandalone.empty()) {
+        std::sort(vStandalone.begin(), vStandalone.end(), [](CTxMemPool::txiter a, CTxMemPool::txiter b) {
+            return CompareTxMemPoolEntryByAncestorFee()(*a, *b);
+        });
+        std::vector<CTxMemPool::BlockOrderPackage> vMerged;
+        vMerged.reserve(vOrder.size() + vStandalone.size());
+        std::vector<CTxMemPool::txiter>::const_iterator sit = vStandalone.begin();
+        for (CTxMemPool::BlockOrderPackage& package : vOrder) {
+            const CTxMemPoolModifiedEntry entry = BlockOrderEntry(package);
+            for (; sit != vStandalone.end() && CompareTxMemPoolEntryByAncestorFee()(CTxMemPoolModifiedEntry(*sit), entry); ++sit)
+                vMerged.push_back(SingleBlockOrderPackage(*sit));
+            vMerged.push_back(std::move(package));
+        }
+        for (; sit != vStandalone.end(); ++sit)
+            vMerged.push_back(SingleBlockOrderPackage(*sit));
+        vOrder.swap(vMerged);
+    }
+
+    // A transaction with parents is taken alone if it only beats a package
+    // once all its ancestors were taken. If it beats one before, it would
+    // bring some of them along and change the packages after it.
+    for (CTxMemPool::txiter child : vChildren) {
+        CTxMemPool::setEntries ancestors;
+        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        pool.CalculateMemPoolAncestors(*child, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+
+        CTxMemPoolModifiedEntry entry(child);
+        size_t nRemaining = ancestors.size();
+        size_t nPos = 0;
+        for (; nPos < vOrder.size(); nPos++) {
+            if (CompareTxMemPoolEntryByAncestorFee()(entry, BlockOrderEntry(vOrder[nPos])))
+                break;
+            for (CTxMemPool::txiter it : vOrder[nPos].vTx) {
+                if (!ancestors.count(it))
+                    continue;
+                // addPackageTxs() does not always take fee deltas of
+                // ancestors out of the package, so don't guess.
+                if (it->GetFee() != it->GetModifiedFee())
+                    return false;
+                entry.nSizeWithAncestors -= it->GetTxSize();
+                entry.nModFeesWithAncestors -= it->GetModifiedFee();
+                entry.nSigOpCostWithAncestors -= it->GetSigOpCost();
+                --nRemaining;
+            }
+        }
+        if (nRemaining)
+            return false;
+        vOrder.insert(vOrder.begin() + nPos, SingleBlockOrderPackage(child));
+    }
+    return true;
+}
+
+bool UpdateBlockOrder(CTxMemPool& pool, std::vector<CTxMemPool::BlockOrderPackage>& vOrder)
+{
+    AssertLockHeld(pool.cs);
+    std::vector<CTxMemPool::txiter> vAdded;
+    if (pool.TakeBlockOrder(vOrder, vAdded) && MergeIntoBlockOrder(pool, vOrder, vAdded))
+        return true;
+    vOrder = ComputeBlockOrder(pool);
+    return false;
+}
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
@@ -22,6 +22,8 @@ class CScript;
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Default for -genproclimit, the number of threads searching nonces for the generate RPCs (0 = number of cores) */
+static const int DEFAULT_GENERATE_THREADS = 0;
 
 struct CBlockTemplate
 {
@@ -120,6 +122,19 @@ struct update_for_parent_inclusion
     CTxMemPool::txiter iter;
 };
 
+/**
+ * Compute the block order of pool: the packages BlockAssembler selects from
+ * it, in order, as long as the limits of the block do not get in the way.
+ */
+std::vector<CTxMemPool::BlockOrderPackage> ComputeBlockOrder(CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(pool.cs);
+
+/**
+ * Take the block order pool keeps and bring it up to date with the
+ * transactions added since, or compute it anew where that cannot be done
+ * exactly. Returns whether it was brought up to date.
+ */
+bool UpdateBlockOrder(CTxMemPool& pool, std::vector<CTxMemPool::BlockOrderPackage>& vOrder) EXCLUSIVE_LOCKS_REQUIRED(pool.cs);
+
 /** Generate a new block, without valid proof-of-work */
 class BlockAssembler
 {
@@ -173,6 +188,10 @@ private:
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
       * statistics from the package selection (for logging statistics). */
     void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
+    /** Add the packages of the block order until one does not fit or fails
+      * TestPackageTransactions(). Returns false in that case, where
+      * addPackageTxs() has to take over. */
+    bool addBlockOrderPackages(const std::vector<CTxMemPool::BlockOrderPackage>& vOrder, int &nPackagesSelected);
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
@@ -183,7 +202,7 @@ private:
       * locktime, premature-witness, serialized size (if necessary)
       * These checks should always succeed, and they're here
       * only as an extra check in case of suboptimal node configuration */
-    bool TestPackageTransactions(const CTxMemPool::setEntries& package);
+    bool TestPackageTransactions(const std::vector<CTxMemPool::txiter>& package);
     /** Return true if given transaction from mapTx has already been evaluated,
       * or if the transaction's cached data in mapTx is incorrect. */
     bool SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
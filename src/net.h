@@ -36,6 +36,7 @@
 
 class CScheduler;
 class CNode;
+class CMempoolAcceptJob;
 
 /** Time between pings automatically sent out for latency probing and keepalive (in seconds). */
 static const int PING_INTERVAL = 2 * 60;
@@ -636,6 +637,8 @@ public:
     CCriticalSection cs_sendProcessing;
 
     std::deque<CInv> vRecvGetData;
+    //! Transactions received and being verified by the mempool accept pipeline, in order
+    std::deque<std::shared_ptr<CMempoolAcceptJob>> vPendingTx;
     uint64_t nRecvBytes;
     std::atomic<int> nRecvVersion;
 
@@ -10,10 +10,12 @@
 #include <chain.h>
 #include <worldcoin.h>
 #include <primitives/block.h>
+#include <sync.h>
 #include <uint256.h>
 #include <util.h>
 
-
+#include <deque>
+#include <list>
 
 // LWMA-1 for BTC & Zcash clones
 // Copyright (c) 2017-2019 The Bitcoin Gold developers, Zawy, iamstenman (Microbitcoin)
@@ -89,6 +91,167 @@ unsigned int Lwma3CalculateNextWorkRequired(const CBlockIndex* pindexLast, const
     return nextTarget.GetCompact();
 }
 
+namespace {
+
+/** One block of an LWMA averaging window. */
+struct LwmaEntry
+{
+    int64_t nTime;          //!< block timestamp
+    int64_t nAdjustedTime;  //!< timestamp forced to be increasing within the window
+    int64_t nSolvetime;     //!< capped solvetime, before weighting
+    arith_uint256 term;     //!< target / N / k
+};
+
+/**
+ * Running sums of Lwma3CalculateNextWorkRequired() over the N blocks ending
+ * at hashTip. A window can be slid forward by one block, so that following
+ * the chain tip costs one target division instead of N ancestor lookups and
+ * divisions.
+ */
+struct LwmaWindow
+{
+    uint256 hashTip;
+    int64_t N;
+    int64_t T;
+    int64_t nBaseTime;      //!< timestamp of the block before the window
+    std::deque<LwmaEntry> entries;
+    int64_t nSumSolvetimes;
+    int64_t nSumWeightedSolvetimes;
+    arith_uint256 avgTarget;
+
+    static LwmaEntry MakeEntry(const CBlockIndex* pindex, int64_t previousTimestamp, int64_t N, int64_t T)
+    {
+        LwmaEntry entry;
+        entry.nTime = pindex->GetBlockTime();
+        entry.nAdjustedTime = (entry.nTime > previousTimestamp) ? entry.nTime : previousTimestamp + 1;
+        entry.nSolvetime = std::min(6 * T, entry.nAdjustedTime - previousTimestamp);
+        arith_uint256 target;
+        target.SetCompact(pindex->nBits);
+        entry.term = target / N / (N * (N + 1) * T / 2);
+        return entry;
+    }
+
+    /** Compute the window ending at pindexLast from scratch. */
+    void Build(const CBlockIndex* pindexLast, int64_t NIn, int64_t TIn)
+    {
+        hashTip = pindexLast->GetBlockHash();
+        N = NIn;
+        T = TIn;
+        entries.clear();
+        nSumSolvetimes = 0;
+        nSumWeightedSolvetimes = 0;
+        avgTarget = 0;
+
+        const int64_t height = pindexLast->nHeight;
+        nBaseTime = pindexLast->GetAncestor(height - N)->GetBlockTime();
+        int64_t previousTimestamp = nBaseTime;
+        for (int64_t i = height - N + 1; i <= height; i++) {
+            entries.push_back(MakeEntry(pindexLast->GetAncestor(i), previousTimestamp, N, T));
+            const LwmaEntry& entry = entries.back();
+            previousTimestamp = entry.nAdjustedTime;
+            nSumSolvetimes += entry.nSolvetime;
+            nSumWeightedSolvetimes += entry.nSolvetime * (int64_t)entries.size();
+            avgTarget += entry.term;
+        }
+    }
+
+    /** Slide the window forward to end at pindexNew, whose parent is the current tip. */
+    void Append(const CBlockIndex* pindexNew)
+    {
+        // Drop the oldest block; every other block loses one unit of weight.
+        const LwmaEntry& oldest = entries.front();
+        nSumWeightedSolvetimes -= nSumSolvetimes;
+        nSumSolvetimes -= oldest.nSolvetime;
+        avgTarget -= oldest.term;
+        nBaseTime = oldest.nTime;
+        entries.pop_front();
+
+        // The window now starts from the raw timestamp of the dropped block
+        // rather than its adjusted one, which may change the adjusted
+        // timestamps that follow until they match the old ones again.
+        int64_t previousTimestamp = nBaseTime;
+        for (size_t j = 0; j < entries.size(); j++) {
+            LwmaEntry& entry = entries[j];
+            const int64_t nAdjustedTime = (entry.nTime > previousTimestamp) ? entry.nTime : previousTimestamp + 1;
+            const int64_t nSolvetime = std::min(6 * T, nAdjustedTime - previousTimestamp);
+            nSumSolvetimes += nSolvetime - entry.nSolvetime;
+            nSumWeightedSolvetimes += (nSolvetime - entry.nSolvetime) * (int64_t)(j + 1);
+            entry.nSolvetime = nSolvetime;
+            if (nAdjustedTime == entry.nAdjustedTime)
+                break;
+            entry.nAdjustedTime = nAdjustedTime;
+            previousTimestamp = nAdjustedTime;
+        }
+
+        entries.push_back(MakeEntry(pindexNew, entries.empty() ? nBaseTime : entries.back().nAdjustedTime, N, T));
+        const LwmaEntry& entry = entries.back();
+        nSumSolvetimes += entry.nSolvetime;
+        nSumWeightedSolvetimes += entry.nSolvetime * N;
+        avgTarget += entry.term;
+        hashTip = pindexNew->GetBlockHash();
+    }
+};
+
+/** Number of windows kept, so that the tips of a few competing branches all stay cached. */
+static const size_t LWMA_WINDOW_CACHE_SIZE = 4;
+
+CCriticalSection cs_lwma;
+//! Most recently used window first.
+std::list<LwmaWindow> g_lwma_windows GUARDED_BY(cs_lwma);
+
+} // namespace
+
+unsigned int Lwma3CalculateNextWorkRequiredCached(const CBlockIndex* pindexLast, const Consensus::Params& params)
+{
+    const int64_t T = params.nLWMAPowTargetTimespan;
+    const int64_t N = params.lwmaAveragingWindow;
+    const arith_uint256 powLimit = UintToArith256(params.powLimit);
+
+    // Blocks that are not in a block index have no hash to key the cache with.
+    if (pindexLast->nHeight < N || pindexLast->phashBlock == nullptr || pindexLast->pprev == nullptr ||
+        pindexLast->pprev->phashBlock == nullptr) {
+        return Lwma3CalculateNextWorkRequired(pindexLast, params);
+    }
+
+    arith_uint256 nextTarget;
+    {
+        LOCK(cs_lwma);
+        const uint256 hashTip = pindexLast->GetBlockHash();
+        const uint256 hashPrev = pindexLast->pprev->GetBlockHash();
+        auto itTip = g_lwma_windows.end();
+        auto itPrev = g_lwma_windows.end();
+        for (auto it = g_lwma_windows.begin(); it != g_lwma_windows.end(); ++it) {
+            if (it->N != N || it->T != T)
+                continue;
+            if (it->hashTip == hashTip)
+                itTip = it;
+            else if (it->hashTip == hashPrev)
+                itPrev = it;
+        }
+
+        if (itTip != g_lwma_windows.end()) {
+            g_lwma_windows.splice(g_lwma_windows.begin(), g_lwma_windows, itTip);
+        } else if (itPrev != g_lwma_windows.end()) {
+            // Keep the parent's window as well: it is the one needed again
+            // if pindexLast gets disconnected.
+            g_lwma_windows.push_front(*itPrev);
+            g_lwma_windows.front().Append(pindexLast);
+        } else {
+            g_lwma_windows.emplace_front();
+            g_lwma_windows.front().Build(pindexLast, N, T);
+        }
+        while (g_lwma_windows.size() > LWMA_WINDOW_CACHE_SIZE)
+            g_lwma_windows.pop_back();
+
+        const LwmaWindow& window = g_lwma_windows.front();
+        nextTarget = window.avgTarget * window.nSumWeightedSolvetimes;
+    }
+
+    if (nextTarget > powLimit) { nextTarget = powLimit; }
+
+    return nextTarget.GetCompact();
+}
+
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params)
 {
     unsigned int nProofOfWorkLimit = UintToArith256(params.powLimit).GetCompact();
@@ -135,7 +298,7 @@ unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHead
     assert(pindexFirst);
 
     if (nHeight >= params.nDiffChangeTargetLWMA) {
-        return Lwma3CalculateNextWorkRequired(pindexLast, params);
+        return Lwma3CalculateNextWorkRequiredCached(pindexLast, params);
     } else {
         return CalculateWorldcoinNextWorkRequired(pindexLast, pindexFirst->GetBlockTime(), params);
     }
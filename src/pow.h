@@ -17,6 +17,15 @@ class uint256;
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params&);
 unsigned int CalculateNextWorkRequired(const CBlockIndex* pindexLast, int64_t nFirstBlockTime, const Consensus::Params&);
 
+/** LWMA difficulty of the block following pindexLast, computed over the full averaging window */
+unsigned int Lwma3CalculateNextWorkRequired(const CBlockIndex* pindexLast, const Consensus::Params&);
+/**
+ * Same result as Lwma3CalculateNextWorkRequired(), from a cache of sliding
+ * windows that is advanced by one block when pindexLast extends a cached tip
+ * and recomputed in full otherwise (e.g. after a reorg).
+ */
+unsigned int Lwma3CalculateNextWorkRequiredCached(const CBlockIndex* pindexLast, const Consensus::Params&);
+
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&);
 
@@ -7,12 +7,15 @@
 #include <arith_uint256.h>
 #include <auxpow.h>
 #include <chainparams.h>
+#include <core_memusage.h>
+#include <memusage.h>
 #include <net.h>
 #include <rpc/protocol.h>
 #include <utilstrencodings.h>
 #include <utiltime.h>
 #include <validation.h>
 #include <streams.h>
+#include <templatecache.h>
 
 #include <cassert>
 
@@ -47,53 +50,137 @@ void auxMiningCheck()
 
 }  // anonymous namespace
 
+AuxpowMiner::AuxpowMiner (const size_t maxUsageIn, const size_t maxTemplatesIn)
+  : maxTemplates(maxTemplatesIn), maxUsage(maxUsageIn)
+{}
+
+size_t
+AuxpowMiner::EntryUsage (const CBlock& block)
+{
+  /* One list node, one hash table node plus its bucket slot, one node in
+     currentBlocks and the block itself.  The transactions are counted in
+     full even though the mempool may share them, so this errs on the safe
+     side.  */
+  return memusage::MallocUsage (sizeof (BlockList::value_type)
+                                + 2 * sizeof (void*))
+      + memusage::MallocUsage (sizeof (std::pair<const uint256,
+                                                 BlockList::iterator>)
+                               + sizeof (void*)) + sizeof (void*)
+      + memusage::MallocUsage (sizeof (std::pair<const CScript, CurrentBlock>)
+                               + 3 * sizeof (void*))
+      + RecursiveDynamicUsage (block);
+}
+
+void
+AuxpowMiner::touch (const BlockList::iterator it)
+{
+  AssertLockHeld (cs);
+  savedBlocks.splice (savedBlocks.begin (), savedBlocks, it);
+}
+
+void
+AuxpowMiner::trim ()
+{
+  AssertLockHeld (cs);
+
+  while ((savedBlocks.size () > maxTemplates || usage > maxUsage)
+         && savedBlocks.size () > 1)
+    {
+      const SavedBlock& last = savedBlocks.back ();
+      usage -= last.usage;
+      blocks.erase (last.hash);
+
+      const auto cur = currentBlocks.find (last.scriptPubKey);
+      if (cur != currentBlocks.end () && cur->second.hash == last.hash)
+        currentBlocks.erase (cur);
+
+      savedBlocks.pop_back ();
+      ++nEvicted;
+    }
+}
+
 const CBlock*
 AuxpowMiner::getCurrentBlock (const CScript& scriptPubKey, uint256& target)
 {
   AssertLockHeld (cs);
 
+  const CBlockIndex* pindexTip;
   {
     LOCK (cs_main);
-    if (pindexPrev != chainActive.Tip ()
-        || (mempool.GetTransactionsUpdated () != txUpdatedLast
-            && GetTime () - startTime > 60))
-      {
-        if (pindexPrev != chainActive.Tip ())
-          {
-            /* Clear old blocks since they're obsolete now.  */
-            blocks.clear ();
-            templates.clear ();
-            pblockCur = nullptr;
-          }
-
-        /* Create new block with nonce = 0 and extraNonce = 1.  */
-        std::unique_ptr<CBlockTemplate> newBlock
-            = BlockAssembler (Params ()).CreateNewBlock (scriptPubKey);
-        if (newBlock == nullptr)
-          throw JSONRPCError (RPC_OUT_OF_MEMORY, "out of memory");
-
-        /* Update state only when CreateNewBlock succeeded.  */
-        txUpdatedLast = mempool.GetTransactionsUpdated ();
-        pindexPrev = chainActive.Tip ();
-        startTime = GetTime ();
-
-        /* Finalise it by setting the version and building the merkle root.  */
-        IncrementExtraNonce (&newBlock->block, pindexPrev, extraNonce);
-        newBlock->block.SetAuxpowFlag (true);
-
-        /* Save in our map of constructed blocks.  */
-        pblockCur = &newBlock->block;
-        blocks[pblockCur->GetHash ()] = pblockCur;
-        templates.push_back (std::move (newBlock));
-      }
+    pindexTip = chainActive.Tip ();
   }
 
-  /* At this point, pblockCur is always initialised:  If we make it here
-     without creating a new block above, it means that, in particular,
-     pindexPrev == chainActive.Tip().  But for that to happen, we must
-     already have created a pblockCur in a previous call, as pindexPrev is
-     initialised only when pblockCur is.  */
-  assert (pblockCur);
+  const CBlock* pblockCur;
+  const auto cur = currentBlocks.find (scriptPubKey);
+  if (pindexPrev != pindexTip || cur == currentBlocks.end ()
+      || (mempool.GetTransactionsUpdated () != cur->second.txUpdatedLast
+          && GetTime () - cur->second.startTime > 60))
+    {
+      /* Take the template kept ready by the template cache if there is one
+         (waiting for it if it is being built, which we can do as we don't
+         hold cs_main), and only build one ourselves otherwise.  */
+      unsigned txUpdated;
+      std::unique_ptr<CBlockTemplate> newBlock;
+      if (g_template_cache != nullptr)
+        newBlock = g_template_cache->Get (pindexTip->GetBlockHash (),
+                                          scriptPubKey, true, &txUpdated);
+      if (newBlock == nullptr)
+        {
+          txUpdated = mempool.GetTransactionsUpdated ();
+          newBlock = BlockAssembler (Params ()).CreateNewBlock (scriptPubKey);
+        }
+      if (newBlock == nullptr)
+        throw JSONRPCError (RPC_OUT_OF_MEMORY, "out of memory");
+
+      LOCK (cs_main);
+      const CBlockIndex* pindexPrevNew
+          = LookupBlockIndex (newBlock->block.hashPrevBlock);
+      assert (pindexPrevNew);
+      if (pindexPrev != pindexPrevNew)
+        {
+          /* Clear old blocks since they're obsolete now.  */
+          blocks.clear ();
+          savedBlocks.clear ();
+          currentBlocks.clear ();
+          usage = 0;
+        }
+
+      /* Update state only when CreateNewBlock succeeded.  */
+      pindexPrev = pindexPrevNew;
+
+      /* Finalise it by setting the version and building the merkle root.  */
+      IncrementExtraNonce (&newBlock->block, pindexPrev, extraNonce);
+      newBlock->block.SetAuxpowFlag (true);
+
+      /* Save it in our store of constructed blocks.  */
+      savedBlocks.emplace_front ();
+      SavedBlock& entry = savedBlocks.front ();
+      entry.block = std::move (newBlock->block);
+      entry.hash = entry.block.GetHash ();
+      entry.scriptPubKey = scriptPubKey;
+      entry.usage = EntryUsage (entry.block);
+      usage += entry.usage;
+
+      const bool inserted
+          = blocks.emplace (entry.hash, savedBlocks.begin ()).second;
+      assert (inserted);
+      currentBlocks[scriptPubKey] = {entry.hash, txUpdated, GetTime ()};
+      ++nCreated;
+
+      pblockCur = &entry.block;
+      trim ();
+    }
+  else
+    {
+      /* The current block of a script is always in the store, as evicting
+         it also removes it from currentBlocks.  */
+      const auto iter = blocks.find (cur->second.hash);
+      assert (iter != blocks.end ());
+      touch (iter->second);
+      ++nShared;
+
+      pblockCur = &iter->second->block;
+    }
 
   arith_uint256 arithTarget;
   bool fNegative, fOverflow;
@@ -106,7 +193,7 @@ AuxpowMiner::getCurrentBlock (const CScript& scriptPubKey, uint256& target)
 }
 
 const CBlock*
-AuxpowMiner::lookupSavedBlock (const std::string& hashHex) const
+AuxpowMiner::lookupSavedBlock (const std::string& hashHex)
 {
   AssertLockHeld (cs);
 
@@ -115,9 +202,14 @@ AuxpowMiner::lookupSavedBlock (const std::string& hashHex) const
 
   const auto iter = blocks.find (hash);
   if (iter == blocks.end ())
-    throw JSONRPCError (RPC_INVALID_PARAMETER, "block hash unknown");
+    {
+      ++nLookupMisses;
+      throw JSONRPCError (RPC_INVALID_PARAMETER, "block hash unknown");
+    }
 
-  return iter->second;
+  ++nLookupHits;
+  touch (iter->second);
+  return &iter->second->block;
 }
 
 UniValue
@@ -147,7 +239,7 @@ AuxpowMiner::createAuxBlock (const CScript& scriptPubKey)
 
 bool
 AuxpowMiner::submitAuxBlock (const std::string& hashHex,
-                             const std::string& auxpowHex) const
+                             const std::string& auxpowHex)
 {
   auxMiningCheck ();
 
@@ -167,3 +259,21 @@ AuxpowMiner::submitAuxBlock (const std::string& hashHex,
 
   return ProcessNewBlock (Params (), shared_block, true, nullptr);
 }
+
+AuxpowMiner::Stats
+AuxpowMiner::getStats () const
+{
+  LOCK (cs);
+
+  Stats stats;
+  stats.nTemplates = savedBlocks.size ();
+  stats.nUsage = usage;
+  stats.nMaxUsage = maxUsage;
+  stats.nCreated = nCreated;
+  stats.nShared = nShared;
+  stats.nEvicted = nEvicted;
+  stats.nLookupHits = nLookupHits;
+  stats.nLookupMisses = nLookupMisses;
+
+  return stats;
+}
@@ -11,10 +11,16 @@
 #include <uint256.h>
 #include <univalue.h>
 
+#include <list>
 #include <map>
-#include <memory>
+#include <stdint.h>
 #include <string>
-#include <vector>
+#include <unordered_map>
+
+/** Default for -auxpowtemplatecache, the memory for auxpow block templates in MiB.  */
+static const unsigned int DEFAULT_AUXPOW_TEMPLATE_CACHE = 64;
+/** Maximum number of auxpow block templates kept for submitauxblock.  */
+static const size_t DEFAULT_AUXPOW_MAX_TEMPLATES = 1000;
 
 namespace auxpow_tests
 {
@@ -23,8 +29,11 @@ class AuxpowMinerForTest;
 
 /**
  * This class holds "global" state used to construct blocks for the auxpow
- * mining RPCs and the map of already constructed blocks to look them up
- * in the submitauxblock RPC.
+ * mining RPCs and the store of already constructed blocks to look them up
+ * in the submitauxblock RPC.  The store is indexed by block hash, shares
+ * blocks between requests for the same coinbase script and is bounded in
+ * both the number of blocks and their memory, evicting the least recently
+ * used ones first.
  *
  * It is used as a singleton that is initialised during startup, taking the
  * place of the previously real global and static variables.
@@ -32,27 +41,93 @@ class AuxpowMinerForTest;
 class AuxpowMiner
 {
 
+public:
+
+  struct Stats
+  {
+    size_t nTemplates;
+    size_t nUsage;
+    size_t nMaxUsage;
+    uint64_t nCreated;
+    uint64_t nShared;
+    uint64_t nEvicted;
+    uint64_t nLookupHits;
+    uint64_t nLookupMisses;
+  };
+
 private:
 
+  /** A constructed block, kept so that submitauxblock can look it up.  */
+  struct SavedBlock
+  {
+    CBlock block;
+    uint256 hash;
+    /** The coinbase script the block was constructed for.  */
+    CScript scriptPubKey;
+    size_t usage;
+  };
+
+  typedef std::list<SavedBlock> BlockList;
+
+  struct HashHasher
+  {
+    size_t operator() (const uint256& hash) const
+    {
+      return hash.GetCheapHash ();
+    }
+  };
+
+  /**
+   * The block currently handed out for a coinbase script.  All requests for
+   * the same script share it until "enough changed" to construct a new one.
+   */
+  struct CurrentBlock
+  {
+    uint256 hash;
+    unsigned txUpdatedLast;
+    int64_t startTime;
+  };
+
   /** The lock used for state in this object.  */
   mutable CCriticalSection cs;
-  /** All currently "active" block templates.  */
-  std::vector<std::unique_ptr<CBlockTemplate>> templates;
-  /** Maps block hashes to pointers in vTemplates.  Does not own the memory.  */
-  std::map<uint256, const CBlock*> blocks;
 
   /**
-   * The block we are "currently" working on.  This does not own the memory,
-   * instead, it points into an element of templates.
+   * All saved blocks, ordered from most to least recently used.  The list is
+   * bounded by maxTemplates and maxUsage, and cleared when the tip changes.
    */
-  CBlock* pblockCur = nullptr;
+  BlockList savedBlocks;
+  /** Maps block hashes to their entry in savedBlocks.  */
+  std::unordered_map<uint256, BlockList::iterator, HashHasher> blocks;
+  /** The current block for each coinbase script, pointing into blocks.  */
+  std::map<CScript, CurrentBlock> currentBlocks;
+
+  size_t usage = 0;
+  const size_t maxTemplates;
+  const size_t maxUsage;
+
   /** The current extra nonce for block creation.  */
   unsigned extraNonce = 0;
 
-  /* Some data about when the current block (pblock) was constructed.  */
-  unsigned txUpdatedLast;
+  /** The tip that all saved blocks build on.  */
   const CBlockIndex* pindexPrev = nullptr;
-  uint64_t startTime;
+
+  uint64_t nCreated = 0;
+  uint64_t nShared = 0;
+  uint64_t nEvicted = 0;
+  uint64_t nLookupHits = 0;
+  uint64_t nLookupMisses = 0;
+
+  /** Estimates the memory used by a saved block and its index entries.  */
+  static size_t EntryUsage (const CBlock& block);
+
+  /** Moves a saved block to the front of the LRU order.  */
+  void touch (BlockList::iterator it);
+
+  /**
+   * Drops the least recently used blocks until the limits are met again.
+   * The most recent block is always kept.
+   */
+  void trim ();
 
   /**
    * Constructs a new current block if necessary (checking the current state to
@@ -66,13 +141,15 @@ private:
    * Looks up a previously constructed block by its (hex-encoded) hash.  If the
    * block is found, it is returned.  Otherwise, a JSONRPCError is thrown.
    */
-  const CBlock* lookupSavedBlock (const std::string& hashHex) const;
+  const CBlock* lookupSavedBlock (const std::string& hashHex);
 
   friend class auxpow_tests::AuxpowMinerForTest;
 
 public:
 
-  AuxpowMiner () = default;
+  explicit AuxpowMiner (size_t maxUsageIn
+                          = DEFAULT_AUXPOW_TEMPLATE_CACHE << 20,
+                        size_t maxTemplatesIn = DEFAULT_AUXPOW_MAX_TEMPLATES);
 
   /**
    * Performs the main work for the "createauxblock" RPC:  Construct a new block
@@ -88,7 +165,10 @@ public:
    * was accepted.
    */
   bool submitAuxBlock (const std::string& hashHex,
-                       const std::string& auxpowHex) const;
+                       const std::string& auxpowHex);
+
+  /** Returns the size of the template store and its counters.  */
+  Stats getStats () const;
 
 };
 
@@ -11,9 +11,12 @@
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <coins.h>
+#include <coinstats.h>
+#include <connectpipeline.h>
 #include <consensus/validation.h>
 #include <validation.h>
 #include <core_io.h>
+#include <headercache.h>
 #include <index/txindex.h>
 #include <key_io.h>
 #include <policy/feerate.h>
@@ -879,77 +882,6 @@ static UniValue getblock(const JSONRPCRequest& request)
     return blockToJSON(block, pblockindex, verbosity >= 2);
 }
 
-struct CCoinsStats
-{
-    int nHeight;
-    uint256 hashBlock;
-    uint64_t nTransactions;
-    uint64_t nTransactionOutputs;
-    uint64_t nBogoSize;
-    uint256 hashSerialized;
-    uint64_t nDiskSize;
-    CAmount nTotalAmount;
-
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
-};
-
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
-{
-    assert(!outputs.empty());
-    ss << hash;
-    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase ? 1u : 0u);
-    stats.nTransactions++;
-    for (const auto& output : outputs) {
-        ss << VARINT(output.first + 1);
-        ss << output.second.out.scriptPubKey;
-        ss << VARINT(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
-        stats.nTransactionOutputs++;
-        stats.nTotalAmount += output.second.out.nValue;
-        stats.nBogoSize += 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
-                           2 /* scriptPubKey len */ + output.second.out.scriptPubKey.size() /* scriptPubKey */;
-    }
-    ss << VARINT(0u);
-}
-
-//! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
-{
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-    assert(pcursor);
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
-    {
-        LOCK(cs_main);
-        stats.nHeight = LookupBlockIndex(stats.hashBlock)->nHeight;
-    }
-    ss << stats.hashBlock;
-    uint256 prevkey;
-    std::map<uint32_t, Coin> outputs;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        COutPoint key;
-        Coin coin;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
-                outputs.clear();
-            }
-            prevkey = key.hash;
-            outputs[key.n] = std::move(coin);
-        } else {
-            return error("%s: unable to read value", __func__);
-        }
-        pcursor->Next();
-    }
-    if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
-    }
-    stats.hashSerialized = ss.GetHash();
-    stats.nDiskSize = view->EstimateSize();
-    return true;
-}
-
 static UniValue pruneblockchain(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -1001,29 +933,62 @@ static UniValue pruneblockchain(const JSONRPCRequest& request)
 
 static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"  (string, optional, default=\"hash_serialized_2\") Which UTXO set hash to compute:\n"
+            "               \"hash_serialized_2\", which needs a scan of the whole set and may take some time, or\n"
+            "               \"muhash\", which is kept up to date with the chain tip when running with -coinstatsindex,\n"
+            "               so the call returns at once\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) The hash of the block at the tip of the chain\n"
-            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs\n"
+            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs (only with hash_serialized_2)\n"
             "  \"txouts\": n,            (numeric) The number of unspent transaction outputs\n"
             "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
-            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
+            "  \"muhash\": \"hash\",      (string) The MuHash3072 of the set (only with muhash)\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash (only with hash_serialized_2)\n"
+            "  \"hash_serialized_3\": \"hash\", (string) The serialized hash that also covers the heights and coinbase flags\n"
+            "                              of the outputs, as loadtxoutset checks (only with hash_serialized_2)\n"
             "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"muhash\"")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
     UniValue ret(UniValue::VOBJ);
 
+    const std::string hash_type = request.params[0].isNull() ? "hash_serialized_2" : request.params[0].get_str();
+    if (hash_type == "muhash") {
+        CCoinsRollingStats stats;
+        int nHeight;
+        {
+            LOCK(cs_main);
+            if (!GetCoinsRollingStats(stats)) {
+                throw JSONRPCError(RPC_MISC_ERROR, "UTXO set statistics are not kept; restart with -coinstatsindex");
+            }
+            const CBlockIndex* pindex = LookupBlockIndex(stats.hashBlock);
+            nHeight = pindex ? pindex->nHeight : 0;
+        }
+        ret.pushKV("height", (int64_t)nHeight);
+        ret.pushKV("bestblock", stats.hashBlock.GetHex());
+        ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
+        ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
+        ret.pushKV("muhash", stats.GetHash().GetHex());
+        ret.pushKV("disk_size", (uint64_t)pcoinsdbview->EstimateSize());
+        ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
+        return ret;
+    }
+    if (hash_type != "hash_serialized_2") {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown hash_type " + hash_type);
+    }
+
     CCoinsStats stats;
     FlushStateToDisk();
     if (GetUTXOStats(pcoinsdbview.get(), stats)) {
@@ -1033,6 +998,7 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
         ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
         ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
         ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+        ret.pushKV("hash_serialized_3", stats.hashSerialized3.GetHex());
         ret.pushKV("disk_size", stats.nDiskSize);
         ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
     } else {
@@ -1478,6 +1444,126 @@ static UniValue getmempoolinfo(const JSONRPCRequest& request)
     return mempoolInfoToJSON();
 }
 
+static UniValue getcoinscacheinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getcoinscacheinfo\n"
+            "\nReturns details on the in-memory UTXO cache and how it has been written to disk.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"entries\": xxxxx,            (numeric) Number of cached coins\n"
+            "  \"usage\": xxxxx,              (numeric) Memory usage of the cache in bytes\n"
+            "  \"maxusage\": xxxxx,           (numeric) Configured size of the cache in bytes (-dbcache share)\n"
+            "  \"retain\": xxxxx,             (numeric) Percentage of maxusage kept after a flush (-dbcacheretain)\n"
+            "  \"flushes\": xxxxx,            (numeric) Flushes that emptied the cache\n"
+            "  \"partialflushes\": xxxxx,     (numeric) Flushes that kept unmodified coins in the cache\n"
+            "  \"written\": xxxxx,            (numeric) Modified coins written to the database\n"
+            "  \"evicted\": xxxxx             (numeric) Unmodified coins evicted to stay within the retained size\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcoinscacheinfo", "")
+            + HelpExampleRpc("getcoinscacheinfo", "")
+        );
+
+    LOCK(cs_main);
+    const CCoinsCacheFlushStats& stats = pcoinsTip->GetFlushStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("entries", (uint64_t)pcoinsTip->GetCacheSize());
+    ret.pushKV("usage", (uint64_t)pcoinsTip->DynamicMemoryUsage());
+    ret.pushKV("maxusage", (uint64_t)nCoinCacheUsage);
+    ret.pushKV("retain", nCoinCacheRetain);
+    ret.pushKV("flushes", stats.nFlushes);
+    ret.pushKV("partialflushes", stats.nSyncs);
+    ret.pushKV("written", stats.nCoinsWritten);
+    ret.pushKV("evicted", stats.nCoinsEvicted);
+    return ret;
+}
+
+static UniValue ConnectPipelineStageToJSON(const ConnectPipelineStageStats& stage, int64_t nElapsedMicros)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("queued", (uint64_t)stage.nQueued);
+    ret.pushKV("blocks", stage.nProcessed);
+    ret.pushKV("occupancy", nElapsedMicros > 0 ? (double)stage.nBusyMicros / nElapsedMicros : 0.0);
+    return ret;
+}
+
+static UniValue getconnectpipelineinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getconnectpipelineinfo\n"
+            "\nReturns details on the pipeline that reads and checks blocks ahead of the chain tip.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"depth\": xxxxx,              (numeric) Maximum number of blocks in the pipeline (-connectpipelinedepth), 0 if disabled\n"
+            "  \"read\": {                    (json object) The stage reading blocks from disk\n"
+            "    \"queued\": xxxxx,           (numeric) Blocks waiting for this stage\n"
+            "    \"blocks\": xxxxx,           (numeric) Blocks this stage has processed\n"
+            "    \"occupancy\": x.xxx         (numeric) Fraction of the time this stage was busy\n"
+            "  },\n"
+            "  \"check\": {                   (json object) The stage running context-free block checks, as above\n"
+            "    ...\n"
+            "  },\n"
+            "  \"ready\": xxxxx,              (numeric) Blocks checked and waiting to be connected\n"
+            "  \"hits\": xxxxx,               (numeric) Blocks that were ready when they were connected\n"
+            "  \"waits\": xxxxx,              (numeric) Blocks that had to be waited for\n"
+            "  \"misses\": xxxxx,             (numeric) Blocks that had to be read when they were connected\n"
+            "  \"dropped\": xxxxx             (numeric) Blocks read or checked that were not connected next\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getconnectpipelineinfo", "")
+            + HelpExampleRpc("getconnectpipelineinfo", "")
+        );
+
+    ConnectPipelineStats stats;
+    {
+        LOCK(cs_main);
+        if (g_connect_pipeline)
+            stats = g_connect_pipeline->GetStats();
+    }
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("depth", stats.nDepth);
+    ret.pushKV("read", ConnectPipelineStageToJSON(stats.read, stats.nElapsedMicros));
+    ret.pushKV("check", ConnectPipelineStageToJSON(stats.check, stats.nElapsedMicros));
+    ret.pushKV("ready", (uint64_t)stats.nReady);
+    ret.pushKV("hits", stats.nHits);
+    ret.pushKV("waits", stats.nWaits);
+    ret.pushKV("misses", stats.nMisses);
+    ret.pushKV("dropped", stats.nDropped);
+    return ret;
+}
+
+static UniValue getheadercacheinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getheadercacheinfo\n"
+            "\nReturns details on the in-memory cache of merge-mined (auxpow) block headers.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"entries\": xxxxx,            (numeric) Number of cached headers\n"
+            "  \"usage\": xxxxx,              (numeric) Memory usage of the cache in bytes\n"
+            "  \"maxusage\": xxxxx,           (numeric) Maximum memory usage of the cache in bytes\n"
+            "  \"hits\": xxxxx,               (numeric) Header lookups served from the cache\n"
+            "  \"misses\": xxxxx              (numeric) Header lookups that had to read the block files\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getheadercacheinfo", "")
+            + HelpExampleRpc("getheadercacheinfo", "")
+        );
+
+    const CAuxpowHeaderCache::Stats stats = g_auxpow_header_cache.GetStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("entries", (uint64_t)stats.nEntries);
+    ret.pushKV("usage", (uint64_t)stats.nUsage);
+    ret.pushKV("maxusage", (uint64_t)stats.nMaxUsage);
+    ret.pushKV("hits", stats.nHits);
+    ret.pushKV("misses", stats.nMisses);
+    return ret;
+}
+
 static UniValue preciousblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -2011,6 +2097,94 @@ static UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrites the UTXO set, as of the current tip, to a file that loadtxoutset can load.\n"
+            "The node keeps processing blocks while the file is written.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) The file to write, relative to the data directory unless absolute. It must not exist.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_written\": n,       (numeric) The number of unspent transaction outputs written\n"
+            "  \"base_hash\": \"hash\",      (string) The hash of the block the UTXO set is as of\n"
+            "  \"base_height\": n,         (numeric) The height of that block\n"
+            "  \"path\": \"path\",           (string) The absolute path of the file\n"
+            "  \"hash_serialized_3\": \"hash\", (string) The serialized hash of the UTXO set, as in gettxoutsetinfo, to pass to loadtxoutset\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+    }
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+    }
+
+    CCoinsStats stats;
+    if (!DumpTxOutSet(path, stats)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to dump the UTXO set");
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("coins_written", (int64_t)stats.nTransactionOutputs);
+    ret.pushKV("base_hash", stats.hashBlock.GetHex());
+    ret.pushKV("base_height", (int64_t)stats.nHeight);
+    ret.pushKV("path", path.string());
+    ret.pushKV("hash_serialized_3", stats.hashSerialized3.GetHex());
+    return ret;
+}
+
+static UniValue loadtxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 2) {
+        throw std::runtime_error(
+            "loadtxoutset \"path\" \"hash\"\n"
+            "\nLoads a UTXO set written by dumptxoutset into a fresh chainstate, so that the node syncs from the\n"
+            "block the set is as of instead of from the genesis block.\n"
+            "The node must run with -prune, must not have connected any block yet, and must know the header of\n"
+            "that block. The blocks before it are never downloaded or verified: the set is trusted if its hash\n"
+            "matches the given one. Blocks are not processed while the set is loaded.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) The file to load, relative to the data directory unless absolute\n"
+            "2. \"hash\"    (string, required) The trusted hash of the UTXO set, which covers the height and coinbase flag\n"
+            "             of every output: the hash_serialized_3 reported by dumptxoutset, or by gettxoutsetinfo at that block\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_loaded\": n,        (numeric) The number of unspent transaction outputs loaded\n"
+            "  \"base_hash\": \"hash\",      (string) The hash of the block the UTXO set is as of, the new tip\n"
+            "  \"base_height\": n,         (numeric) The height of that block\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("loadtxoutset", "\"utxo.dat\" \"6fd2e8d9eb1cd86f1df6eca3b8e0e0ffe7a2d0c4a6f4b7a36fce06f2f3b0e1d5\"")
+            + HelpExampleRpc("loadtxoutset", "\"utxo.dat\", \"6fd2e8d9eb1cd86f1df6eca3b8e0e0ffe7a2d0c4a6f4b7a36fce06f2f3b0e1d5\"")
+        );
+    }
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    const uint256 hash = ParseHashV(request.params[1], "hash");
+
+    CCoinsStats stats;
+    std::string strError;
+    if (!LoadTxOutSet(path, hash, stats, strError)) {
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    }
+
+    // Carry on with any blocks after it that are already here.
+    CValidationState state;
+    ActivateBestChain(state, Params());
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("coins_loaded", (int64_t)stats.nTransactionOutputs);
+    ret.pushKV("base_hash", stats.hashBlock.GetHex());
+    ret.pushKV("base_height", (int64_t)stats.nHeight);
+    return ret;
+}
+
 //! Search for a given set of pubkey scripts
 bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, int64_t& count, CCoinsViewCursor* cursor, const std::set<CScript>& needles, std::map<COutPoint, Coin>& out_results) {
     scan_progress = 0;
@@ -2234,20 +2408,25 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockhash",           &getblockhash,           {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"} },
     { "blockchain",         "getchaintips",           &getchaintips,           {} },
+    { "blockchain",         "getcoinscacheinfo",      &getcoinscacheinfo,      {} },
+    { "blockchain",         "getconnectpipelineinfo", &getconnectpipelineinfo, {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          {} },
+    { "blockchain",         "getheadercacheinfo",     &getheadercacheinfo,     {} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_type"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
 
     { "blockchain",         "preciousblock",          &preciousblock,          {"blockhash"} },
     { "blockchain",         "scantxoutset",           &scantxoutset,           {"action", "scanobjects"} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           {"path"} },
+    { "blockchain",         "loadtxoutset",           &loadtxoutset,           {"path","hash"} },
 
     /* Not shown in help */
     { "hidden",             "invalidateblock",        &invalidateblock,        {"blockhash"} },
@@ -10,6 +10,7 @@
 #include <consensus/params.h>
 #include <consensus/validation.h>
 #include <core_io.h>
+#include <crypto/scrypt.h>
 #include <validation.h>
 #include <key_io.h>
 #include <miner.h>
@@ -21,14 +22,17 @@
 #include <rpc/mining.h>
 #include <rpc/server.h>
 #include <shutdown.h>
+#include <templatecache.h>
 #include <txmempool.h>
 #include <util.h>
 #include <utilstrencodings.h>
 #include <validationinterface.h>
 #include <warnings.h>
 
+#include <atomic>
 #include <stdint.h>
 #include <string>
+#include <thread>
 #include <utility>
 
 unsigned int ParseConfirmTarget(const UniValue& value)
@@ -105,11 +109,82 @@ static UniValue getnetworkhashps(const JSONRPCRequest& request)
     return GetNetworkHashPS(!request.params[0].isNull() ? request.params[0].get_int() : 120, !request.params[1].isNull() ? request.params[1].get_int() : -1);
 }
 
+/** Nonces hashed together through the multi-lane scrypt kernels. */
+static const uint32_t NONCE_BATCH = 16;
+/** Nonces handed to a nonce search thread at a time. */
+static const uint32_t NONCE_CHUNK = 16 * NONCE_BATCH;
+
+/** Hash the nonces [nBegin, nEnd) of header in batches. Returns the first valid nonce, or nEnd. */
+static uint32_t ScanNonces(const CBlockHeader& header, uint32_t nBegin, uint32_t nEnd, const Consensus::Params& params, std::atomic<uint64_t>& nHashes)
+{
+    CPureBlockHeader pure = header;
+    char input[80 * NONCE_BATCH];
+    uint256 output[NONCE_BATCH];
+    for (uint32_t nNonce = nBegin; nNonce < nEnd; nNonce += NONCE_BATCH) {
+        const uint32_t nCount = std::min(NONCE_BATCH, nEnd - nNonce);
+        for (uint32_t i = 0; i < nCount; i++) {
+            pure.nNonce = nNonce + i;
+            memcpy(input + 80 * i, BEGIN(pure.nVersion), 80);
+        }
+        scrypt_1024_1_1_256_multi(input, (char*)output, nCount);
+        nHashes += nCount;
+        for (uint32_t i = 0; i < nCount; i++) {
+            if (CheckProofOfWork(output[i], header.nBits, params))
+                return nNonce + i;
+        }
+    }
+    return nEnd;
+}
+
+/**
+ * Find the lowest valid nonce of header in [nBegin, nEnd), or return nEnd.
+ * The first batch is hashed on the calling thread, which is enough for
+ * most regtest blocks; the rest of the range is split over nThreads.
+ */
+static uint32_t FindNonce(const CBlockHeader& header, uint32_t nBegin, uint32_t nEnd, int nThreads, const Consensus::Params& params, std::atomic<uint64_t>& nHashes)
+{
+    const uint32_t nFirstEnd = std::min(nEnd, nBegin + NONCE_BATCH);
+    const uint32_t nFirst = ScanNonces(header, nBegin, nFirstEnd, params, nHashes);
+    if (nFirst < nFirstEnd || nFirstEnd == nEnd)
+        return nFirst;
+    if (nThreads <= 1)
+        return ScanNonces(header, nFirstEnd, nEnd, params, nHashes);
+
+    // Chunks are handed out in increasing order and no longer once a nonce
+    // was found, so all chunks below it get scanned and the lowest valid
+    // nonce is the one a single thread would have found.
+    std::atomic<uint32_t> nNext(nFirstEnd);
+    std::atomic<uint32_t> nFound(nEnd);
+    auto search = [&]() {
+        while (true) {
+            const uint32_t nChunk = nNext.fetch_add(NONCE_CHUNK);
+            if (nChunk >= nEnd || nChunk >= nFound)
+                break;
+            const uint32_t nChunkEnd = std::min(nEnd, nChunk + NONCE_CHUNK);
+            const uint32_t nNonce = ScanNonces(header, nChunk, nChunkEnd, params, nHashes);
+            uint32_t nPrev = nFound;
+            while (nNonce < nPrev && !nFound.compare_exchange_weak(nPrev, nNonce)) {}
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < nThreads; i++)
+        threads.emplace_back(search);
+    search();
+    for (std::thread& thread : threads)
+        thread.join();
+    return nFound;
+}
+
 UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGenerate, uint64_t nMaxTries, bool keepScript)
 {
     static const int nInnerLoopCount = 0x10000;
     int nHeightEnd = 0;
     int nHeight = 0;
+    int nThreads = gArgs.GetArg("-genproclimit", DEFAULT_GENERATE_THREADS);
+    if (nThreads <= 0)
+        nThreads = GetNumCores();
+    std::atomic<uint64_t> nHashes(0);
+    const int64_t nStartTime = GetTimeMicros();
 
     {   // Don't keep cs_main locked
         LOCK(cs_main);
@@ -128,10 +203,11 @@ UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGen
             LOCK(cs_main);
             IncrementExtraNonce(pblock, chainActive.Tip(), nExtraNonce);
         }
-        while (nMaxTries > 0 && pblock->nNonce < nInnerLoopCount && !CheckProofOfWork(pblock->GetPoWHash(), pblock->nBits, Params().GetConsensus())) {
-            ++pblock->nNonce;
-            --nMaxTries;
-        }        
+        // Like trying one nonce after the other: the valid nonce does not count against nMaxTries.
+        const uint32_t nStartNonce = pblock->nNonce;
+        const uint32_t nEndNonce = std::min<uint64_t>(nInnerLoopCount, nStartNonce + std::min<uint64_t>(nMaxTries, nInnerLoopCount));
+        pblock->nNonce = FindNonce(*pblock, nStartNonce, nEndNonce, nThreads, Params().GetConsensus(), nHashes);
+        nMaxTries -= pblock->nNonce - nStartNonce;
         if (nMaxTries == 0) {
             break;
         }
@@ -150,6 +226,9 @@ UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGen
             coinbaseScript->KeepScript();
         }
     }
+    const int64_t nElapsed = std::max<int64_t>(GetTimeMicros() - nStartTime, 1);
+    LogPrint(BCLog::RPC, "%s: %u blocks, %u hashes in %.3fs (%.1f H/s, %d threads)\n", __func__, blockHashes.size(), nHashes.load(),
+        nElapsed * 0.000001, nHashes * 1000000.0 / nElapsed, nThreads);
     return blockHashes;
 }
 
@@ -203,12 +282,37 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
             "  \"pooledtx\": n              (numeric) The size of the mempool\n"
             "  \"chain\": \"xxxx\",           (string) current network name as defined in BIP70 (main, test, regtest)\n"
             "  \"warnings\": \"...\"          (string) any network and blockchain warnings\n"
+            "  \"blocktemplate\": {         (json object) the block template kept ready, if -blocktemplatecache is on\n"
+            "    \"ready\": true|false,       (boolean) whether there is a template on top of the current tip\n"
+            "    \"age\": x.xxx,             (numeric) seconds since it was built\n"
+            "    \"pendingupdates\": n,      (numeric) mempool updates it doesn't include yet\n"
+            "    \"builds\": n,              (numeric) number of templates built\n"
+            "    \"lastbuildms\": x.xxx,     (numeric) milliseconds the last build took\n"
+            "    \"averagebuildms\": x.xxx,  (numeric) milliseconds a build took on average\n"
+            "    \"lasttipms\": x.xxx,       (numeric) milliseconds from the last tip change to a template on top of it\n"
+            "    \"hits\": n,                (numeric) requests served from the ready template\n"
+            "    \"misses\": n               (numeric) requests that had to build a template themselves\n"
+            "  },\n"
+            "  \"auxpow\": {                (json object) the blocks kept for submitauxblock\n"
+            "    \"templates\": n,           (numeric) number of blocks kept\n"
+            "    \"usage\": n,               (numeric) memory used by them in bytes\n"
+            "    \"maxusage\": n,            (numeric) memory limit in bytes, see -auxpowtemplatecache\n"
+            "    \"created\": n,             (numeric) number of blocks created\n"
+            "    \"shared\": n,              (numeric) requests answered with the current block of their coinbase script\n"
+            "    \"evicted\": n,             (numeric) blocks dropped before the tip changed\n"
+            "    \"hits\": n,                (numeric) submitted hashes that were found\n"
+            "    \"misses\": n               (numeric) submitted hashes that were unknown\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmininginfo", "")
             + HelpExampleRpc("getmininginfo", "")
         );
 
+    // Taken before cs_main, as the auxpow miner locks cs_main while holding its own lock.
+    AuxpowMiner::Stats auxpow_stats{};
+    if (g_auxpow_miner)
+        auxpow_stats = g_auxpow_miner->getStats();
 
     LOCK(cs_main);
 
@@ -221,6 +325,32 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
     obj.pushKV("pooledtx",         (uint64_t)mempool.size());
     obj.pushKV("chain",            Params().NetworkIDString());
     obj.pushKV("warnings",         GetWarnings("statusbar"));
+    if (g_template_cache) {
+        const BlockTemplateCacheStats stats = g_template_cache->GetStats();
+        UniValue tmpl(UniValue::VOBJ);
+        tmpl.pushKV("ready",          stats.hashPrevBlock == chainActive.Tip()->GetBlockHash());
+        tmpl.pushKV("age",            stats.nAgeMicros * 0.000001);
+        tmpl.pushKV("pendingupdates", (uint64_t)stats.nPendingUpdates);
+        tmpl.pushKV("builds",         stats.nBuilds);
+        tmpl.pushKV("lastbuildms",    stats.nLastBuildMicros * 0.001);
+        tmpl.pushKV("averagebuildms", stats.nBuilds ? stats.nTotalBuildMicros * 0.001 / stats.nBuilds : 0.0);
+        tmpl.pushKV("lasttipms",      stats.nLastTipMicros * 0.001);
+        tmpl.pushKV("hits",           stats.nHits);
+        tmpl.pushKV("misses",         stats.nMisses);
+        obj.pushKV("blocktemplate", tmpl);
+    }
+    if (g_auxpow_miner) {
+        UniValue auxpow(UniValue::VOBJ);
+        auxpow.pushKV("templates", (uint64_t)auxpow_stats.nTemplates);
+        auxpow.pushKV("usage",     (uint64_t)auxpow_stats.nUsage);
+        auxpow.pushKV("maxusage",  (uint64_t)auxpow_stats.nMaxUsage);
+        auxpow.pushKV("created",   auxpow_stats.nCreated);
+        auxpow.pushKV("shared",    auxpow_stats.nShared);
+        auxpow.pushKV("evicted",   auxpow_stats.nEvicted);
+        auxpow.pushKV("hits",      auxpow_stats.nLookupHits);
+        auxpow.pushKV("misses",    auxpow_stats.nLookupMisses);
+        obj.pushKV("auxpow", auxpow);
+    }
     return obj;
 }
 
@@ -516,9 +646,14 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
         nStart = GetTime();
         fLastTemplateSupportsSegwit = fSupportsSegwit;
 
-        // Create new block
+        // Create new block, unless the template cache has one ready (its
+        // templates may include witness transactions)
         CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy, fSupportsSegwit);
+        pblocktemplate.reset();
+        if (g_template_cache && fSupportsSegwit)
+            pblocktemplate = g_template_cache->Get(pindexPrevNew->GetBlockHash(), scriptDummy, false, &nTransactionsUpdatedLast);
+        if (!pblocktemplate)
+            pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy, fSupportsSegwit);
         if (!pblocktemplate)
             throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
 
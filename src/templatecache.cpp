@@ -0,0 +1,194 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <templatecache.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <consensus/consensus.h>
+#include <consensus/tx_verify.h>
+#include <miner.h>
+#include <script/script.h>
+#include <txmempool.h>
+#include <util.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <chrono>
+
+std::unique_ptr<CBlockTemplateCache> g_template_cache;
+
+CBlockTemplateCache::CBlockTemplateCache() :
+    fInterrupt(false), nRefreshMicros(0), fActive(false), fDirty(false), fTipChanged(false), fBuilding(false),
+    nTipChangedMicros(0), nTransactionsUpdated(0), nBuiltMicros(0), nAttemptMicros(0)
+{
+}
+
+CBlockTemplateCache::~CBlockTemplateCache()
+{
+    Stop();
+}
+
+void CBlockTemplateCache::Start(int64_t nRefreshMillis)
+{
+    assert(!thread.joinable());
+    {
+        WaitableLock lock(cs);
+        fInterrupt = false;
+        nRefreshMicros = nRefreshMillis * 1000;
+    }
+    thread = std::thread([this] { TraceThread("blocktemplate", [this] { ThreadBuild(); }); });
+}
+
+void CBlockTemplateCache::Stop()
+{
+    {
+        WaitableLock lock(cs);
+        fInterrupt = true;
+    }
+    cond.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+    WaitableLock lock(cs);
+    ptemplate.reset();
+}
+
+void CBlockTemplateCache::MarkDirty(bool fTip)
+{
+    fDirty = true;
+    if (fTip) {
+        fTipChanged = true;
+        if (nTipChangedMicros == 0)
+            nTipChangedMicros = GetTimeMicros();
+    }
+    cond.notify_all();
+}
+
+void CBlockTemplateCache::UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload)
+{
+    if (fInitialDownload)
+        return;
+    WaitableLock lock(cs);
+    MarkDirty(true);
+}
+
+void CBlockTemplateCache::TransactionAddedToMempool(const CTransactionRef& ptx)
+{
+    WaitableLock lock(cs);
+    MarkDirty(false);
+}
+
+void CBlockTemplateCache::TransactionRemovedFromMempool(const CTransactionRef& ptx)
+{
+    WaitableLock lock(cs);
+    MarkDirty(false);
+}
+
+void CBlockTemplateCache::ThreadBuild()
+{
+    const CScript scriptDummy = CScript() << OP_TRUE;
+    while (true) {
+        {
+            WaitableLock lock(cs);
+            while (!fInterrupt) {
+                if (fActive && fDirty) {
+                    // Rebuild right away for a new tip, but not more often
+                    // than every refresh interval for mempool changes.
+                    const int64_t nWaitMicros = nAttemptMicros + nRefreshMicros - GetTimeMicros();
+                    if (fTipChanged || nWaitMicros <= 0)
+                        break;
+                    cond.wait_for(lock, std::chrono::microseconds(nWaitMicros));
+                } else {
+                    cond.wait(lock);
+                }
+            }
+            if (fInterrupt)
+                return;
+            fDirty = false;
+            fTipChanged = false;
+            fBuilding = true;
+            nAttemptMicros = GetTimeMicros();
+        }
+
+        std::unique_ptr<CBlockTemplate> pnew;
+        const unsigned int nUpdated = mempool.GetTransactionsUpdated();
+        if (!IsInitialBlockDownload()) {
+            try {
+                pnew = BlockAssembler(Params()).CreateNewBlock(scriptDummy);
+            } catch (const std::exception& e) {
+                LogPrintf("%s: unable to build a block template: %s\n", __func__, e.what());
+            }
+        }
+        const int64_t nNow = GetTimeMicros();
+
+        {
+            WaitableLock lock(cs);
+            fBuilding = false;
+            if (pnew) {
+                LogPrint(BCLog::BENCH, "Built a block template with %u transactions in %.2fms\n", pnew->block.vtx.size(), (nNow - nAttemptMicros) * 0.001);
+                ptemplate = std::move(pnew);
+                nTransactionsUpdated = nUpdated;
+                nBuiltMicros = nNow;
+                stats.nBuilds++;
+                stats.nLastBuildMicros = nNow - nAttemptMicros;
+                stats.nTotalBuildMicros += stats.nLastBuildMicros;
+                if (nTipChangedMicros != 0 && !fTipChanged) {
+                    stats.nLastTipMicros = nNow - nTipChangedMicros;
+                    nTipChangedMicros = 0;
+                }
+            }
+        }
+        cond.notify_all();
+    }
+}
+
+std::unique_ptr<CBlockTemplate> CBlockTemplateCache::Get(const uint256& hashPrev, const CScript& scriptPubKey, bool fWait, unsigned int* pnTransactionsUpdated)
+{
+    std::shared_ptr<const CBlockTemplate> pcached;
+    {
+        WaitableLock lock(cs);
+        fActive = true;
+        auto fMatches = [this, &hashPrev] { return ptemplate && ptemplate->block.hashPrevBlock == hashPrev; };
+        if (!fMatches() && thread.joinable() && !fInterrupt) {
+            MarkDirty(true);
+            if (fWait) {
+                AssertLockNotHeld(cs_main);
+                cond.wait(lock, [this, &fMatches] { return fInterrupt || fMatches() || (!fBuilding && !fDirty); });
+            }
+        }
+        if (!fMatches()) {
+            stats.nMisses++;
+            return nullptr;
+        }
+        stats.nHits++;
+        pcached = ptemplate;
+        if (pnTransactionsUpdated)
+            *pnTransactionsUpdated = nTransactionsUpdated;
+    }
+
+    std::unique_ptr<CBlockTemplate> pnew(new CBlockTemplate(*pcached));
+    CMutableTransaction coinbaseTx(*pnew->block.vtx[0]);
+    coinbaseTx.vout[0].scriptPubKey = scriptPubKey;
+    pnew->block.vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    pnew->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pnew->block.vtx[0]);
+    return pnew;
+}
+
+BlockTemplateCacheStats CBlockTemplateCache::GetStats() const
+{
+    BlockTemplateCacheStats ret;
+    unsigned int nUpdated;
+    {
+        WaitableLock lock(cs);
+        ret = stats;
+        if (!ptemplate)
+            return ret;
+        ret.hashPrevBlock = ptemplate->block.hashPrevBlock;
+        ret.nAgeMicros = GetTimeMicros() - nBuiltMicros;
+        nUpdated = nTransactionsUpdated;
+    }
+    ret.nPendingUpdates = mempool.GetTransactionsUpdated() - nUpdated;
+    return ret;
+}
@@ -0,0 +1,107 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WORLDCOIN_TEMPLATECACHE_H
+#define WORLDCOIN_TEMPLATECACHE_H
+
+#include <primitives/transaction.h>
+#include <sync.h>
+#include <uint256.h>
+#include <validationinterface.h>
+
+#include <memory>
+#include <stdint.h>
+#include <thread>
+
+class CBlockIndex;
+class CScript;
+struct CBlockTemplate;
+
+/** Default for -blocktemplatecache */
+static const bool DEFAULT_BLOCK_TEMPLATE_CACHE = true;
+/** Default for -blocktemplaterefresh, in milliseconds */
+static const int64_t DEFAULT_BLOCK_TEMPLATE_REFRESH = 5000;
+
+struct BlockTemplateCacheStats
+{
+    uint256 hashPrevBlock;        //!< The block the template builds on, if there is one
+    int64_t nAgeMicros = 0;       //!< Time since that template was built
+    unsigned int nPendingUpdates = 0; //!< Mempool updates it doesn't include yet
+    uint64_t nBuilds = 0;         //!< Templates built
+    int64_t nLastBuildMicros = 0; //!< Time the last build took
+    int64_t nTotalBuildMicros = 0; //!< Time all builds took
+    int64_t nLastTipMicros = 0;   //!< Time from the last tip change to a template on top of it
+    uint64_t nHits = 0;           //!< Requests served from the cache
+    uint64_t nMisses = 0;         //!< Requests the caller had to build a template for
+};
+
+/**
+ * Keeps a block template on top of the current tip ready for the mining RPCs,
+ * so that they don't have to run CreateNewBlock() themselves.
+ *
+ * The template is rebuilt on a thread of its own: right away when the tip
+ * changes, and when the mempool changes at most once every refresh interval.
+ * Nothing is built until a template is first asked for, nor during the
+ * initial block download. Templates pay to a placeholder script, which is
+ * swapped for the caller's when one is handed out.
+ */
+class CBlockTemplateCache : public CValidationInterface
+{
+private:
+    mutable CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    std::thread thread;
+    bool fInterrupt;
+    int64_t nRefreshMicros;
+
+    //! Whether a template was asked for, so that one should be kept ready
+    bool fActive;
+    //! Whether the template is out of date, and whether that is because of the tip
+    bool fDirty;
+    bool fTipChanged;
+    //! Whether a template is being built
+    bool fBuilding;
+    int64_t nTipChangedMicros;
+
+    std::shared_ptr<const CBlockTemplate> ptemplate;
+    unsigned int nTransactionsUpdated;
+    int64_t nBuiltMicros;
+    int64_t nAttemptMicros;
+
+    BlockTemplateCacheStats stats;
+
+    void ThreadBuild();
+    void MarkDirty(bool fTip);
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override;
+    void TransactionAddedToMempool(const CTransactionRef& ptx) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& ptx) override;
+
+public:
+    CBlockTemplateCache();
+    ~CBlockTemplateCache();
+
+    //! Start the build thread, rebuilding after mempool changes at most every nRefreshMillis
+    void Start(int64_t nRefreshMillis);
+    //! Stop and join the build thread
+    void Stop();
+
+    /**
+     * Get a copy of the template on top of hashPrev, paying to scriptPubKey.
+     * If there is none, returns nullptr and has one built, unless fWait is
+     * set and one is being built already, in which case it waits for that.
+     * The caller must not hold cs_main when fWait is set. If
+     * pnTransactionsUpdated is given, it gets the mempool's update counter as
+     * of the template.
+     */
+    std::unique_ptr<CBlockTemplate> Get(const uint256& hashPrev, const CScript& scriptPubKey, bool fWait, unsigned int* pnTransactionsUpdated = nullptr);
+
+    BlockTemplateCacheStats GetStats() const;
+};
+
+/** The template cache, if enabled */
+extern std::unique_ptr<CBlockTemplateCache> g_template_cache;
+
+#endif // WORLDCOIN_TEMPLATECACHE_H
@@ -504,6 +504,13 @@ class AuxpowMinerForTest : public AuxpowMiner
 
 public:
 
+  explicit AuxpowMinerForTest (const size_t maxUsage
+                                 = DEFAULT_AUXPOW_TEMPLATE_CACHE << 20,
+                               const size_t maxTemplates
+                                 = DEFAULT_AUXPOW_MAX_TEMPLATES)
+    : AuxpowMiner (maxUsage, maxTemplates)
+  {}
+
   using AuxpowMiner::cs;
 
   using AuxpowMiner::getCurrentBlock;
@@ -586,6 +593,64 @@ BOOST_FIXTURE_TEST_CASE (auxpow_miner_createAndLookupBlock, TestChain240Setup)
   BOOST_CHECK_THROW (miner.lookupSavedBlock ("foobar"), UniValue);
 }
 
+/* This only needs blocks on top of some tip, so it builds on the genesis
+   block of the main chain and doesn't depend on the regtest chain of
+   TestChain240Setup.  */
+BOOST_FIXTURE_TEST_CASE (auxpow_miner_boundedStore, TestingSetup)
+{
+  /* Keep at most two blocks.  */
+  AuxpowMinerForTest miner(DEFAULT_AUXPOW_TEMPLATE_CACHE << 20, 2);
+  LOCK (miner.cs);
+
+  const CScript script1 = CScript () << OP_1;
+  const CScript script2 = CScript () << OP_2;
+  const CScript script3 = CScript () << OP_3;
+  uint256 target;
+
+  /* Requests for the same script share a block, other scripts get their
+     own one paying to them.  */
+  const CBlock* pblock1 = miner.getCurrentBlock (script1, target);
+  BOOST_CHECK (miner.getCurrentBlock (script1, target) == pblock1);
+  const CBlock* pblock2 = miner.getCurrentBlock (script2, target);
+  BOOST_CHECK (pblock2 != pblock1);
+  BOOST_CHECK (pblock1->vtx[0]->vout[0].scriptPubKey == script1);
+  BOOST_CHECK (pblock2->vtx[0]->vout[0].scriptPubKey == script2);
+  const std::string hex1 = pblock1->GetHash ().GetHex ();
+  const std::string hex2 = pblock2->GetHash ().GetHex ();
+
+  /* Looking up the first block makes the second one the least recently used,
+     so that it is evicted for the block of a third script.  */
+  BOOST_CHECK (miner.lookupSavedBlock (hex1) == pblock1);
+  const CBlock* pblock3 = miner.getCurrentBlock (script3, target);
+  BOOST_CHECK (pblock3->vtx[0]->vout[0].scriptPubKey == script3);
+  BOOST_CHECK (miner.lookupSavedBlock (hex1) == pblock1);
+  BOOST_CHECK_THROW (miner.lookupSavedBlock (hex2), UniValue);
+
+  /* The evicted block is no longer handed out for its script either.  */
+  const CBlock* pblock = miner.getCurrentBlock (script2, target);
+  BOOST_CHECK (pblock->GetHash ().GetHex () != hex2);
+  BOOST_CHECK (miner.lookupSavedBlock (hex1) == pblock1);
+
+  const AuxpowMiner::Stats stats = miner.getStats ();
+  BOOST_CHECK_EQUAL (stats.nTemplates, 2u);
+  BOOST_CHECK (stats.nUsage > 0 && stats.nUsage <= stats.nMaxUsage);
+  BOOST_CHECK_EQUAL (stats.nCreated, 4u);
+  BOOST_CHECK_EQUAL (stats.nShared, 1u);
+  BOOST_CHECK_EQUAL (stats.nEvicted, 2u);
+  BOOST_CHECK_EQUAL (stats.nLookupHits, 3u);
+  BOOST_CHECK_EQUAL (stats.nLookupMisses, 1u);
+
+  /* With a memory limit below the size of a single block, the most recent
+     one is still kept.  */
+  AuxpowMinerForTest tiny(1);
+  LOCK (tiny.cs);
+  tiny.getCurrentBlock (script1, target);
+  pblock = tiny.getCurrentBlock (script2, target);
+  BOOST_CHECK (tiny.lookupSavedBlock (pblock->GetHash ().GetHex ()) == pblock);
+  BOOST_CHECK_EQUAL (tiny.getStats ().nTemplates, 1u);
+  BOOST_CHECK_EQUAL (tiny.getStats ().nEvicted, 1u);
+}
+
 /* ************************************************************************** */
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -2,9 +2,17 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <chainparams.h>
 #include <coins.h>
+#include <coinstats.h>
+#include <coinsprefetch.h>
+#include <coinswriter.h>
+#include <primitives/block.h>
 #include <script/standard.h>
+#include <txdb.h>
+#include <txoutset.h>
 #include <uint256.h>
+#include <streams.h>
 #include <undo.h>
 #include <utilstrencodings.h>
 #include <test/test_worldcoin.h>
@@ -13,6 +21,7 @@
 
 #include <vector>
 #include <map>
+#include <unordered_map>
 
 #include <boost/test/unit_test.hpp>
 
@@ -43,7 +52,7 @@ public:
 
     uint256 GetBestBlock() const override { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) override
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool fErase) override
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
@@ -54,7 +63,10 @@ public:
                     map_.erase(it->first);
                 }
             }
-            mapCoins.erase(it++);
+            if (fErase)
+                mapCoins.erase(it++);
+            else
+                ++it;
         }
         if (!hashBlock.IsNull())
             hashBestBlock_ = hashBlock;
@@ -198,10 +210,15 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
         }
 
         if (InsecureRandRange(100) == 0) {
-            // Every 100 iterations, flush an intermediate cache
+            // Every 100 iterations, flush an intermediate cache, possibly
+            // keeping some or all of its unmodified entries.
             if (stack.size() > 1 && InsecureRandBool() == 0) {
                 unsigned int flushIndex = InsecureRandRange(stack.size() - 1);
-                stack[flushIndex]->Flush();
+                if (InsecureRandBool()) {
+                    stack[flushIndex]->Flush();
+                } else {
+                    stack[flushIndex]->Sync(InsecureRandRange(stack[flushIndex]->DynamicMemoryUsage() * 2 + 1));
+                }
             }
         }
         if (InsecureRandRange(100) == 0) {
@@ -431,10 +448,15 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
         }
 
         if (InsecureRandRange(100) == 0) {
-            // Every 100 iterations, flush an intermediate cache
+            // Every 100 iterations, flush an intermediate cache, possibly
+            // keeping some or all of its unmodified entries.
             if (stack.size() > 1 && InsecureRandBool() == 0) {
                 unsigned int flushIndex = InsecureRandRange(stack.size() - 1);
-                stack[flushIndex]->Flush();
+                if (InsecureRandBool()) {
+                    stack[flushIndex]->Flush();
+                } else {
+                    stack[flushIndex]->Sync(InsecureRandRange(stack[flushIndex]->DynamicMemoryUsage() * 2 + 1));
+                }
             }
         }
         if (InsecureRandRange(100) == 0) {
@@ -579,7 +601,7 @@ void WriteCoinsViewEntry(CCoinsView& view, CAmount value, char flags)
 {
     CCoinsMap map;
     InsertCoinsMapEntry(map, value, flags);
-    view.BatchWrite(map, {});
+    view.BatchWrite(map, {}, true);
 }
 
 class SingleEntryCacheTest
@@ -846,4 +868,463 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+static bool CoinsEntriesEqual(const CCoinsCacheEntry& a, const CCoinsCacheEntry& b)
+{
+    return a.flags == b.flags && a.coin.out == b.coin.out && a.coin.nHeight == b.coin.nHeight && a.coin.fCoinBase == b.coin.fCoinBase;
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_map_differential)
+{
+    // Run the same random operations on CCoinsMap and on the
+    // std::unordered_map it replaced, and check that they always agree.
+    typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> ReferenceMap;
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 400; i++)
+        outpoints.emplace_back(InsecureRand256(), InsecureRandRange(4));
+
+    CCoinsMap map;
+    ReferenceMap ref;
+
+    // Entries must not move while the table grows and shrinks around them.
+    const COutPoint pinned(InsecureRand256(), 0);
+    const CCoinsCacheEntry* pinnedEntry = &map[pinned];
+    ref[pinned];
+
+    for (int step = 0; step < 40000; step++) {
+        const COutPoint& outpoint = outpoints[InsecureRandRange(outpoints.size())];
+        switch (InsecureRandRange(8)) {
+        case 0: {
+            CCoinsCacheEntry entry;
+            entry.flags = InsecureRandRange(4);
+            entry.coin = Coin(CTxOut(InsecureRand32(), CScript() << OP_TRUE), InsecureRandRange(1000), InsecureRandBool());
+            auto inserted = map.emplace(outpoint, entry);
+            auto refInserted = ref.emplace(outpoint, entry);
+            BOOST_CHECK_EQUAL(inserted.second, refInserted.second);
+            BOOST_CHECK(CoinsEntriesEqual(inserted.first->second, refInserted.first->second));
+            break;
+        }
+        case 1: {
+            // The path CCoinsViewCache::FetchCoin takes.
+            Coin coin(CTxOut(InsecureRand32(), CScript()), 1, false);
+            Coin refCoin = coin;
+            bool inserted = map.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(coin))).second;
+            bool refInserted = ref.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(refCoin))).second;
+            BOOST_CHECK_EQUAL(inserted, refInserted);
+            break;
+        }
+        case 2: {
+            unsigned char flags = InsecureRandRange(4);
+            map[outpoint].flags ^= flags;
+            ref[outpoint].flags ^= flags;
+            break;
+        }
+        case 3:
+        case 4:
+            BOOST_CHECK_EQUAL(map.erase(outpoint), ref.erase(outpoint));
+            break;
+        case 5:
+            if (InsecureRandRange(64) == 0) {
+                // Erase while iterating, as BatchWrite implementations do.
+                for (CCoinsMap::iterator it = map.begin(); it != map.end();) {
+                    if (it->first == pinned || InsecureRandBool()) {
+                        ++it;
+                    } else {
+                        BOOST_CHECK_EQUAL(ref.erase(it->first), 1U);
+                        it = map.erase(it);
+                    }
+                }
+                break;
+            }
+            // fall through
+        default: {
+            CCoinsMap::const_iterator it = map.find(outpoint);
+            ReferenceMap::const_iterator refIt = ref.find(outpoint);
+            BOOST_CHECK_EQUAL(it == map.end(), refIt == ref.end());
+            if (it != map.end() && refIt != ref.end())
+                BOOST_CHECK(CoinsEntriesEqual(it->second, refIt->second));
+            break;
+        }
+        }
+        BOOST_CHECK_EQUAL(map.size(), ref.size());
+    }
+
+    size_t count = 0;
+    for (const auto& entry : map) {
+        ReferenceMap::const_iterator refIt = ref.find(entry.first);
+        BOOST_CHECK(refIt != ref.end() && CoinsEntriesEqual(entry.second, refIt->second));
+        count++;
+    }
+    BOOST_CHECK_EQUAL(count, ref.size());
+    BOOST_CHECK_EQUAL(&map.find(pinned)->second, pinnedEntry);
+
+    // Repacking keeps exactly the entries the predicate asks for.
+    map.compact([&](const CCoinsMap::value_type& entry) {
+        if (InsecureRandBool())
+            return true;
+        ref.erase(entry.first);
+        return false;
+    });
+    BOOST_CHECK_EQUAL(map.size(), ref.size());
+    for (const auto& entry : ref) {
+        CCoinsMap::const_iterator it = map.find(entry.first);
+        BOOST_CHECK(it != map.end() && CoinsEntriesEqual(it->second, entry.second));
+    }
+
+    BOOST_CHECK(memusage::DynamicUsage(map) > 0);
+    map.clear();
+    BOOST_CHECK(map.empty() && map.begin() == map.end());
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_sync)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 200; i++) {
+        outpoints.emplace_back(InsecureRand256(), 0);
+        cache.AddCoin(outpoints.back(), Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false), false);
+    }
+    cache.SetBestBlock(InsecureRand256());
+    cache.SpendCoin(outpoints[0]);
+
+    // Writing everything out keeps the unspent coins, now unmodified.
+    BOOST_CHECK(cache.Sync(std::numeric_limits<size_t>::max()));
+    cache.SelfTest();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), outpoints.size() - 1);
+    for (const auto& entry : cache.map())
+        BOOST_CHECK_EQUAL(entry.second.flags, 0);
+    Coin coin;
+    BOOST_CHECK(base.GetCoin(outpoints[1], coin) && coin.out.nValue == 2);
+    BOOST_CHECK_EQUAL(cache.GetFlushStats().nSyncs, 1U);
+    BOOST_CHECK_EQUAL(cache.GetFlushStats().nCoinsWritten, outpoints.size() - 1);
+    BOOST_CHECK_EQUAL(cache.GetFlushStats().nCoinsEvicted, 0U);
+
+    // Let a few blocks go by while only the second half of the coins is used.
+    for (int i = 0; i < 4; i++) {
+        CCoinsViewCacheTest child(&cache);
+        BOOST_CHECK(child.Flush());
+        for (size_t j = outpoints.size() / 2; j < outpoints.size(); j++)
+            cache.AccessCoin(outpoints[j]);
+    }
+
+    // Over budget, the coins used least recently go first.
+    const size_t target = cache.DynamicMemoryUsage() / 2;
+    BOOST_CHECK(cache.Sync(target));
+    cache.SelfTest();
+    BOOST_CHECK(cache.DynamicMemoryUsage() <= target);
+    BOOST_CHECK(cache.GetFlushStats().nCoinsEvicted > 0);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize() + cache.GetFlushStats().nCoinsEvicted, outpoints.size() - 1);
+    bool fOldKept = false;
+    bool fRecentEvicted = false;
+    for (size_t j = 1; j < outpoints.size(); j++) {
+        if (j < outpoints.size() / 2)
+            fOldKept |= cache.HaveCoinInCache(outpoints[j]);
+        else
+            fRecentEvicted |= !cache.HaveCoinInCache(outpoints[j]);
+    }
+    BOOST_CHECK(!(fOldKept && fRecentEvicted));
+
+    // Nothing may stay with no budget at all.
+    BOOST_CHECK(cache.Sync(0));
+    cache.SelfTest();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    BOOST_CHECK_EQUAL(cache.GetFlushStats().nCoinsEvicted, outpoints.size() - 1);
+    BOOST_CHECK(base.GetCoin(outpoints[199], coin) && coin.out.nValue == 200);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_prefetch)
+{
+    CCoinsViewTest base;
+    CCoinsViewPrefetch prefetch(&base, Params().GetConsensus(), 1 << 20);
+
+    // A block spending two coins of the base view and one unknown coin.
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    CMutableTransaction spend;
+    spend.vin.resize(3);
+    for (unsigned int i = 0; i < spend.vin.size(); i++)
+        spend.vin[i].prevout = COutPoint(InsecureRand256(), i);
+    spend.vout.resize(1);
+    CBlock block;
+    block.vtx = {MakeTransactionRef(coinbase), MakeTransactionRef(spend)};
+
+    {
+        CCoinsViewCache cache(&base);
+        for (unsigned int i = 0; i < 2; i++)
+            cache.AddCoin(spend.vin[i].prevout, Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false), false);
+        BOOST_CHECK(cache.Flush());
+    }
+
+    prefetch.FetchBlockInputs(block);
+    BOOST_CHECK(prefetch.HaveCoin(spend.vin[0].prevout));
+    BOOST_CHECK(!prefetch.HaveCoin(spend.vin[2].prevout));
+    const size_t nStagedUsage = prefetch.DynamicMemoryUsage();
+    BOOST_CHECK(nStagedUsage > 0);
+
+    // Nothing is staged beyond the memory budget.
+    CCoinsViewPrefetch full(&base, Params().GetConsensus(), 0);
+    const size_t nEmptyUsage = full.DynamicMemoryUsage();
+    full.FetchBlockInputs(block);
+    BOOST_CHECK_EQUAL(full.DynamicMemoryUsage(), nEmptyUsage);
+
+    // Spend both coins behind the prefetcher's back; the staged copies are
+    // still served, but only once.
+    {
+        CCoinsViewCache cache(&base);
+        for (unsigned int i = 0; i < 2; i++)
+            BOOST_CHECK(cache.SpendCoin(spend.vin[i].prevout));
+        BOOST_CHECK(cache.Flush());
+    }
+    Coin coin;
+    BOOST_CHECK(prefetch.GetCoin(spend.vin[0].prevout, coin));
+    BOOST_CHECK_EQUAL(coin.out.nValue, 1);
+    BOOST_CHECK(!prefetch.GetCoin(spend.vin[0].prevout, coin) || coin.IsSpent());
+
+    // A write through the prefetcher drops whatever is still staged.
+    CCoinsMap mapCoins;
+    BOOST_CHECK(prefetch.BatchWrite(mapCoins, uint256(), true));
+    BOOST_CHECK(!prefetch.GetCoin(spend.vin[1].prevout, coin) || coin.IsSpent());
+    BOOST_CHECK(prefetch.DynamicMemoryUsage() < nStagedUsage);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_writer)
+{
+    SetDataDir("ccoins_writer");
+    CBlockTreeDB blocktree(1 << 20, true);
+    CCoinsViewTest base;
+    CCoinsViewWriter writer(&base, &blocktree);
+    CCoinsViewCache cache(&writer);
+
+    // Stage a coin and a block index update; none of it is on disk before
+    // Commit(), but lookups through the writer already see it.
+    COutPoint outpoint(InsecureRand256(), 0);
+    uint256 hashBlock = InsecureRand256();
+    CBlockIndex index;
+    index.phashBlock = &hashBlock;
+    CBlockFileInfo info;
+    info.nBlocks = 1;
+    BOOST_CHECK(writer.StageBlockIndex({std::make_pair(0, info)}, 0, {index}));
+    cache.AddCoin(outpoint, Coin(CTxOut(1, CScript() << OP_TRUE), 1, false), false);
+    cache.SetBestBlock(hashBlock);
+    BOOST_CHECK(cache.Flush());
+
+    Coin coin;
+    BOOST_CHECK(!base.GetCoin(outpoint, coin));
+    BOOST_CHECK(base.GetBestBlock().IsNull());
+    BOOST_CHECK(writer.GetCoin(outpoint, coin));
+    BOOST_CHECK(writer.GetBestBlock() == hashBlock);
+    BOOST_CHECK(!blocktree.ReadBlockFileInfo(0, info));
+    const size_t nStagedUsage = writer.DynamicMemoryUsage();
+    BOOST_CHECK(nStagedUsage > 0);
+
+    // Without a thread, Commit() writes on the calling thread.
+    bool fCommitted = false;
+    BOOST_CHECK(writer.Commit([&fCommitted] { fCommitted = true; }, false));
+    BOOST_CHECK(fCommitted);
+    BOOST_CHECK(base.GetCoin(outpoint, coin));
+    BOOST_CHECK(base.GetBestBlock() == hashBlock);
+    BOOST_CHECK(blocktree.ReadBlockFileInfo(0, info));
+    BOOST_CHECK_EQUAL(info.nBlocks, 1U);
+    BOOST_CHECK(writer.DynamicMemoryUsage() < nStagedUsage);
+
+    // With the thread running, spending the coin is visible through the
+    // writer right away and on disk once the write completes.
+    writer.Start();
+    hashBlock = InsecureRand256();
+    BOOST_CHECK(cache.SpendCoin(outpoint));
+    cache.SetBestBlock(hashBlock);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!writer.HaveCoin(outpoint));
+    fCommitted = false;
+    BOOST_CHECK(writer.Commit([&fCommitted] { fCommitted = true; }, false));
+    BOOST_CHECK(writer.Commit(nullptr, true));
+    BOOST_CHECK(fCommitted);
+    BOOST_CHECK(!base.GetCoin(outpoint, coin) || coin.IsSpent());
+    BOOST_CHECK(base.GetBestBlock() == hashBlock);
+    writer.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(txoutset_dump_load)
+{
+    SetDataDir("txoutset_dump_load");
+
+    // A database with the outputs of a couple hundred transactions
+    CCoinsViewDB source(1 << 20, true, true);
+    uint256 hashBlock = InsecureRand256();
+    {
+        CCoinsViewCache cache(&source);
+        for (int i = 0; i < 200; i++) {
+            uint256 txid = InsecureRand256();
+            const uint32_t nOutputs = 1 + InsecureRandRange(4);
+            for (uint32_t n = 0; n < nOutputs; n++) {
+                CScript script;
+                script.assign(InsecureRandRange(40), OP_TRUE);
+                cache.AddCoin(COutPoint(txid, 3 * n), Coin(CTxOut(InsecureRandRange(1000000), script), 1 + InsecureRandRange(1000), InsecureRandBool()), false);
+            }
+        }
+        cache.SetBestBlock(hashBlock);
+        BOOST_CHECK(cache.Flush());
+    }
+    CCoinsStats expected;
+    BOOST_CHECK(GetUTXOStats(&source, expected));
+
+    CAutoFile file(fsbridge::fopen(GetDataDir() / "txoutset.dat", "w+b"), SER_DISK, CLIENT_VERSION);
+    std::unique_ptr<CCoinsViewCursor> pcursor(source.Cursor());
+    CCoinsStats dumped;
+    BOOST_CHECK(WriteTxOutSet(*pcursor, 1234, file, dumped));
+    BOOST_CHECK(dumped.hashSerialized == expected.hashSerialized);
+    BOOST_CHECK_EQUAL(dumped.nTransactionOutputs, expected.nTransactionOutputs);
+    // The block of the source database is unknown, so its nChainTx is 0.
+    BOOST_CHECK(dumped.hashSerialized3 != expected.hashSerialized3);
+
+    // Reading it back, just for the hash or into an empty database, gives the
+    // same UTXO set.
+    CTxOutSetHeader header;
+    CCoinsStats read;
+    rewind(file.Get());
+    BOOST_CHECK(ReadTxOutSetHeader(file, header));
+    BOOST_CHECK(header.hashBlock == hashBlock);
+    BOOST_CHECK_EQUAL(header.nChainTx, 1234U);
+    BOOST_CHECK_EQUAL(header.nCoins, expected.nTransactionOutputs);
+    BOOST_CHECK(ReadTxOutSet(file, header, nullptr, read));
+    BOOST_CHECK(read.hashSerialized == expected.hashSerialized);
+    BOOST_CHECK(read.hashSerialized3 == dumped.hashSerialized3);
+
+    CCoinsViewDB dest(1 << 20, true, true);
+    CCoinsStats loaded;
+    rewind(file.Get());
+    BOOST_CHECK(ReadTxOutSetHeader(file, header));
+    BOOST_CHECK(ReadTxOutSet(file, header, &dest, loaded));
+    BOOST_CHECK(loaded.hashSerialized3 == dumped.hashSerialized3);
+    // Until a regular write completes it, the database is in transition.
+    BOOST_CHECK(dest.GetBestBlock().IsNull());
+    CCoinsMap mapCoins;
+    BOOST_CHECK(dest.BatchWrite(mapCoins, hashBlock, true));
+    CCoinsStats check;
+    BOOST_CHECK(GetUTXOStats(&dest, check));
+    BOOST_CHECK(check.hashSerialized == expected.hashSerialized);
+
+    // A damaged file can't be read, or doesn't match the hash.
+    BOOST_CHECK_EQUAL(fseek(file.Get(), 500, SEEK_SET), 0);
+    int c = fgetc(file.Get());
+    BOOST_CHECK_EQUAL(fseek(file.Get(), 500, SEEK_SET), 0);
+    fputc(c ^ 0x20, file.Get());
+    CCoinsStats damaged;
+    rewind(file.Get());
+    BOOST_CHECK(ReadTxOutSetHeader(file, header));
+    BOOST_CHECK(!ReadTxOutSet(file, header, nullptr, damaged) || damaged.hashSerialized != expected.hashSerialized);
+}
+
+BOOST_AUTO_TEST_CASE(coins_stats_hash_serialized_3)
+{
+    // Outputs of two transactions, hashed with one field changed at a time
+    const uint256 txid1 = InsecureRand256(), txid2 = InsecureRand256();
+    const Coin coin(CTxOut(1000, CScript() << OP_TRUE), 100, false);
+    auto hash = [&](unsigned int nChainTx, uint32_t nHeight, bool fCoinBase) {
+        CCoinsStats stats;
+        stats.nChainTx = nChainTx;
+        CCoinsStatsHasher hasher(stats);
+        hasher.Add(COutPoint(txid1, 0), Coin(coin));
+        Coin changed(coin);
+        changed.nHeight = nHeight;
+        changed.fCoinBase = fCoinBase;
+        hasher.Add(COutPoint(txid1, 1), std::move(changed));
+        hasher.Add(COutPoint(txid2, 0), Coin(coin));
+        hasher.Finalize();
+        return stats;
+    };
+
+    const CCoinsStats base = hash(10, 100, false);
+    for (const CCoinsStats& stats : {hash(11, 100, false), hash(10, 101, false), hash(10, 100, true)}) {
+        BOOST_CHECK(stats.hashSerialized3 != base.hashSerialized3);
+    }
+    // hash_serialized_2 only covers the first output of each transaction,
+    // and not its height or coinbase flag at all.
+    BOOST_CHECK(hash(11, 101, true).hashSerialized == base.hashSerialized);
+    BOOST_CHECK(hash(10, 100, false).hashSerialized3 == base.hashSerialized3);
+}
+
+BOOST_AUTO_TEST_CASE(coins_rolling_stats)
+{
+    // A database with the outputs of a hundred transactions
+    CCoinsViewDB db(1 << 20, true, true);
+    std::vector<std::pair<COutPoint, Coin>> coins;
+    {
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < 100; i++) {
+            uint256 txid = InsecureRand256();
+            const uint32_t nOutputs = 1 + InsecureRandRange(3);
+            for (uint32_t n = 0; n < nOutputs; n++) {
+                CScript script;
+                script.assign(InsecureRandRange(40), OP_TRUE);
+                Coin coin(CTxOut(InsecureRandRange(1000000), script), 1 + InsecureRandRange(1000), InsecureRandBool());
+                coins.emplace_back(COutPoint(txid, n), coin);
+                cache.AddCoin(coins.back().first, std::move(coin), false);
+            }
+        }
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+    CCoinsRollingStats stats;
+    BOOST_CHECK(ComputeCoinsRollingStats(&db, stats));
+    CCoinsStats expected;
+    BOOST_CHECK(GetUTXOStats(&db, expected));
+    BOOST_CHECK(stats.hashBlock == expected.hashBlock);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, expected.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.nBogoSize, expected.nBogoSize);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, expected.nTotalAmount);
+
+    // A block spending some coins and creating others changes the set the
+    // way its delta says.
+    CCoinsRollingStats delta;
+    {
+        CCoinsViewCache cache(&db);
+        for (size_t i = 0; i < coins.size(); i += 3) {
+            BOOST_CHECK(cache.SpendCoin(coins[i].first));
+            delta.Remove(coins[i].first, coins[i].second);
+        }
+        for (uint32_t n = 0; n < 20; n++) {
+            COutPoint outpoint(InsecureRand256(), n);
+            Coin coin(CTxOut(InsecureRandRange(1000000), CScript() << OP_TRUE), 1001, false);
+            delta.Add(outpoint, coin);
+            cache.AddCoin(outpoint, std::move(coin), false);
+        }
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+    stats += delta;
+    CCoinsRollingStats recomputed;
+    BOOST_CHECK(ComputeCoinsRollingStats(&db, recomputed));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, recomputed.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.nBogoSize, recomputed.nBogoSize);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, recomputed.nTotalAmount);
+    BOOST_CHECK(stats.GetHash() == recomputed.GetHash());
+    BOOST_CHECK(stats.GetHash() != CCoinsRollingStats().GetHash());
+
+    // They are stored with the chainstate.
+    stats.hashBlock = recomputed.hashBlock;
+    BOOST_CHECK(db.WriteRollingStats(stats));
+    CCoinsRollingStats read;
+    BOOST_CHECK(db.ReadRollingStats(read));
+    BOOST_CHECK(read.hashBlock == recomputed.hashBlock);
+    BOOST_CHECK_EQUAL(read.nTransactionOutputs, recomputed.nTransactionOutputs);
+    BOOST_CHECK(read.GetHash() == recomputed.GetHash());
+
+    // Staged statistics are only written along with the coins of their block.
+    CCoinsRollingStats staged = stats;
+    staged.hashBlock = InsecureRand256();
+    staged.nTransactionOutputs++;
+    db.StageRollingStats(staged);
+    CCoinsMap mapCoins;
+    BOOST_CHECK(db.BatchWrite(mapCoins, InsecureRand256(), true));
+    BOOST_CHECK(db.ReadRollingStats(read));
+    BOOST_CHECK(read.hashBlock == recomputed.hashBlock);
+    BOOST_CHECK(db.BatchWrite(mapCoins, staged.hashBlock, true));
+    BOOST_CHECK(db.ReadRollingStats(read));
+    BOOST_CHECK(read.hashBlock == staged.hashBlock);
+    BOOST_CHECK_EQUAL(read.nTransactionOutputs, staged.nTransactionOutputs);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
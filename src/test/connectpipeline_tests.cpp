@@ -0,0 +1,75 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <connectpipeline.h>
+#include <primitives/block.h>
+#include <test/test_worldcoin.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(connectpipeline_tests, TestingSetup)
+
+//! Wait until the pipeline holds nReady checked blocks
+static void WaitForReady(const CConnectPipeline& pipeline, size_t nReady)
+{
+    for (int i = 0; i < 1000 && pipeline.GetStats().nReady < nReady; i++)
+        MilliSleep(10);
+    BOOST_CHECK_EQUAL(pipeline.GetStats().nReady, nReady);
+}
+
+BOOST_AUTO_TEST_CASE(connectpipeline_read_check)
+{
+    std::pair<uint256, CDiskBlockPos> genesis;
+    {
+        LOCK(cs_main);
+        genesis = std::make_pair(chainActive.Genesis()->GetBlockHash(), chainActive.Genesis()->GetBlockPos());
+    }
+    CConnectPipeline pipeline(Params().GetConsensus());
+
+    // Without threads nothing is scheduled.
+    pipeline.Schedule({genesis});
+    BOOST_CHECK(pipeline.Take(genesis.first) == nullptr);
+    BOOST_CHECK_EQUAL(pipeline.GetStats().nMisses, 0U);
+
+    pipeline.Start(2);
+    pipeline.Schedule({genesis});
+    WaitForReady(pipeline, 1);
+    ConnectPipelineStats stats = pipeline.GetStats();
+    BOOST_CHECK_EQUAL(stats.read.nProcessed, 1U);
+    BOOST_CHECK_EQUAL(stats.check.nProcessed, 1U);
+    BOOST_CHECK_EQUAL(stats.read.nQueued + stats.check.nQueued, 0U);
+
+    // The block comes out checked, and only once.
+    std::shared_ptr<const CBlock> pblock = pipeline.Take(genesis.first);
+    BOOST_REQUIRE(pblock);
+    BOOST_CHECK(pblock->GetHash() == genesis.first);
+    BOOST_CHECK(pblock->fChecked);
+    BOOST_CHECK(pipeline.Take(genesis.first) == nullptr);
+    stats = pipeline.GetStats();
+    BOOST_CHECK_EQUAL(stats.nHits + stats.nWaits, 1U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 1U);
+
+    // Blocks that are no longer scheduled are dropped.
+    pipeline.Schedule({genesis});
+    WaitForReady(pipeline, 1);
+    pipeline.Schedule({});
+    BOOST_CHECK_EQUAL(pipeline.GetStats().nReady, 0U);
+    BOOST_CHECK_EQUAL(pipeline.GetStats().nDropped, 1U);
+
+    // A block that doesn't match its hash never becomes ready.
+    const uint256 hashWrong = InsecureRand256();
+    pipeline.Schedule({std::make_pair(hashWrong, genesis.second)});
+    for (int i = 0; i < 1000 && pipeline.GetStats().read.nProcessed < 3; i++)
+        MilliSleep(10);
+    BOOST_CHECK(pipeline.Take(hashWrong) == nullptr);
+    BOOST_CHECK_EQUAL(pipeline.GetStats().nReady, 0U);
+
+    pipeline.Stop();
+    BOOST_CHECK_EQUAL(pipeline.GetStats().nDepth, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
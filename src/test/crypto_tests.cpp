@@ -4,6 +4,7 @@
 
 #include <crypto/aes.h>
 #include <crypto/chacha20.h>
+#include <crypto/muhash.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
@@ -562,4 +563,51 @@ BOOST_AUTO_TEST_CASE(sha256d64)
     }
 }
 
+static std::string MuHashHex(MuHash3072 muhash)
+{
+    unsigned char out[32];
+    muhash.Finalize(out);
+    return HexStr(out, out + sizeof(out));
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    const unsigned char data[3][1] = {{0}, {1}, {2}};
+
+    // Test vectors computed with a straightforward Python implementation
+    BOOST_CHECK_EQUAL(MuHashHex(MuHash3072()), "c85525462fdcf30a2c18d6f4b92923000974355c2477f59594d2c205a1d25add");
+    MuHash3072 acc;
+    acc.Insert(data[0], 1).Insert(data[1], 1).Remove(data[2], 1);
+    BOOST_CHECK_EQUAL(MuHashHex(acc), "2a1d8be8d020123442b9d377c399f5739231c4c03436c6e8c16b6f77b84de6fc");
+
+    // The order of insertions doesn't matter, and a removal undoes an
+    // insertion.
+    MuHash3072 other;
+    other.Remove(data[2], 1).Insert(data[1], 1).Insert(data[2], 1).Insert(data[0], 1).Remove(data[2], 1);
+    BOOST_CHECK_EQUAL(MuHashHex(other), MuHashHex(acc));
+    MuHash3072 empty;
+    empty.Insert(data[1], 1).Remove(data[1], 1);
+    BOOST_CHECK_EQUAL(MuHashHex(empty), MuHashHex(MuHash3072()));
+
+    // Sets can be combined.
+    MuHash3072 first, second;
+    first.Insert(data[0], 1);
+    second.Insert(data[1], 1).Remove(data[2], 1);
+    first *= second;
+    BOOST_CHECK_EQUAL(MuHashHex(first), MuHashHex(acc));
+
+    // Serialization keeps pending removals.
+    for (int i = 0; i < 10; i++) {
+        unsigned char element[32];
+        GetRandBytes(element, sizeof(element));
+        other.Insert(element, sizeof(element));
+        acc.Insert(element, sizeof(element));
+    }
+    unsigned char serialized[MuHash3072::SERIALIZED_SIZE];
+    other.ToBytes(serialized);
+    MuHash3072 deserialized;
+    deserialized.FromBytes(serialized);
+    BOOST_CHECK_EQUAL(MuHashHex(deserialized), MuHashHex(acc));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -42,6 +42,29 @@ BOOST_AUTO_TEST_CASE(dbwrapper)
     }
 }
 
+// Test that obfuscated data can be read back after reopening the database
+BOOST_AUTO_TEST_CASE(dbwrapper_reopen_obfuscated)
+{
+    fs::path ph = SetDataDir(std::string("dbwrapper_reopen_obfuscated"));
+    uint256 in = InsecureRand256();
+    std::vector<unsigned char> key;
+    {
+        CDBWrapper dbw(ph, (1 << 20), false, true, true);
+        key = dbwrapper_private::GetObfuscateKey(dbw);
+        BOOST_CHECK(dbw.Write('k', in));
+    }
+    CDBWrapper dbw(ph, (1 << 20), false, false, true);
+    BOOST_CHECK(dbwrapper_private::GetObfuscateKey(dbw) == key);
+    uint256 res;
+    BOOST_CHECK(dbw.Read('k', res));
+    BOOST_CHECK_EQUAL(res.ToString(), in.ToString());
+    std::unique_ptr<CDBIterator> it(dbw.NewIterator());
+    it->Seek('k');
+    BOOST_CHECK(it->Valid());
+    BOOST_CHECK(it->GetValue(res));
+    BOOST_CHECK_EQUAL(res.ToString(), in.ToString());
+}
+
 // Test batch operations
 BOOST_AUTO_TEST_CASE(dbwrapper_batch)
 {
@@ -0,0 +1,87 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <headercache.h>
+
+#include <auxpow.h>
+#include <primitives/block.h>
+
+#include <test/test_worldcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(headercache_tests, BasicTestingSetup)
+
+static CBlockHeader MakeAuxpowHeader(uint32_t nonce)
+{
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashPrevBlock = InsecureRand256();
+    header.nTime = 1500000000 + nonce;
+    header.nNonce = nonce;
+    CAuxPow::initAuxPow(header);
+    return header;
+}
+
+BOOST_AUTO_TEST_CASE(headercache_lookup)
+{
+    CAuxpowHeaderCache cache(1 << 20);
+    CBlockHeader header = MakeAuxpowHeader(1);
+    CBlockHeader result;
+
+    BOOST_CHECK(!cache.Get(header.GetHash(), result));
+    cache.Insert(header);
+    BOOST_CHECK(cache.Get(header.GetHash(), result));
+    BOOST_CHECK(result.GetHash() == header.GetHash());
+    BOOST_CHECK(result.auxpow);
+    BOOST_CHECK(result.auxpow->getParentBlock().GetHash() == header.auxpow->getParentBlock().GetHash());
+
+    // Headers without auxpow are not worth caching.
+    CBlockHeader plain;
+    plain.nVersion = 2;
+    plain.nNonce = 2;
+    cache.Insert(plain);
+    BOOST_CHECK(!cache.Get(plain.GetHash(), result));
+
+    const CAuxpowHeaderCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 1U);
+    BOOST_CHECK_EQUAL(stats.nHits, 1U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 2U);
+    BOOST_CHECK(stats.nUsage > 0);
+
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.GetStats().nUsage, 0U);
+    BOOST_CHECK(!cache.Get(header.GetHash(), result));
+}
+
+BOOST_AUTO_TEST_CASE(headercache_eviction)
+{
+    std::vector<CBlockHeader> headers;
+    for (uint32_t i = 0; i < 20; i++) {
+        headers.push_back(MakeAuxpowHeader(i));
+    }
+
+    // Size the cache for about ten entries.
+    CAuxpowHeaderCache probe(1 << 20);
+    probe.Insert(headers[0]);
+    const size_t nEntryUsage = probe.GetStats().nUsage;
+    CAuxpowHeaderCache cache(nEntryUsage * 10);
+
+    CBlockHeader result;
+    for (const CBlockHeader& header : headers) {
+        cache.Insert(header);
+        // Keep the first header recently used so it survives eviction.
+        BOOST_CHECK(cache.Get(headers[0].GetHash(), result));
+        BOOST_CHECK(cache.GetStats().nUsage <= nEntryUsage * 10);
+    }
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 10U);
+    BOOST_CHECK(cache.Get(headers[0].GetHash(), result));
+    BOOST_CHECK(!cache.Get(headers[1].GetHash(), result));
+    BOOST_CHECK(cache.Get(headers[19].GetHash(), result));
+
+    cache.SetMaxUsage(nEntryUsage * 2);
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
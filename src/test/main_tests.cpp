@@ -3,6 +3,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <chainparams.h>
+#include <consensus/merkle.h>
+#include <consensus/validation.h>
 #include <validation.h>
 #include <net.h>
 
@@ -78,4 +80,68 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+
+//! A block of nTx transactions spending distinct made-up outputs
+static CBlock MakeCheckBlock(unsigned int nTx, const CScript& scriptPubKey)
+{
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << OP_0 << OP_0;
+    coinbase.vout.emplace_back(50 * COIN, scriptPubKey);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    for (unsigned int i = 1; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+        tx.vout.emplace_back(COIN, scriptPubKey);
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    return block;
+}
+
+//! Run the context-free checks on block (with a correct merkle root)
+static std::string CheckBlockResult(CBlock& block)
+{
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    block.fChecked = false;
+    CValidationState state;
+    if (CheckBlock(block, state, Params().GetConsensus(), false, true))
+        return "";
+    return state.GetRejectReason();
+}
+
+BOOST_AUTO_TEST_CASE(checkblock_parallel_first_failure)
+{
+    // Large enough for CheckBlock() to use the tx check queue.
+    CBlock block = MakeCheckBlock(200, CScript() << OP_TRUE);
+    BOOST_CHECK_EQUAL(CheckBlockResult(block), "");
+
+    // Whichever thread gets to them first, the failure of the earliest
+    // transaction is the one reported.
+    CMutableTransaction dup(*block.vtx[150]);
+    dup.vin.push_back(dup.vin[0]);
+    block.vtx[150] = MakeTransactionRef(dup);
+    CMutableTransaction negative(*block.vtx[40]);
+    negative.vout[0].nValue = -1;
+    block.vtx[40] = MakeTransactionRef(negative);
+    BOOST_CHECK_EQUAL(CheckBlockResult(block), "bad-txns-vout-negative");
+    block.vtx[40] = MakeCheckBlock(2, CScript() << OP_TRUE).vtx[1];
+    BOOST_CHECK_EQUAL(CheckBlockResult(block), "bad-txns-inputs-duplicate");
+
+    // Merkle root and size failures still come before transaction failures.
+    block.hashMerkleRoot = uint256();
+    CValidationState state;
+    BOOST_CHECK(!CheckBlock(block, state, Params().GetConsensus(), false, true));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txnmrklroot");
+
+    // Legacy sigops are summed over all transactions.
+    CScript manySigOps;
+    for (int i = 0; i < 101; i++)
+        manySigOps << OP_CHECKSIG;
+    block = MakeCheckBlock(200, manySigOps);
+    BOOST_CHECK_EQUAL(CheckBlockResult(block), "bad-blk-sigops");
+    block.vtx.resize(198);
+    BOOST_CHECK_EQUAL(CheckBlockResult(block), "");
+}
 BOOST_AUTO_TEST_SUITE_END()
@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <miner.h>
 #include <policy/policy.h>
 #include <txmempool.h>
 #include <util.h>
@@ -749,4 +750,98 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 6ULL);
 }
 
+/** Bring the block order of pool up to date, and check it is the one computed anew */
+static bool CheckBlockOrder(CTxMemPool& pool)
+{
+    LOCK(pool.cs);
+    std::vector<CTxMemPool::BlockOrderPackage> vOrder;
+    const bool fUpdated = UpdateBlockOrder(pool, vOrder);
+    const std::vector<CTxMemPool::BlockOrderPackage> vExpected = ComputeBlockOrder(pool);
+    BOOST_REQUIRE_EQUAL(vOrder.size(), vExpected.size());
+    for (size_t i = 0; i < vOrder.size(); i++) {
+        BOOST_CHECK(vOrder[i].vTx == vExpected[i].vTx);
+        BOOST_CHECK_EQUAL(vOrder[i].nSize, vExpected[i].nSize);
+        BOOST_CHECK_EQUAL(vOrder[i].nModFees, vExpected[i].nModFees);
+        BOOST_CHECK_EQUAL(vOrder[i].nSigOpCost, vExpected[i].nSigOpCost);
+    }
+    pool.SetBlockOrder(std::move(vOrder));
+    return fUpdated;
+}
+
+BOOST_AUTO_TEST_CASE(MempoolBlockOrderTest)
+{
+    CTxMemPool pool;
+    LOCK(pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // [low].0 <- [high], and some transactions without parents
+    CTransactionRef low = make_tx({10 * COIN});
+    CTransactionRef high = make_tx({9 * COIN}, {low});
+    pool.addUnchecked(low->GetHash(), entry.Fee(1000LL).FromTx(low));
+    pool.addUnchecked(high->GetHash(), entry.Fee(100000LL).FromTx(high));
+    for (int i = 0; i < 10; i++) {
+        CTransactionRef tx = make_tx({i * COIN + 1});
+        pool.addUnchecked(tx->GetHash(), entry.Fee(1000LL * (i + 1)).FromTx(tx));
+    }
+
+    // Computed the first time, then kept.
+    BOOST_CHECK(!CheckBlockOrder(pool));
+    BOOST_CHECK(CheckBlockOrder(pool));
+    {
+        LOCK(pool.cs);
+        std::vector<CTxMemPool::BlockOrderPackage> vOrder = ComputeBlockOrder(pool);
+        BOOST_CHECK_EQUAL(vOrder.size(), 11U);
+        BOOST_CHECK(vOrder[0].vTx.size() == 2 && vOrder[0].vTx[0]->GetTx().GetHash() == low->GetHash());
+    }
+
+    // New transactions without parents, and a child taken after its parent,
+    // are merged in.
+    for (int i = 0; i < 10; i++) {
+        CTransactionRef tx = make_tx({i * COIN + 2});
+        pool.addUnchecked(tx->GetHash(), entry.Fee(1500LL * (i + 1)).FromTx(tx));
+    }
+    CTransactionRef child = make_tx({8 * COIN}, {high});
+    pool.addUnchecked(child->GetHash(), entry.Fee(100LL).FromTx(child));
+    BOOST_CHECK(CheckBlockOrder(pool));
+
+    // A child that would bring its parent forward is not.
+    CTransactionRef parent = make_tx({7 * COIN});
+    pool.addUnchecked(parent->GetHash(), entry.Fee(10LL).FromTx(parent));
+    BOOST_CHECK(CheckBlockOrder(pool));
+    CTransactionRef cpfp = make_tx({6 * COIN}, {parent});
+    pool.addUnchecked(cpfp->GetHash(), entry.Fee(1000000LL).FromTx(cpfp));
+    BOOST_CHECK(!CheckBlockOrder(pool));
+
+    // Nor are fee deltas and removals.
+    pool.PrioritiseTransaction(low->GetHash(), 5000);
+    BOOST_CHECK(!CheckBlockOrder(pool));
+    pool.removeRecursive(*cpfp);
+    BOOST_CHECK(!CheckBlockOrder(pool));
+
+    // Random additions, merged or not, always give the order computed anew.
+    std::vector<std::pair<CTransactionRef, uint32_t>> vOutputs;
+    int nUpdated = 0;
+    for (int i = 0; i < 400; i++) {
+        std::vector<CTransactionRef> vInputs;
+        std::vector<uint32_t> vIndices;
+        if (!vOutputs.empty() && InsecureRandBool()) {
+            const size_t nInputs = 1 + InsecureRandRange(std::min<size_t>(2, vOutputs.size()));
+            for (size_t j = 0; j < nInputs; j++) {
+                const size_t k = InsecureRandRange(vOutputs.size());
+                vInputs.push_back(vOutputs[k].first);
+                vIndices.push_back(vOutputs[k].second);
+                vOutputs.erase(vOutputs.begin() + k);
+            }
+        }
+        std::vector<CAmount> vValues(1 + InsecureRandRange(3), COIN + i);
+        CTransactionRef tx = make_tx(std::move(vValues), std::move(vInputs), std::move(vIndices));
+        pool.addUnchecked(tx->GetHash(), entry.Fee(100 + InsecureRandRange(100000)).FromTx(tx));
+        for (uint32_t n = 0; n < tx->vout.size(); n++)
+            vOutputs.emplace_back(tx, n);
+        if (InsecureRandRange(10) == 0)
+            nUpdated += CheckBlockOrder(pool);
+    }
+    BOOST_CHECK(nUpdated > 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
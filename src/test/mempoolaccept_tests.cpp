@@ -0,0 +1,203 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <clientversion.h>
+#include <consensus/validation.h>
+#include <fs.h>
+#include <key.h>
+#include <mempoolaccept.h>
+#include <script/interpreter.h>
+#include <script/standard.h>
+#include <streams.h>
+#include <test/test_worldcoin.h>
+#include <txmempool.h>
+#include <util.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mempoolaccept_tests, TestingSetup)
+
+static const CAmount COIN_VALUE = COIN;
+
+//! Add a made-up confirmed output paying to key
+static COutPoint AddCoin(const CKey& key)
+{
+    const COutPoint outpoint(InsecureRand256(), 0);
+    LOCK(cs_main);
+    pcoinsTip->AddCoin(outpoint, Coin(CTxOut(COIN_VALUE, GetScriptForDestination(key.GetPubKey().GetID())), 0, false), false);
+    return outpoint;
+}
+
+//! A transaction spending outpoint, worth nValue and paying to key, back to key
+static CTransactionRef Spend(const CKey& key, const COutPoint& outpoint, CAmount nValue, bool fBadSig = false)
+{
+    const CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    CMutableTransaction tx;
+    tx.vin.emplace_back(outpoint);
+    tx.vout.emplace_back(nValue - 10000, scriptPubKey);
+
+    const uint256 hash = fBadSig ? InsecureRand256() : SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, nValue, SigVersion::BASE);
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig << ToByteVector(key.GetPubKey());
+    return MakeTransactionRef(tx);
+}
+
+static bool Accept(CMempoolAcceptPipeline& pipeline, const CMempoolAcceptJob& job, CValidationState& state, bool* pfMissingInputs = nullptr)
+{
+    pipeline.Wait(job);
+    LOCK(cs_main);
+    return pipeline.Accept(job, state, pfMissingInputs, nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(pipeline_verifies_independent_transactions)
+{
+    CKey key;
+    key.MakeNewKey(true);
+
+    CMempoolAcceptPipeline pipeline(mempool);
+    pipeline.Start(2);
+
+    std::vector<std::shared_ptr<CMempoolAcceptJob>> vJobs;
+    for (int i = 0; i < 20; i++)
+        vJobs.push_back(pipeline.Submit(Spend(key, AddCoin(key), COIN_VALUE)));
+    for (const auto& job : vJobs) {
+        CValidationState state;
+        BOOST_CHECK(Accept(pipeline, *job, state));
+        BOOST_CHECK(job->GetState() == CMempoolAcceptJob::VERIFIED);
+        BOOST_CHECK(mempool.exists(job->tx->GetHash()));
+    }
+
+    // A bad signature fails on the pipeline, and is still rejected by
+    // AcceptToMemoryPool() for the right reason.
+    const auto bad = pipeline.Submit(Spend(key, AddCoin(key), COIN_VALUE, true));
+    CValidationState state;
+    BOOST_CHECK(!Accept(pipeline, *bad, state));
+    BOOST_CHECK(bad->GetState() == CMempoolAcceptJob::FAILED);
+    BOOST_CHECK_EQUAL(state.GetRejectReason().substr(0, 35), "mandatory-script-verify-flag-failed");
+    BOOST_CHECK(!mempool.exists(bad->tx->GetHash()));
+
+    const MempoolAcceptPipelineStats stats = pipeline.GetStats();
+    BOOST_CHECK_EQUAL(stats.nThreads, 2);
+    BOOST_CHECK_EQUAL(stats.nSubmitted, 21U);
+    BOOST_CHECK_EQUAL(stats.nVerified, 20U);
+    BOOST_CHECK_EQUAL(stats.nFailed, 1U);
+    BOOST_CHECK_EQUAL(stats.nSkipped, 0U);
+    BOOST_CHECK_EQUAL(stats.nHits, 20U);
+
+    pipeline.Stop();
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(pipeline_skips_conflicts_and_orphans)
+{
+    CKey key;
+    key.MakeNewKey(true);
+
+    CMempoolAcceptPipeline pipeline(mempool);
+    pipeline.Start(2);
+
+    const COutPoint outpoint = AddCoin(key);
+    const CTransactionRef parent = Spend(key, outpoint, COIN_VALUE);
+    const auto job = pipeline.Submit(parent);
+    CValidationState state;
+    BOOST_CHECK(Accept(pipeline, *job, state));
+
+    // A double spend of a mempool transaction's input is left to
+    // AcceptToMemoryPool(), which rejects it.
+    const auto conflict = pipeline.Submit(Spend(key, outpoint, COIN_VALUE - 1000));
+    BOOST_CHECK(conflict->GetState() == CMempoolAcceptJob::SKIPPED);
+    BOOST_CHECK(!Accept(pipeline, *conflict, state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "txn-mempool-conflict");
+
+    // So is one we already have, without even looking at it.
+    const auto known = pipeline.Submit(parent, nullptr, false /* fVerify */);
+    BOOST_CHECK(known->GetState() == CMempoolAcceptJob::SKIPPED);
+
+    // What AcceptToMemoryPool() rejects before it gets to the scripts, like
+    // a transaction paying out more than it spends, fails without reaching
+    // the workers.
+    const auto overspend = pipeline.Submit(Spend(key, AddCoin(key), COIN_VALUE + 20000));
+    BOOST_CHECK(overspend->GetState() == CMempoolAcceptJob::FAILED);
+    CValidationState overspendState;
+    BOOST_CHECK(!Accept(pipeline, *overspend, overspendState));
+    BOOST_CHECK_EQUAL(overspendState.GetRejectReason(), "bad-txns-in-belowout");
+
+    // Inputs from the mempool are part of the snapshot.
+    const CTransactionRef child = Spend(key, COutPoint(parent->GetHash(), 0), parent->vout[0].nValue);
+    const auto childJob = pipeline.Submit(child);
+    BOOST_CHECK(Accept(pipeline, *childJob, state));
+    BOOST_CHECK(childJob->GetState() == CMempoolAcceptJob::VERIFIED);
+
+    // A transaction whose inputs are missing is not verified ahead.
+    const CTransactionRef grandchild = Spend(key, COutPoint(child->GetHash(), 0), child->vout[0].nValue);
+    const CTransactionRef orphan = Spend(key, COutPoint(grandchild->GetHash(), 0), grandchild->vout[0].nValue);
+    const auto orphanJob = pipeline.Submit(orphan);
+    BOOST_CHECK(orphanJob->GetState() == CMempoolAcceptJob::SKIPPED);
+    bool fMissingInputs = false;
+    BOOST_CHECK(!Accept(pipeline, *orphanJob, state, &fMissingInputs));
+    BOOST_CHECK(fMissingInputs);
+
+    // Once the parent is there, it is accepted the slow way.
+    BOOST_CHECK(Accept(pipeline, *pipeline.Submit(grandchild), state));
+    BOOST_CHECK(Accept(pipeline, *orphanJob, state));
+    BOOST_CHECK(mempool.exists(orphan->GetHash()));
+
+    // Without worker threads, nothing is verified ahead.
+    pipeline.Stop();
+    const auto stopped = pipeline.Submit(Spend(key, AddCoin(key), COIN_VALUE));
+    BOOST_CHECK(stopped->GetState() == CMempoolAcceptJob::SKIPPED);
+    BOOST_CHECK(Accept(pipeline, *stopped, state));
+
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(load_mempool_out_of_order)
+{
+    CKey key;
+    key.MakeNewKey(true);
+
+    const CTransactionRef parent = Spend(key, AddCoin(key), COIN_VALUE);
+    const CTransactionRef child = Spend(key, COutPoint(parent->GetHash(), 0), parent->vout[0].nValue);
+    const CTransactionRef grandchild = Spend(key, COutPoint(child->GetHash(), 0), child->vout[0].nValue);
+    const CTransactionRef independent = Spend(key, AddCoin(key), COIN_VALUE);
+    const CTransactionRef bad = Spend(key, AddCoin(key), COIN_VALUE, true);
+    const CTransactionRef expired = Spend(key, AddCoin(key), COIN_VALUE);
+
+    // Children before their parents, which DumpMempool() never writes.
+    {
+        CAutoFile file(fsbridge::fopen(GetDataDir() / "mempool.dat", "wb"), SER_DISK, CLIENT_VERSION);
+        file << (uint64_t)1 << (uint64_t)6;
+        const int64_t nNow = GetTime();
+        for (const CTransactionRef& tx : {grandchild, child, bad, independent, parent}) {
+            file << *tx << nNow << (int64_t)0;
+        }
+        file << *expired << (int64_t)0 << (int64_t)0;
+        std::map<uint256, CAmount> mapDeltas;
+        mapDeltas[independent->GetHash()] = 5000;
+        file << mapDeltas;
+    }
+
+    mempool.clear();
+    BOOST_CHECK(LoadMempool());
+
+    BOOST_CHECK_EQUAL(mempool.size(), 4U);
+    BOOST_CHECK(!mempool.exists(bad->GetHash()));
+    BOOST_CHECK(!mempool.exists(expired->GetHash()));
+    {
+        LOCK(mempool.cs);
+        const auto it = mempool.mapTx.find(grandchild->GetHash());
+        BOOST_CHECK(it != mempool.mapTx.end());
+        BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), 3U);
+        BOOST_CHECK_EQUAL(mempool.mapTx.find(parent->GetHash())->GetCountWithDescendants(), 3U);
+        BOOST_CHECK_EQUAL(mempool.mapTx.find(independent->GetHash())->GetModifiedFee(), 10000 + 5000);
+    }
+
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,11 +2,13 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <auxpow.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <pow.h>
 #include <random.h>
 #include <util.h>
+#include <worldcoin.h>
 #include <test/test_worldcoin.h>
 
 #include <boost/test/unit_test.hpp>
@@ -87,4 +89,94 @@ BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
     }
 }
 
+/* Append random blocks to blocks[from..], building on pprev; timestamps may go backwards */
+static void BuildLwmaChain(std::vector<CBlockIndex>& blocks, std::vector<uint256>& hashes, size_t from, CBlockIndex* pprev)
+{
+    for (size_t i = from; i < blocks.size(); i++) {
+        CBlockIndex& block = blocks[i];
+        hashes[i] = InsecureRand256();
+        block.phashBlock = &hashes[i];
+        block.pprev = pprev;
+        block.nHeight = pprev ? pprev->nHeight + 1 : 0;
+        const int64_t nDelta = InsecureRandRange(20) ? (int64_t)InsecureRandRange(240) - 60 : -600;
+        block.nTime = pprev ? pprev->nTime + nDelta : 1500000000;
+        block.nBits = ((0x1b + InsecureRandRange(3)) << 24) | (InsecureRand32() & 0x7fffff) | 0x8000;
+        block.BuildSkip();
+        pprev = &block;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(lwma_cached_window)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    Consensus::Params params = chainParams->GetConsensus();
+
+    for (int64_t N : {17, 120}) {
+        params.lwmaAveragingWindow = N;
+
+        std::vector<CBlockIndex> chain(600);
+        std::vector<uint256> chainHashes(chain.size());
+        BuildLwmaChain(chain, chainHashes, 0, nullptr);
+        // A competing branch forking off somewhere in the second half.
+        std::vector<CBlockIndex> fork(150);
+        std::vector<uint256> forkHashes(fork.size());
+        BuildLwmaChain(fork, forkHashes, 0, &chain[300 + InsecureRandRange(200)]);
+
+        // Follow the main chain, reorg to the fork, then back.
+        for (size_t i = 0; i < 500; i++)
+            BOOST_CHECK_EQUAL(Lwma3CalculateNextWorkRequiredCached(&chain[i], params), Lwma3CalculateNextWorkRequired(&chain[i], params));
+        for (size_t i = 0; i < fork.size(); i++)
+            BOOST_CHECK_EQUAL(Lwma3CalculateNextWorkRequiredCached(&fork[i], params), Lwma3CalculateNextWorkRequired(&fork[i], params));
+        for (size_t i = 500; i < chain.size(); i++)
+            BOOST_CHECK_EQUAL(Lwma3CalculateNextWorkRequiredCached(&chain[i], params), Lwma3CalculateNextWorkRequired(&chain[i], params));
+        // Disconnects and random lookups.
+        for (size_t i = chain.size() - 1; i > chain.size() - 20; i--)
+            BOOST_CHECK_EQUAL(Lwma3CalculateNextWorkRequiredCached(&chain[i], params), Lwma3CalculateNextWorkRequired(&chain[i], params));
+        for (int j = 0; j < 100; j++) {
+            const CBlockIndex* pindex = &chain[InsecureRandRange(chain.size())];
+            BOOST_CHECK_EQUAL(Lwma3CalculateNextWorkRequiredCached(pindex, params), Lwma3CalculateNextWorkRequired(pindex, params));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CheckAuxPowProofOfWorkMulti_test)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    Consensus::Params params = chainParams->GetConsensus();
+    // An easy target, so that about half of the random headers pass.
+    params.powLimit = uint256S("7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+
+    std::vector<CBlockHeader> headers(37);
+    for (size_t i = 0; i < headers.size(); i++) {
+        CBlockHeader& header = headers[i];
+        header.nVersion = 1;
+        header.hashPrevBlock = InsecureRand256();
+        header.hashMerkleRoot = InsecureRand256();
+        header.nTime = InsecureRand32();
+        header.nBits = 0x207fffff;
+        header.nNonce = InsecureRand32();
+    }
+    // Merge-mined headers, with a random parent block nonce.
+    for (size_t i = 20; i < 30; i++) {
+        headers[i].SetBaseVersion(4, params.nAuxpowChainId);
+        CAuxPow::initAuxPow(headers[i]).nNonce = InsecureRand32();
+    }
+    // Claims auxpow without carrying one.
+    headers[5].SetBaseVersion(4, params.nAuxpowChainId);
+    headers[5].SetAuxpowFlag(true);
+    // Target above the limit.
+    headers[9].nBits = 0x2100ffff;
+
+    std::vector<const CBlockHeader*> vpheaders;
+    for (const CBlockHeader& header : headers)
+        vpheaders.push_back(&header);
+    std::vector<bool> vValid;
+    CheckAuxPowProofOfWorkMulti(vpheaders, params, vValid);
+    BOOST_CHECK_EQUAL(vValid.size(), headers.size());
+    for (size_t i = 0; i < headers.size(); i++)
+        BOOST_CHECK_EQUAL(vValid[i], CheckAuxPowProofOfWork(headers[i], params));
+    BOOST_CHECK(!vValid[5]);
+    BOOST_CHECK(!vValid[9]);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
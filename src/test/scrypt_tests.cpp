@@ -1,11 +1,14 @@
 #include <boost/test/unit_test.hpp>
 
 #include "crypto/scrypt.h"
+#include "test/test_worldcoin.h"
 #include "uint256.h"
 #include "util.h"
 #include "utilstrencodings.h"
 
-BOOST_AUTO_TEST_SUITE(scrypt_tests)
+#include <thread>
+
+BOOST_FIXTURE_TEST_SUITE(scrypt_tests, BasicTestingSetup)
 
 BOOST_AUTO_TEST_CASE(scrypt_hashtest)
 {
@@ -32,4 +35,61 @@ BOOST_AUTO_TEST_CASE(scrypt_hashtest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(scrypt_multi_hashtest)
+{
+    // Enough headers to run every multi-lane kernel plus a one-at-a-time remainder
+    static const size_t COUNT = 16 + 8 + 1;
+    std::vector<unsigned char> input;
+    std::vector<uint256> expected;
+    char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
+    for (size_t i = 0; i < COUNT; i++) {
+        std::vector<unsigned char> header(80);
+        for (size_t j = 0; j < header.size(); j++) {
+            header[j] = InsecureRandBits(8);
+        }
+        uint256 hash;
+        scrypt_1024_1_1_256_sp_generic((const char*)header.data(), BEGIN(hash), scratchpad);
+        input.insert(input.end(), header.begin(), header.end());
+        expected.push_back(hash);
+    }
+
+    for (size_t count : {(size_t)0, (size_t)1, (size_t)7, (size_t)8, (size_t)9, COUNT}) {
+        std::vector<uint256> output(count);
+        scrypt_1024_1_1_256_multi((const char*)input.data(), (char*)output.data(), count);
+        for (size_t i = 0; i < count; i++) {
+            BOOST_CHECK(output[i] == expected[i]);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_thread_scratchpad)
+{
+    std::vector<unsigned char> input(80 * 16);
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] = InsecureRandBits(8);
+    }
+    std::vector<uint256> expected(16);
+    char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
+    for (size_t i = 0; i < expected.size(); i++) {
+        scrypt_1024_1_1_256_sp_generic((const char*)&input[80 * i], BEGIN(expected[i]), scratchpad);
+    }
+
+    // Fresh threads allocate their scratchpad with and without huge pages.
+    for (bool fHugePages : {false, true}) {
+        ScryptUseHugePages(fHugePages);
+        std::vector<uint256> single(expected.size());
+        std::vector<uint256> multi(expected.size());
+        std::thread t([&] {
+            for (size_t i = 0; i < single.size(); i++) {
+                scrypt_1024_1_1_256((const char*)&input[80 * i], BEGIN(single[i]));
+            }
+            scrypt_1024_1_1_256_multi((const char*)input.data(), (char*)multi.data(), multi.size());
+        });
+        t.join();
+        BOOST_CHECK(single == expected);
+        BOOST_CHECK(multi == expected);
+    }
+    ScryptUseHugePages(false);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -123,4 +123,48 @@ BOOST_AUTO_TEST_CASE(streams_serializedata_xor)
             std::string(ds.begin(), ds.end()));
 }
 
+
+BOOST_AUTO_TEST_CASE(streams_xorbytes)
+{
+    // Word-wise and byte-wise XOR agree for all key sizes, buffer sizes and
+    // key offsets.
+    for (size_t key_size = 1; key_size <= 9; key_size++) {
+        std::vector<unsigned char> key(key_size);
+        for (unsigned char& c : key) c = InsecureRandBits(8);
+        for (size_t size = 0; size <= 40; size++) {
+            for (size_t offset = 0; offset < 2 * key_size; offset++) {
+                std::vector<unsigned char> data(size), expected(size);
+                for (size_t i = 0; i < size; i++) {
+                    data[i] = InsecureRandBits(8);
+                    expected[i] = data[i] ^ key[(offset + i) % key_size];
+                }
+                XorBytes(data.data(), data.size(), key, offset);
+                BOOST_CHECK(data == expected);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(streams_xor_reader)
+{
+    std::vector<unsigned char> key{0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0};
+    CDataStream ds(SER_DISK, 0);
+    std::vector<unsigned char> vch{1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+    uint32_t n = 0x01020304;
+    ds << uint8_t(42) << vch << n;
+    ds.Xor(key);
+
+    // Reading undoes the XOR, whatever the position in the key.
+    CXorReader reader(SER_DISK, 0, ds.data(), ds.size(), key);
+    uint8_t a;
+    std::vector<unsigned char> vchRead;
+    uint32_t nRead;
+    reader >> a >> vchRead >> nRead;
+    BOOST_CHECK_EQUAL(a, 42);
+    BOOST_CHECK(vchRead == vch);
+    BOOST_CHECK_EQUAL(nRead, n);
+    BOOST_CHECK(reader.empty());
+    BOOST_CHECK_THROW(reader >> a, std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
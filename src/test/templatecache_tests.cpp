@@ -0,0 +1,106 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <key.h>
+#include <miner.h>
+#include <script/interpreter.h>
+#include <script/standard.h>
+#include <templatecache.h>
+#include <test/test_worldcoin.h>
+#include <txmempool.h>
+#include <utiltime.h>
+#include <validation.h>
+#include <validationinterface.h>
+
+#include <boost/test/unit_test.hpp>
+
+// Blocks can't be mined here, so the cache builds on the genesis block, with
+// the clock mocked so that the node isn't in the initial block download.
+BOOST_FIXTURE_TEST_SUITE(templatecache_tests, TestingSetup)
+
+static uint256 TipHash()
+{
+    LOCK(cs_main);
+    return chainActive.Tip()->GetBlockHash();
+}
+
+BOOST_AUTO_TEST_CASE(templatecache_follows_tip_and_mempool)
+{
+    SetMockTime(Params().GenesisBlock().GetBlockTime() + 60);
+    BOOST_REQUIRE(!IsInitialBlockDownload());
+
+    CBlockTemplateCache cache;
+    RegisterValidationInterface(&cache);
+    cache.Start(0);
+
+    // Nothing is built until a template is asked for; then it can be
+    // waited for.
+    BOOST_CHECK_EQUAL(cache.GetStats().nBuilds, 0U);
+    const CScript script = CScript() << OP_2;
+    std::unique_ptr<CBlockTemplate> ptemplate = cache.Get(TipHash(), script, true);
+    BOOST_REQUIRE(ptemplate);
+    BOOST_CHECK(ptemplate->block.hashPrevBlock == TipHash());
+    BOOST_CHECK(ptemplate->block.vtx[0]->vout[0].scriptPubKey == script);
+    BOOST_CHECK_EQUAL(ptemplate->block.vtx.size(), 1U);
+
+    // A template for another tip is never handed out.
+    BOOST_CHECK(!cache.Get(InsecureRand256(), script, true));
+
+    // A tip change has the template rebuilt right away.
+    const uint64_t nBuilds = cache.GetStats().nBuilds;
+    {
+        LOCK(cs_main);
+        GetMainSignals().UpdatedBlockTip(chainActive.Tip(), chainActive.Tip(), false);
+    }
+    SyncWithValidationInterfaceQueue();
+    for (int i = 0; i < 1000 && cache.GetStats().nBuilds == nBuilds; i++)
+        MilliSleep(10);
+    BOOST_CHECK(cache.GetStats().nBuilds > nBuilds);
+
+    // A new mempool transaction, spending a made-up confirmed coin, makes it
+    // into a later template.
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    const COutPoint outpoint(InsecureRand256(), 0);
+    {
+        LOCK(cs_main);
+        pcoinsTip->AddCoin(outpoint, Coin(CTxOut(COIN, scriptPubKey), 0, false), false);
+    }
+    CMutableTransaction spend;
+    spend.vin.emplace_back(outpoint);
+    spend.vout.emplace_back(COIN - 10000, scriptPubKey);
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(key.Sign(SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, COIN, SigVersion::BASE), vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig << ToByteVector(key.GetPubKey());
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(AcceptToMemoryPool(mempool, state, MakeTransactionRef(spend), nullptr, nullptr, true, 0));
+    }
+    SyncWithValidationInterfaceQueue();
+    for (int i = 0; i < 1000 && ptemplate->block.vtx.size() == 1; i++) {
+        MilliSleep(10);
+        ptemplate = cache.Get(TipHash(), script, false);
+        BOOST_REQUIRE(ptemplate);
+    }
+    BOOST_REQUIRE_EQUAL(ptemplate->block.vtx.size(), 2U);
+    BOOST_CHECK(ptemplate->block.vtx[1]->GetHash() == spend.GetHash());
+
+    BlockTemplateCacheStats stats = cache.GetStats();
+    BOOST_CHECK(stats.hashPrevBlock == TipHash());
+    BOOST_CHECK(stats.nBuilds >= 3);
+    BOOST_CHECK_EQUAL(stats.nMisses, 1U);
+    BOOST_CHECK_EQUAL(stats.nPendingUpdates, 0U);
+
+    UnregisterValidationInterface(&cache);
+    cache.Stop();
+    mempool.clear();
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
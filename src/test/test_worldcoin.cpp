@@ -5,8 +5,10 @@
 #include <test/test_worldcoin.h>
 
 #include <chainparams.h>
+#include <coinswriter.h>
 #include <consensus/consensus.h>
 #include <consensus/validation.h>
+#include <crypto/scrypt.h>
 #include <crypto/sha256.h>
 #include <validation.h>
 #include <miner.h>
@@ -49,6 +51,7 @@ BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
     : m_path_root(fs::temp_directory_path() / "test_worldcoin" / strprintf("%lu_%i", (unsigned long)GetTime(), (int)(InsecureRandRange(1 << 30))))
 {
     SHA256AutoDetect();
+    ScryptAutoDetect();
     RandomInit();
     ECC_Start();
     SetupEnvironment();
@@ -92,7 +95,11 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         mempool.setSanityCheck(1.0);
         pblocktree.reset(new CBlockTreeDB(1 << 20, true));
         pcoinsdbview.reset(new CCoinsViewDB(1 << 23, true));
-        pcoinsTip.reset(new CCoinsViewCache(pcoinsdbview.get()));
+        pcoinswriter.reset(new CCoinsViewWriter(pcoinsdbview.get(), pblocktree.get()));
+        pcoinsTip.reset(new CCoinsViewCache(pcoinswriter.get()));
+        if (!LoadCoinsRollingStats()) {
+            throw std::runtime_error("LoadCoinsRollingStats failed.");
+        }
         if (!LoadGenesisBlock(chainparams)) {
             throw std::runtime_error("LoadGenesisBlock failed.");
         }
@@ -103,8 +110,12 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
             }
         }
         nScriptCheckThreads = 3;
-        for (int i=0; i < nScriptCheckThreads-1; i++)
+        for (int i=0; i < nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+        }
+        for (int i=0; i < std::min(nScriptCheckThreads-1, MAX_TXCHECK_THREADS); i++) {
+            threadGroup.create_thread(&ThreadTxCheck);
+        }
         g_connman = std::unique_ptr<CConnman>(new CConnman(0x1337, 0x1337)); // Deterministic randomness for tests.
         connman = g_connman.get();
         peerLogic.reset(new PeerLogicValidation(connman, scheduler, /*enable_bip61=*/true));
@@ -120,6 +131,7 @@ TestingSetup::~TestingSetup()
         peerLogic.reset();
         UnloadBlockIndex();
         pcoinsTip.reset();
+        pcoinswriter.reset();
         pcoinsdbview.reset();
         pblocktree.reset();
 }
@@ -7,9 +7,11 @@
 #define WORLDCOIN_TXDB_H
 
 #include <coins.h>
+#include <coinstats.h>
 #include <dbwrapper.h>
 #include <chain.h>
 #include <primitives/block.h>
+#include <sync.h>
 
 #include <map>
 #include <memory>
@@ -25,6 +27,10 @@ class uint256;
 static constexpr int MAX_BLOCK_COINSDB_USAGE = 10;
 //! -dbcache default (MiB)
 static const int64_t nDefaultDbCache = 450;
+//! -dbcacheretain default (percent of the in-memory UTXO cache)
+static const int DEFAULT_DB_CACHE_RETAIN = 50;
+//! max. -dbcacheretain, leaving room below the size that triggers a flush
+static const int MAX_DB_CACHE_RETAIN = 80;
 //! -dbbatchsize default (bytes)
 static const int64_t nDefaultDbBatchSize = 16 << 20;
 //! max. -dbcache (MiB)
@@ -45,6 +51,11 @@ class CCoinsViewDB final : public CCoinsView
 {
 protected:
     CDBWrapper db;
+
+    CCriticalSection cs_stats;
+    //! Statistics for the next BatchWrite() to their block, see StageRollingStats()
+    CCoinsRollingStats statsStaged GUARDED_BY(cs_stats);
+    bool fStatsStaged GUARDED_BY(cs_stats);
 public:
     explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
@@ -52,9 +63,23 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase) override;
     CCoinsViewCursor *Cursor() const override;
 
+    //! Write coins that aren't in the database yet (in key order, for speed),
+    //! marking it as in transition to hashBlock until a BatchWrite() for
+    //! hashBlock completes it
+    bool WriteCoins(const std::vector<std::pair<COutPoint, Coin>>& vCoins, const uint256& hashBlock);
+
+    //! The running UTXO set statistics stored along with the coins. They may
+    //! be for an older block than GetBestBlock() if they were not kept for a
+    //! while.
+    bool ReadRollingStats(CCoinsRollingStats& stats) const;
+    bool WriteRollingStats(const CCoinsRollingStats& stats);
+    //! Have the BatchWrite() that brings the database to stats.hashBlock write
+    //! the statistics too, in the same batch as its best block
+    void StageRollingStats(const CCoinsRollingStats& stats);
+
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
@@ -118,6 +118,9 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
     // accounted for in the state of their ancestors)
     std::set<uint256> setAlreadyIncluded(vHashesToUpdate.begin(), vHashesToUpdate.end());
 
+    // The re-added transactions may bring in descendants ahead of them.
+    InvalidateBlockOrder();
+
     // Iterate in reverse, so that whenever we are looking at a transaction
     // we are sure that all in-mempool descendants have already been processed.
     // This maximizes the benefit of the descendant cache and guarantees that
@@ -327,7 +330,7 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator) :
-    nTransactionsUpdated(0), minerPolicyEstimator(estimator)
+    nTransactionsUpdated(0), minerPolicyEstimator(estimator), fBlockOrderValid(false), nBlockOrderUsage(0)
 {
     _clear(); //lock free clear
 
@@ -409,6 +412,9 @@ void CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
 
     vTxHashes.emplace_back(tx.GetWitnessHash(), newit);
     newit->vTxHashesIdx = vTxHashes.size() - 1;
+
+    if (fBlockOrderValid)
+        vBlockOrderAdded.push_back(newit);
 }
 
 void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
@@ -433,6 +439,7 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     mapLinks.erase(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
+    InvalidateBlockOrder();
     if (minerPolicyEstimator) {minerPolicyEstimator->removeTx(hash, false);}
 }
 
@@ -594,6 +601,7 @@ void CTxMemPool::_clear()
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
+    InvalidateBlockOrder();
 }
 
 void CTxMemPool::clear()
@@ -851,6 +859,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
                 mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0));
             }
             ++nTransactionsUpdated;
+            InvalidateBlockOrder();
         }
     }
     LogPrintf("PrioritiseTransaction: %s feerate += %s\n", hash.ToString(), FormatMoney(nFeeDelta));
@@ -898,10 +907,45 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     return base->GetCoin(outpoint, coin);
 }
 
+void CTxMemPool::InvalidateBlockOrder()
+{
+    if (!fBlockOrderValid)
+        return;
+    std::vector<BlockOrderPackage>().swap(vBlockOrder);
+    std::vector<txiter>().swap(vBlockOrderAdded);
+    nBlockOrderUsage = 0;
+    fBlockOrderValid = false;
+}
+
+bool CTxMemPool::TakeBlockOrder(std::vector<BlockOrderPackage>& vOrder, std::vector<txiter>& vAdded)
+{
+    AssertLockHeld(cs);
+    if (!fBlockOrderValid)
+        return false;
+    vOrder = std::move(vBlockOrder);
+    vAdded = std::move(vBlockOrderAdded);
+    vBlockOrder.clear();
+    vBlockOrderAdded.clear();
+    nBlockOrderUsage = 0;
+    fBlockOrderValid = false;
+    return true;
+}
+
+void CTxMemPool::SetBlockOrder(std::vector<BlockOrderPackage>&& vOrder)
+{
+    AssertLockHeld(cs);
+    vBlockOrder = std::move(vOrder);
+    vBlockOrderAdded.clear();
+    nBlockOrderUsage = memusage::DynamicUsage(vBlockOrder);
+    for (const BlockOrderPackage& package : vBlockOrder)
+        nBlockOrderUsage += memusage::DynamicUsage(package.vTx);
+    fBlockOrderValid = true;
+}
+
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + memusage::DynamicUsage(vBlockOrderAdded) + nBlockOrderUsage + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
@@ -496,6 +496,18 @@ public:
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
+    /**
+     * A package of the block order: a transaction together with the ancestors
+     * it brings into a block, in an order valid within it, and their totals.
+     * The transaction is the last one.
+     */
+    struct BlockOrderPackage {
+        std::vector<txiter> vTx;
+        uint64_t nSize;
+        CAmount nModFees;
+        int64_t nSigOpCost;
+    };
+
     const setEntries & GetMemPoolParents(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
     const setEntries & GetMemPoolChildren(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
     uint64_t CalculateDescendantMaximum(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
@@ -513,6 +525,19 @@ private:
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
+    /**
+     * The packages in the order block assembly selects them, ignoring the
+     * limits of a block (see BlockAssembler). It is computed by block
+     * assembly, and kept until a change other than adding a transaction.
+     */
+    std::vector<BlockOrderPackage> vBlockOrder GUARDED_BY(cs);
+    bool fBlockOrderValid GUARDED_BY(cs);
+    //! Transactions added since vBlockOrder was computed, in order
+    std::vector<txiter> vBlockOrderAdded GUARDED_BY(cs);
+    size_t nBlockOrderUsage GUARDED_BY(cs);
+
+    void InvalidateBlockOrder() EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
 public:
@@ -565,6 +590,15 @@ public:
     void ApplyDelta(const uint256 hash, CAmount &nFeeDelta) const;
     void ClearPrioritisation(const uint256 hash);
 
+    /**
+     * Take the block order kept for block assembly, and the transactions
+     * added since it was computed. Returns false if there is none; either
+     * way, none is kept until SetBlockOrder().
+     */
+    bool TakeBlockOrder(std::vector<BlockOrderPackage>& vOrder, std::vector<txiter>& vAdded) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    //! Keep the block order of the current contents for block assembly
+    void SetBlockOrder(std::vector<BlockOrderPackage>&& vOrder) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
 public:
     /** Remove a set of transactions from the mempool.
      *  If a transaction is in this set, then all in-mempool descendants must
@@ -0,0 +1,139 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txoutset.h>
+
+#include <coins.h>
+#include <coinstats.h>
+#include <streams.h>
+#include <txdb.h>
+#include <util.h>
+
+#include <utility>
+#include <vector>
+
+#include <boost/thread/thread.hpp> // boost::this_thread::interruption_point
+
+static void WriteOutputs(CAutoFile& file, const uint256& txid, const std::vector<std::pair<uint32_t, Coin>>& outputs)
+{
+    file << txid;
+    WriteCompactSize(file, outputs.size());
+    for (const auto& output : outputs) {
+        file << VARINT(output.first);
+        file << output.second;
+    }
+}
+
+bool WriteTxOutSet(CCoinsViewCursor& cursor, unsigned int nChainTx, CAutoFile& file, CCoinsStats& stats)
+{
+    try {
+        // The number of coins is only known at the end, so the header is
+        // written again once it is.
+        CTxOutSetHeader header;
+        header.hashBlock = cursor.GetBestBlock();
+        header.nChainTx = nChainTx;
+        const long nStart = ftell(file.Get());
+        file << TXOUTSET_DUMP_VERSION << header;
+
+        stats.hashBlock = header.hashBlock;
+        stats.nChainTx = header.nChainTx;
+        CCoinsStatsHasher hasher(stats);
+        uint256 prevkey;
+        std::vector<std::pair<uint32_t, Coin>> outputs;
+        while (cursor.Valid()) {
+            if (header.nCoins % 8192 == 0)
+                boost::this_thread::interruption_point();
+            COutPoint key;
+            Coin coin;
+            if (!cursor.GetKey(key) || !cursor.GetValue(coin))
+                return error("%s: unable to read value", __func__);
+            if (!outputs.empty() && key.hash != prevkey) {
+                WriteOutputs(file, prevkey, outputs);
+                outputs.clear();
+            }
+            prevkey = key.hash;
+            outputs.emplace_back(key.n, coin);
+            hasher.Add(key, std::move(coin));
+            header.nCoins++;
+            cursor.Next();
+        }
+        if (!outputs.empty())
+            WriteOutputs(file, prevkey, outputs);
+        hasher.Finalize();
+
+        if (nStart < 0 || fseek(file.Get(), nStart, SEEK_SET) != 0)
+            return error("%s: unable to rewind file", __func__);
+        file << TXOUTSET_DUMP_VERSION << header;
+        if (fseek(file.Get(), 0, SEEK_END) != 0)
+            return error("%s: unable to seek to end of file", __func__);
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    return true;
+}
+
+bool ReadTxOutSetHeader(CAutoFile& file, CTxOutSetHeader& header)
+{
+    try {
+        uint64_t nVersion;
+        file >> nVersion;
+        if (nVersion != TXOUTSET_DUMP_VERSION)
+            return error("%s: unknown version %u", __func__, nVersion);
+        file >> header;
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    return true;
+}
+
+bool ReadTxOutSet(CAutoFile& file, const CTxOutSetHeader& header, CCoinsViewDB* pview, CCoinsStats& stats)
+{
+    stats.hashBlock = header.hashBlock;
+    stats.nChainTx = header.nChainTx;
+    CCoinsStatsHasher hasher(stats);
+    std::vector<std::pair<COutPoint, Coin>> vCoins;
+    uint64_t nCoins = 0;
+    try {
+        uint256 prevkey;
+        uint32_t nPrevOutput = 0;
+        while (nCoins < header.nCoins) {
+            boost::this_thread::interruption_point();
+            uint256 txid;
+            file >> txid;
+            // Transactions come in database order, each once.
+            if (nCoins > 0 && !(prevkey < txid))
+                return error("%s: transaction %s out of order", __func__, txid.ToString());
+            prevkey = txid;
+            const uint64_t nOutputs = ReadCompactSize(file);
+            if (nOutputs == 0 || nOutputs > header.nCoins - nCoins)
+                return error("%s: bad number of outputs for transaction %s", __func__, txid.ToString());
+            for (uint64_t i = 0; i < nOutputs; i++) {
+                COutPoint outpoint(txid, 0);
+                Coin coin;
+                file >> VARINT(outpoint.n);
+                file >> coin;
+                if (i > 0 && outpoint.n <= nPrevOutput)
+                    return error("%s: output %s out of order", __func__, outpoint.ToString());
+                nPrevOutput = outpoint.n;
+                if (coin.IsSpent())
+                    return error("%s: spent output %s", __func__, outpoint.ToString());
+                if (pview)
+                    vCoins.emplace_back(outpoint, coin);
+                hasher.Add(outpoint, std::move(coin));
+            }
+            nCoins += nOutputs;
+            if (vCoins.size() >= TXOUTSET_LOAD_CHUNK) {
+                if (!pview->WriteCoins(vCoins, header.hashBlock))
+                    return error("%s: failed to write coins", __func__);
+                vCoins.clear();
+            }
+        }
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    if (pview && !vCoins.empty() && !pview->WriteCoins(vCoins, header.hashBlock))
+        return error("%s: failed to write coins", __func__);
+    hasher.Finalize();
+    return true;
+}
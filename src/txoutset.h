@@ -0,0 +1,66 @@
+// Copyright (c) 2018 The Worldcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WORLDCOIN_TXOUTSET_H
+#define WORLDCOIN_TXOUTSET_H
+
+#include <serialize.h>
+#include <uint256.h>
+
+#include <stdint.h>
+
+class CAutoFile;
+class CCoinsViewCursor;
+class CCoinsViewDB;
+struct CCoinsStats;
+
+/** Version of the file format written by dumptxoutset */
+static const uint64_t TXOUTSET_DUMP_VERSION = 1;
+/** Number of coins handed to the database at once when loading a UTXO set */
+static const size_t TXOUTSET_LOAD_CHUNK = 65536;
+
+/**
+ * What a dumptxoutset file starts with. It is followed by the coins in
+ * database order, grouped by transaction: the txid, the number of its unspent
+ * outputs, and for each of them the output index and the Coin.
+ */
+class CTxOutSetHeader
+{
+public:
+    //! The block the UTXO set is as of
+    uint256 hashBlock;
+    //! nChainTx of that block, which a node loading the set cannot count
+    unsigned int nChainTx;
+    //! Number of unspent outputs in the file
+    uint64_t nCoins;
+
+    CTxOutSetHeader() : nChainTx(0), nCoins(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashBlock);
+        READWRITE(nChainTx);
+        READWRITE(nCoins);
+    }
+};
+
+/**
+ * Write the version, header and coins of a dumptxoutset file, with the coins
+ * from cursor, as of its best block. stats gets their statistics.
+ */
+bool WriteTxOutSet(CCoinsViewCursor& cursor, unsigned int nChainTx, CAutoFile& file, CCoinsStats& stats);
+
+/** Read the version and header of a dumptxoutset file */
+bool ReadTxOutSetHeader(CAutoFile& file, CTxOutSetHeader& header);
+
+/**
+ * Read the coins of a dumptxoutset file, following its header, into stats.
+ * If pview is given, they are also written to it, in chunks, marking it as in
+ * transition to header.hashBlock; see CCoinsViewDB::WriteCoins.
+ */
+bool ReadTxOutSet(CAutoFile& file, const CTxOutSetHeader& header, CCoinsViewDB* pview, CCoinsStats& stats);
+
+#endif // WORLDCOIN_TXOUTSET_H
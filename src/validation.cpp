@@ -11,6 +11,10 @@
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <checkqueue.h>
+#include <coinsprefetch.h>
+#include <coinstats.h>
+#include <coinswriter.h>
+#include <connectpipeline.h>
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
@@ -18,6 +22,7 @@
 #include <cuckoocache.h>
 #include <worldcoin.h>
 #include <hash.h>
+#include <headercache.h>
 #include <index/txindex.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
@@ -35,6 +40,7 @@
 #include <tinyformat.h>
 #include <txdb.h>
 #include <txmempool.h>
+#include <txoutset.h>
 #include <ui_interface.h>
 #include <undo.h>
 #include <util.h>
@@ -166,13 +172,14 @@ public:
      * If a block header hasn't already been seen, call CheckBlockHeader on it, ensure
      * that it doesn't descend from an invalid block, and then add it to mapBlockIndex.
      */
-    bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     // Block (dis)connection on a given view:
-    DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view);
+    // If pdelta is given, it collects the change to the UTXO set statistics.
+    DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, CCoinsRollingStats* pdelta = nullptr);
     bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                    CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false);
+                    CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false, CCoinsRollingStats* pdelta = nullptr);
 
     // Block disconnection on our pcoinsTip:
     bool DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool);
@@ -183,6 +190,8 @@ public:
     void ResetBlockFailureFlags(CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
+    /** Make pindexBase, whose UTXO set has just been loaded, the tip */
+    void ActivateTxOutSet(CBlockIndex* pindexBase, unsigned int nChainTx, const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     bool RewindBlockIndex(const CChainParams& params);
     bool LoadGenesisBlock(const CChainParams& chainparams);
 
@@ -232,6 +241,7 @@ bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
+int nCoinCacheRetain = DEFAULT_DB_CACHE_RETAIN;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 bool fEnableReplacement = DEFAULT_ENABLE_REPLACEMENT;
@@ -296,9 +306,16 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 std::unique_ptr<CCoinsViewDB> pcoinsdbview;
+std::unique_ptr<CCoinsViewPrefetch> pcoinsprefetch;
+std::unique_ptr<CCoinsViewWriter> pcoinswriter;
+std::unique_ptr<CConnectPipeline> g_connect_pipeline;
 std::unique_ptr<CCoinsViewCache> pcoinsTip;
 std::unique_ptr<CBlockTreeDB> pblocktree;
 
+/** Statistics of the UTXO set at the chain tip, kept up to date while fCoinsRollingStats. Protected by cs_main. */
+static CCoinsRollingStats coinsRollingStats;
+static bool fCoinsRollingStats = false;
+
 enum class FlushStateMode {
     NONE,
     IF_NEEDED,
@@ -1079,7 +1096,7 @@ static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMes
    both a block and its header.  */
 
 template<typename T>
-static bool ReadBlockOrHeader(T& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+static bool ReadBlockOrHeader(T& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPOW = true)
 {
     block.SetNull();
 
@@ -1101,7 +1118,7 @@ static bool ReadBlockOrHeader(T& block, const CDiskBlockPos& pos, const Consensu
         return true;    
     
     // Check the header
-    if (!CheckAuxPowProofOfWork(block, consensusParams))
+    if (fCheckPOW && !CheckAuxPowProofOfWork(block, consensusParams))
         return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
 
     return true;
@@ -1111,22 +1128,37 @@ template<typename T>
 static bool ReadBlockOrHeader(T& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
     CDiskBlockPos blockPos;
+    bool fPowVerified;
     {
         LOCK(cs_main);
         blockPos = pindex->GetBlockPos();
+        fPowVerified = pindex->nStatus & BLOCK_POW_VERIFIED;
     }
 
-    if (!ReadBlockOrHeader(block, blockPos, consensusParams))
+    // The (aux)PoW of data we stored ourselves was checked before it was
+    // written, and the hash comparison below ties the header to the index.
+    if (!ReadBlockOrHeader(block, blockPos, consensusParams, !fPowVerified))
         return false;
     if (block.GetHash() != pindex->GetBlockHash())
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
                 pindex->ToString(), pindex->GetBlockPos().ToString());
+
+    if (!fPowVerified) {
+        // Block index entries written before BLOCK_POW_VERIFIED existed do
+        // not carry the flag; remember the successful check now.
+        LOCK(cs_main);
+        BlockMap::iterator it = mapBlockIndex.find(pindex->GetBlockHash());
+        if (it != mapBlockIndex.end() && it->second == pindex && (it->second->nStatus & BLOCK_HAVE_DATA) && it->second->GetBlockPos() == blockPos) {
+            it->second->nStatus |= BLOCK_POW_VERIFIED;
+            setDirtyBlockIndex.insert(it->second);
+        }
+    }
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPOW)
 {
-    return ReadBlockOrHeader(block, pos, consensusParams);
+    return ReadBlockOrHeader(block, pos, consensusParams, fCheckPOW);
 }
 
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
@@ -1399,6 +1431,16 @@ int GetSpendHeight(const CCoinsViewCache& inputs)
 static CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
 static uint256 scriptExecutionCacheNonce(GetRandHash());
 
+static uint256 GetScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags)
+{
+    uint256 hashCacheEntry;
+    // We only use the first 19 bytes of nonce to avoid a second SHA
+    // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
+    static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
+    CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    return hashCacheEntry;
+}
+
 void InitScriptExecutionCache() {
     // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
     // setup_bytes creates the minimum possible cache (2 elements).
@@ -1444,11 +1486,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
             // correct (ie that the transaction hash which is in tx's prevouts
             // properly commits to the scriptPubKey in the inputs view of that
             // transaction).
-            uint256 hashCacheEntry;
-            // We only use the first 19 bytes of nonce to avoid a second SHA
-            // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
-            static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
-            CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+            const uint256 hashCacheEntry = GetScriptExecutionCacheEntry(tx, flags);
             AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
             if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
                 return true;
@@ -1506,6 +1544,93 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
     return true;
 }
 
+unsigned int GetMempoolBlockScriptFlags()
+{
+    AssertLockHeld(cs_main);
+    return GetBlockScriptFlags(chainActive.Tip(), Params().GetConsensus());
+}
+
+//! The checks of PreVerifyMempoolTransaction() that don't need the inputs
+static bool CheckLooseTransaction(const CTransaction& tx)
+{
+    CValidationState state;
+    if (!CheckTransaction(tx, state) || tx.IsCoinBase())
+        return false;
+    std::string reason;
+    return !fRequireStandard || IsStandardTx(tx, reason);
+}
+
+bool PreVerifyMempoolTransaction(const CTransaction& tx, const std::vector<Coin>& vCoins, unsigned int nBlockFlags)
+{
+    if (!CheckLooseTransaction(tx))
+        return false;
+
+    assert(vCoins.size() == tx.vin.size());
+    PrecomputedTransactionData txdata(tx);
+    // The second pass finds the signatures in the cache the first one filled.
+    for (const unsigned int flags : {STANDARD_SCRIPT_VERIFY_FLAGS, nBlockFlags}) {
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            CScriptCheck check(vCoins[i].out, tx, i, flags, true, &txdata);
+            if (!check())
+                return false;
+        }
+    }
+    return true;
+}
+
+void CachePreVerifiedTransaction(const CTransaction& tx, unsigned int nBlockFlags)
+{
+    AssertLockHeld(cs_main);
+    scriptExecutionCache.insert(GetScriptExecutionCacheEntry(tx, STANDARD_SCRIPT_VERIFY_FLAGS));
+    scriptExecutionCache.insert(GetScriptExecutionCacheEntry(tx, nBlockFlags));
+}
+
+bool PreCheckMempoolTransaction(const CTransaction& tx, const std::vector<Coin>& vCoins, const CTxMemPool& pool)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(pool.cs);
+    assert(vCoins.size() == tx.vin.size());
+
+    // The same checks, in the same order, as AcceptToMemoryPoolWorker()
+    // does before it runs the scripts.
+    if (!CheckLooseTransaction(tx))
+        return false;
+    if (::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) < MIN_STANDARD_TX_NONWITNESS_SIZE)
+        return false;
+    if (!CheckFinalTx(tx, STANDARD_LOCKTIME_VERIFY_FLAGS))
+        return false;
+
+    CCoinsView dummy;
+    CCoinsViewCache view(&dummy);
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
+        view.AddCoin(tx.vin[i].prevout, Coin(vCoins[i]), true);
+    view.SetBestBlock(pcoinsTip->GetBestBlock());
+
+    CValidationState state;
+    LockPoints lp;
+    if (!CheckSequenceLocks(tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp))
+        return false;
+    CAmount nFees = 0;
+    if (!Consensus::CheckTxInputs(tx, state, view, GetSpendHeight(view), nFees))
+        return false;
+    if (fRequireStandard && !AreInputsStandard(tx, view))
+        return false;
+    if (tx.HasWitness() && fRequireStandard && !IsWitnessStandard(tx, view))
+        return false;
+
+    const int64_t nSigOpsCost = GetTransactionSigOpCost(tx, view, STANDARD_SCRIPT_VERIFY_FLAGS);
+    if (nSigOpsCost > MAX_STANDARD_TX_SIGOPS_COST)
+        return false;
+
+    CAmount nModifiedFees = nFees;
+    pool.ApplyDelta(tx.GetHash(), nModifiedFees);
+    const int64_t nSize = GetVirtualTransactionSize(tx, nSigOpsCost);
+    const CAmount mempoolRejectFee = pool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+    if (mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee)
+        return false;
+    return nModifiedFees >= ::minRelayTxFee.GetFee(nSize);
+}
+
 namespace {
 
 bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
@@ -1622,7 +1747,7 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  When FAILED is returned, view is left in an indeterminate state. */
-DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view)
+DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, CCoinsRollingStats* pdelta)
 {
     bool fClean = true;
 
@@ -1653,6 +1778,9 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
                 if (!is_spent || tx.vout[o] != coin.out || pindex->nHeight != coin.nHeight || is_coinbase != coin.fCoinBase) {
                     fClean = false; // transaction output mismatch
                 }
+                if (is_spent && pdelta) {
+                    pdelta->Remove(out, coin);
+                }
             }
         }
 
@@ -1668,6 +1796,9 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
                 int res = ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out);
                 if (res == DISCONNECT_FAILED) return DISCONNECT_FAILED;
                 fClean = fClean && res != DISCONNECT_UNCLEAN;
+                if (pdelta) {
+                    pdelta->Add(out, view.AccessCoin(out));
+                }
             }
             // At this point, all of txundo.vprevout should have been moved out.
         }
@@ -1735,6 +1866,151 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+/**
+ * Closure representing the context-free proof-of-work check of a run of
+ * block headers from one HEADERS message. The result for each header is
+ * written to its slot in a shared array. A run with an invalid header fails,
+ * so that the check queue skips the runs not started yet: a message that
+ * will be rejected at its first bad header isn't worth hashing in full.
+ */
+class CHeaderPowCheck
+{
+private:
+    const std::vector<CBlockHeader>* pheaders;
+    std::vector<size_t> vIndex;
+    const Consensus::Params* params;
+    char* pfValid;
+
+public:
+    CHeaderPowCheck(): pheaders(nullptr), params(nullptr), pfValid(nullptr) {}
+    CHeaderPowCheck(const std::vector<CBlockHeader>& headersIn, std::vector<size_t>&& vIndexIn, const Consensus::Params& paramsIn, char* pfValidIn) :
+        pheaders(&headersIn), vIndex(std::move(vIndexIn)), params(&paramsIn), pfValid(pfValidIn) {}
+
+    bool operator()() {
+        std::vector<const CBlockHeader*> vHeaders;
+        vHeaders.reserve(vIndex.size());
+        for (size_t i : vIndex)
+            vHeaders.push_back(&(*pheaders)[i]);
+        std::vector<bool> vValid;
+        CheckAuxPowProofOfWorkMulti(vHeaders, *params, vValid);
+        bool fAllValid = true;
+        for (size_t j = 0; j < vIndex.size(); j++) {
+            pfValid[vIndex[j]] = vValid[j];
+            fAllValid = fAllValid && vValid[j];
+        }
+        return fAllValid;
+    }
+
+    void swap(CHeaderPowCheck &check) {
+        std::swap(pheaders, check.pheaders);
+        vIndex.swap(check.vIndex);
+        std::swap(params, check.params);
+        std::swap(pfValid, check.pfValid);
+    }
+};
+
+/** Number of headers hashed together by one CHeaderPowCheck; the widest scrypt kernel is 16-way. */
+static const size_t HEADER_POW_CHECK_BATCH = 16;
+
+static CCheckQueue<CHeaderPowCheck> powcheckqueue(1);
+
+void ThreadPowCheck() {
+    RenameThread("worldcoin-powchk");
+    powcheckqueue.Thread();
+}
+
+/**
+ * Check the proof of work of the not yet known headers of a HEADERS message
+ * on the check queue workers, without holding cs_main. Returns for each
+ * header whether its PoW was found valid; headers that were already known,
+ * failed, or were skipped after a failure are left to AcceptBlockHeader(),
+ * which checks them again so that rejection and DoS scoring are unchanged.
+ * Once a run fails, the workers stop taking new ones, so the hashing done
+ * for a message with bad headers is bounded by the runs already in flight.
+ */
+static std::vector<char> CheckHeadersProofOfWork(const std::vector<CBlockHeader>& headers, const Consensus::Params& params)
+{
+    std::vector<char> vValid(headers.size(), 0);
+    std::vector<size_t> vUnknown;
+    {
+        LOCK(cs_main);
+        for (size_t i = 0; i < headers.size(); i++) {
+            // The genesis block is not checked at all.
+            if (headers[i].hashPrevBlock.IsNull())
+                continue;
+            if (!mapBlockIndex.count(headers[i].GetHash()))
+                vUnknown.push_back(i);
+        }
+    }
+
+    std::vector<CHeaderPowCheck> vChecks;
+    for (size_t i = 0; i < vUnknown.size(); i += HEADER_POW_CHECK_BATCH) {
+        std::vector<size_t> vIndex(vUnknown.begin() + i, vUnknown.begin() + std::min(i + HEADER_POW_CHECK_BATCH, vUnknown.size()));
+        vChecks.emplace_back(headers, std::move(vIndex), params, vValid.data());
+    }
+
+    if (nScriptCheckThreads) {
+        CCheckQueueControl<CHeaderPowCheck> control(&powcheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+    } else {
+        for (CHeaderPowCheck& check : vChecks) {
+            if (!check())
+                break;
+        }
+    }
+    return vValid;
+}
+
+/**
+ * Closure representing the context-free checks of a run of a block's
+ * transactions: CheckTransaction() and the legacy sigop count. It only tells
+ * whether all of them passed; CheckBlock() repeats the checks one by one to
+ * report the first failure.
+ */
+class CBlockTxCheck
+{
+private:
+    const CBlock* pblock;
+    size_t nBegin;
+    size_t nEnd;
+    unsigned int* pnSigOps;
+
+public:
+    CBlockTxCheck(): pblock(nullptr), nBegin(0), nEnd(0), pnSigOps(nullptr) {}
+    CBlockTxCheck(const CBlock& blockIn, size_t nBeginIn, size_t nEndIn, unsigned int* pnSigOpsIn) :
+        pblock(&blockIn), nBegin(nBeginIn), nEnd(nEndIn), pnSigOps(pnSigOpsIn) {}
+
+    bool operator()() {
+        unsigned int nSigOps = 0;
+        for (size_t i = nBegin; i < nEnd; i++) {
+            CValidationState state;
+            if (!CheckTransaction(*pblock->vtx[i], state, true))
+                return false;
+            nSigOps += GetLegacySigOpCount(*pblock->vtx[i]);
+        }
+        *pnSigOps = nSigOps;
+        return true;
+    }
+
+    void swap(CBlockTxCheck &check) {
+        std::swap(pblock, check.pblock);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+        std::swap(pnSigOps, check.pnSigOps);
+    }
+};
+
+/** Number of transactions checked together by one CBlockTxCheck */
+static const size_t BLOCK_TX_CHECK_BATCH = 32;
+
+static CCheckQueue<CBlockTxCheck> txcheckqueue(1);
+
+void ThreadTxCheck() {
+    RenameThread("worldcoin-txchk");
+    txcheckqueue.Thread();
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -1849,7 +2125,7 @@ static int64_t nBlocksTotal = 0;
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
 bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck)
+                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck, CCoinsRollingStats* pdelta)
 {
     AssertLockHeld(cs_main);
     assert(pindex);
@@ -2096,6 +2372,20 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
             blockundo.vtxundo.push_back(CTxUndo());
         }
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
+        if (pdelta) {
+            if (i > 0) {
+                const CTxUndo& txundo = blockundo.vtxundo.back();
+                for (size_t j = 0; j < tx.vin.size(); j++) {
+                    pdelta->Remove(tx.vin[j].prevout, txundo.vprevout[j]);
+                }
+            }
+            const uint256& txid = tx.GetHash();
+            for (size_t o = 0; o < tx.vout.size(); o++) {
+                if (!tx.vout[o].scriptPubKey.IsUnspendable()) {
+                    pdelta->Add(COutPoint(txid, o), Coin(tx.vout[o], pindex->nHeight, i == 0));
+                }
+            }
+        }
     }
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
     LogPrint(BCLog::BENCH, "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs (%.2fms/blk)]\n", (unsigned)block.vtx.size(), MILLI * (nTime3 - nTime2), MILLI * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : MILLI * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * MICRO, nTimeConnect * MILLI / nBlocksTotal);
@@ -2184,7 +2474,9 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             nLastFlush = nNow;
         }
         int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
-        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+        // The coins still waiting for the writer count too; they are not
+        // freed until they are on disk.
+        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() + pcoinswriter->DynamicMemoryUsage();
         int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
         bool fCacheLarge = mode == FlushStateMode::PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
@@ -2204,26 +2496,24 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             // First make sure all block and undo data is flushed to disk.
             FlushBlockFile();
             // Then update all block file information (which may refer to block and undo files).
+            // The writer gets copies, as the originals keep changing while it writes.
             {
-                std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
+                std::vector<std::pair<int, CBlockFileInfo> > vFiles;
                 vFiles.reserve(setDirtyFileInfo.size());
                 for (std::set<int>::iterator it = setDirtyFileInfo.begin(); it != setDirtyFileInfo.end(); ) {
-                    vFiles.push_back(std::make_pair(*it, &vinfoBlockFile[*it]));
+                    vFiles.push_back(std::make_pair(*it, vinfoBlockFile[*it]));
                     setDirtyFileInfo.erase(it++);
                 }
-                std::vector<const CBlockIndex*> vBlocks;
+                std::vector<CBlockIndex> vBlocks;
                 vBlocks.reserve(setDirtyBlockIndex.size());
                 for (std::set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end(); ) {
-                    vBlocks.push_back(*it);
+                    vBlocks.push_back(**it);
                     setDirtyBlockIndex.erase(it++);
                 }
-                if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
+                if (!pcoinswriter->StageBlockIndex(std::move(vFiles), nLastBlockFile, std::move(vBlocks))) {
                     return AbortNode(state, "Failed to write to block index database");
                 }
             }
-            // Finally remove any pruned files
-            if (fFlushForPrune)
-                UnlinkPrunedFiles(setFilesToPrune);
             nLastWrite = nNow;
         }
         // Flush best chain related state. This can only be done if the blocks / block index write was also done.
@@ -2235,16 +2525,46 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             // overwrite one. Still, use a conservative safety factor of 2.
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
-            // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
+            // The UTXO set statistics are written in the same batch as the
+            // best block of the coins they describe.
+            if (fCoinsRollingStats)
+                pcoinsdbview->StageRollingStats(coinsRollingStats);
+            // Flush the chainstate (which may refer to block index entries),
+            // keeping part of the cache warm for the next blocks if allowed.
+            if (nCoinCacheRetain > 0) {
+                if (!pcoinsTip->Sync(nCoinCacheUsage / 100 * nCoinCacheRetain))
+                    return AbortNode(state, "Failed to write to coin database");
+            } else if (!pcoinsTip->Flush()) {
                 return AbortNode(state, "Failed to write to coin database");
+            }
             nLastFlush = nNow;
             full_flush_completed = true;
         }
-    }
-    if (full_flush_completed) {
-        // Update best block in wallet (so we can detect restored wallets).
-        GetMainSignals().ChainStateFlushed(chainActive.GetLocator());
+        if (fDoFullFlush || fPeriodicWrite) {
+            // Hand the staged block index and chainstate to the writer thread,
+            // and only wait for it when asked to flush everything now. Pruned
+            // files are removed, and the wallet told about the new best
+            // block, once the block index no longer refers to them.
+            std::set<int> setFilesToUnlink;
+            if (fFlushForPrune)
+                setFilesToUnlink.swap(setFilesToPrune);
+            CBlockLocator locator;
+            if (full_flush_completed)
+                locator = chainActive.GetLocator();
+            auto fnCommitted = [setFilesToUnlink, locator, full_flush_completed]() {
+                UnlinkPrunedFiles(setFilesToUnlink);
+                if (full_flush_completed) {
+                    // Update best block in wallet (so we can detect restored wallets).
+                    GetMainSignals().ChainStateFlushed(locator);
+                }
+            };
+            auto fnFailed = []() {
+                AbortNode("Failed to write chainstate to disk");
+            };
+            if (!pcoinswriter->Commit(fnCommitted, mode == FlushStateMode::ALWAYS, fnFailed)) {
+                return AbortNode(state, "Failed to write chainstate to disk");
+            }
+        }
     }
     } catch (const std::runtime_error& e) {
         return AbortNode(state, std::string("System error while flushing: ") + e.what());
@@ -2368,10 +2688,15 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
     {
         CCoinsViewCache view(pcoinsTip.get());
         assert(view.GetBestBlock() == pindexDelete->GetBlockHash());
-        if (DisconnectBlock(block, pindexDelete, view) != DISCONNECT_OK)
+        CCoinsRollingStats statsDelta;
+        if (DisconnectBlock(block, pindexDelete, view, fCoinsRollingStats ? &statsDelta : nullptr) != DISCONNECT_OK)
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         bool flushed = view.Flush();
         assert(flushed);
+        if (fCoinsRollingStats) {
+            coinsRollingStats += statsDelta;
+            coinsRollingStats.hashBlock = pindexDelete->pprev->GetBlockHash();
+        }
     }
     LogPrint(BCLog::BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * MILLI);
     // Write the chain state to disk, if necessary.
@@ -2484,10 +2809,14 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     int64_t nTime1 = GetTimeMicros();
     std::shared_ptr<const CBlock> pthisBlock;
     if (!pblock) {
-        std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
-        if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
-            return AbortNode(state, "Failed to read block");
-        pthisBlock = pblockNew;
+        if (g_connect_pipeline)
+            pthisBlock = g_connect_pipeline->Take(pindexNew->GetBlockHash());
+        if (!pthisBlock) {
+            std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
+            if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
+                return AbortNode(state, "Failed to read block");
+            pthisBlock = pblockNew;
+        }
     } else {
         pthisBlock = pblock;
     }
@@ -2498,7 +2827,8 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
     {
         CCoinsViewCache view(pcoinsTip.get());
-        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
+        CCoinsRollingStats statsDelta;
+        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams, false, fCoinsRollingStats ? &statsDelta : nullptr);
         GetMainSignals().BlockChecked(blockConnecting, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -2509,6 +2839,10 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
         LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime3 - nTime2) * MILLI, nTimeConnectTotal * MICRO, nTimeConnectTotal * MILLI / nBlocksTotal);
         bool flushed = view.Flush();
         assert(flushed);
+        if (fCoinsRollingStats) {
+            coinsRollingStats += statsDelta;
+            coinsRollingStats.hashBlock = pindexNew->GetBlockHash();
+        }
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime4 - nTime3) * MILLI, nTimeFlush * MICRO, nTimeFlush * MILLI / nBlocksTotal);
@@ -2602,6 +2936,65 @@ void CChainState::PruneBlockIndexCandidates() {
     assert(!setBlockIndexCandidates.empty());
 }
 
+void CChainState::ActivateTxOutSet(CBlockIndex* pindexBase, unsigned int nChainTx, const CChainParams& chainparams)
+{
+    AssertLockHeld(cs_main);
+
+    // The blocks up to pindexBase are never downloaded, so make them look
+    // like pruned ones. Where their number of transactions isn't known, it is
+    // made up such that pindexBase gets its real nChainTx.
+    std::vector<CBlockIndex*> vChain;
+    for (CBlockIndex* pindex = pindexBase; pindex->pprev; pindex = pindex->pprev) {
+        vChain.push_back(pindex);
+    }
+    for (auto it = vChain.rbegin(); it != vChain.rend(); ++it) {
+        CBlockIndex* pindex = *it;
+        if (pindex->nTx == 0) {
+            pindex->nTx = 1;
+            if (pindex == pindexBase && nChainTx > pindex->pprev->nChainTx)
+                pindex->nTx = nChainTx - pindex->pprev->nChainTx;
+        }
+        pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+        pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+        setDirtyBlockIndex.insert(pindex);
+        auto range = mapBlocksUnlinked.equal_range(pindex->pprev);
+        while (range.first != range.second) {
+            if (range.first->second == pindex)
+                range.first = mapBlocksUnlinked.erase(range.first);
+            else
+                range.first++;
+        }
+    }
+
+    // Link pindexBase and any descendants that have already been received,
+    // as ReceivedBlockTransactions() would.
+    std::deque<CBlockIndex*> queue;
+    queue.push_back(pindexBase);
+    while (!queue.empty()) {
+        CBlockIndex *pindex = queue.front();
+        queue.pop_front();
+        pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+        {
+            LOCK(cs_nBlockSequenceId);
+            pindex->nSequenceId = nBlockSequenceId++;
+        }
+        setBlockIndexCandidates.insert(pindex);
+        std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex);
+        while (range.first != range.second) {
+            std::multimap<CBlockIndex*, CBlockIndex*>::iterator it = range.first;
+            queue.push_back(it->second);
+            range.first++;
+            mapBlocksUnlinked.erase(it);
+        }
+    }
+
+    chainActive.SetTip(pindexBase);
+    PruneBlockIndexCandidates();
+    pblocktree->WriteFlag("prunedblockfiles", true);
+    fHavePruned = true;
+    UpdateTip(pindexBase, chainparams);
+}
+
 /**
  * Try to make some progress towards making pindexMostWork the active block.
  * pblock is either nullptr or a pointer to a CBlock corresponding to pindexMostWork.
@@ -2643,6 +3036,26 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
         }
         nHeight = nTargetHeight;
 
+        // Let the pipeline read and check the blocks we are about to connect
+        // (except one we were handed already), and the prefetcher warm up the
+        // inputs of the blocks after the first.
+        if (g_connect_pipeline) {
+            std::vector<std::pair<uint256, CDiskBlockPos>> vSchedule;
+            for (CBlockIndex *pindex : reverse_iterate(vpindexToConnect)) {
+                if ((pindex->nStatus & BLOCK_HAVE_DATA) && !(pindex == pindexMostWork && pblock))
+                    vSchedule.emplace_back(pindex->GetBlockHash(), pindex->GetBlockPos());
+            }
+            g_connect_pipeline->Schedule(vSchedule);
+        }
+        if (pcoinsprefetch && vpindexToConnect.size() > 1) {
+            std::vector<std::pair<uint256, CDiskBlockPos>> vPrefetch;
+            for (auto it = vpindexToConnect.rbegin() + 1; it != vpindexToConnect.rend(); ++it) {
+                if ((*it)->nStatus & BLOCK_HAVE_DATA)
+                    vPrefetch.emplace_back((*it)->GetBlockHash(), (*it)->GetBlockPos());
+            }
+            pcoinsprefetch->Prefetch(vPrefetch);
+        }
+
         // Connect new blocks.
         for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
             if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
@@ -2986,6 +3399,7 @@ CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block)
         pindexNew->BuildSkip();
     }
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
+    pindexNew->CacheMedianTimePast();
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
     if (pindexBestHeader == nullptr || pindexBestHeader->nChainWork < pindexNew->nChainWork)
@@ -3004,7 +3418,9 @@ void CChainState::ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pi
     pindexNew->nFile = pos.nFile;
     pindexNew->nDataPos = pos.nPos;
     pindexNew->nUndoPos = 0;
-    pindexNew->nStatus |= BLOCK_HAVE_DATA;
+    // AcceptBlock() only stores blocks that passed CheckBlock(), PoW included,
+    // and the genesis block is exempt from the PoW check on reads anyway.
+    pindexNew->nStatus |= BLOCK_HAVE_DATA | BLOCK_POW_VERIFIED;
     if (IsWitnessEnabled(pindexNew->pprev, consensusParams)) {
         pindexNew->nStatus |= BLOCK_OPT_WITNESS;
     }
@@ -3156,6 +3572,23 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
     if (!CheckBlockHeader(block, state, consensusParams, fCheckPOW))
         return false;
 
+    // Hand the transaction checks of larger blocks to the check queue now, so
+    // that they run while the merkle root is computed below. Their result is
+    // only looked at where they used to be done, and a failure is reported by
+    // doing them again in order, so the outcome is the same as if they had
+    // been done one by one.
+    const bool fParallel = nScriptCheckThreads && block.vtx.size() > BLOCK_TX_CHECK_BATCH;
+    std::vector<unsigned int> vSigOps;
+    CCheckQueueControl<CBlockTxCheck> control(fParallel ? &txcheckqueue : nullptr);
+    if (fParallel) {
+        vSigOps.resize((block.vtx.size() + BLOCK_TX_CHECK_BATCH - 1) / BLOCK_TX_CHECK_BATCH);
+        std::vector<CBlockTxCheck> vChecks;
+        vChecks.reserve(vSigOps.size());
+        for (size_t i = 0; i < vSigOps.size(); i++)
+            vChecks.emplace_back(block, i * BLOCK_TX_CHECK_BATCH, std::min((i + 1) * BLOCK_TX_CHECK_BATCH, block.vtx.size()), &vSigOps[i]);
+        control.Add(vChecks);
+    }
+
     // Check the merkle root.
     if (fCheckMerkleRoot) {
         bool mutated;
@@ -3187,16 +3620,21 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
         if (block.vtx[i]->IsCoinBase())
             return state.DoS(100, false, REJECT_INVALID, "bad-cb-multiple", false, "more than one coinbase");
 
-    // Check transactions
-    for (const auto& tx : block.vtx)
-        if (!CheckTransaction(*tx, state, true))
-            return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
-                                 strprintf("Transaction check failed (tx hash %s) %s", tx->GetHash().ToString(), state.GetDebugMessage()));
-
     unsigned int nSigOps = 0;
-    for (const auto& tx : block.vtx)
-    {
-        nSigOps += GetLegacySigOpCount(*tx);
+    if (fParallel && control.Wait()) {
+        for (unsigned int n : vSigOps)
+            nSigOps += n;
+    } else {
+        // Check transactions
+        for (const auto& tx : block.vtx)
+            if (!CheckTransaction(*tx, state, true))
+                return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
+                                     strprintf("Transaction check failed (tx hash %s) %s", tx->GetHash().ToString(), state.GetDebugMessage()));
+
+        for (const auto& tx : block.vtx)
+        {
+            nSigOps += GetLegacySigOpCount(*tx);
+        }
     }
     if (nSigOps * WITNESS_SCALE_FACTOR > MAX_BLOCK_SIGOPS_COST)
         return state.DoS(100, false, REJECT_INVALID, "bad-blk-sigops", false, "out-of-bounds SigOpCount");
@@ -3428,7 +3866,7 @@ static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, c
     return true;
 }
 
-bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3446,7 +3884,7 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3478,8 +3916,11 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
             }
         }
     }
-    if (pindex == nullptr)
+    if (pindex == nullptr) {
         pindex = AddToBlockIndex(block);
+        // Newly accepted headers are the ones peers are most likely to ask for next.
+        g_auxpow_header_cache.Insert(block);
+    }
 
     if (ppindex)
         *ppindex = pindex;
@@ -3493,11 +3934,14 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader *first_invalid)
 {
     if (first_invalid != nullptr) first_invalid->SetNull();
+    // Only the contextual checks need cs_main; verify the PoW up front.
+    const std::vector<char> vPowValid = CheckHeadersProofOfWork(headers, chainparams.GetConsensus());
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); i++) {
+            const CBlockHeader& header = headers[i];
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!g_chainstate.AcceptBlockHeader(header, state, chainparams, &pindex)) {
+            if (!g_chainstate.AcceptBlockHeader(header, state, chainparams, &pindex, !vPowValid[i])) {
                 if (first_invalid) *first_invalid = header;
                 return false;
             }
@@ -3691,7 +4135,7 @@ void PruneOneBlockFile(const int fileNumber)
     for (const auto& entry : mapBlockIndex) {
         CBlockIndex* pindex = entry.second;
         if (pindex->nFile == fileNumber) {
-            pindex->nStatus &= ~BLOCK_HAVE_DATA;
+            pindex->nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_POW_VERIFIED);
             pindex->nStatus &= ~BLOCK_HAVE_UNDO;
             pindex->nFile = 0;
             pindex->nDataPos = 0;
@@ -3920,6 +4364,7 @@ bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlo
         CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
+        pindex->CacheMedianTimePast();
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
         if (pindex->nTx > 0) {
@@ -4285,7 +4730,7 @@ bool CChainState::RewindBlockIndex(const CChainParams& params)
             // Reduce validity
             pindexIter->nStatus = std::min<unsigned int>(pindexIter->nStatus & BLOCK_VALID_MASK, BLOCK_VALID_TREE) | (pindexIter->nStatus & ~BLOCK_VALID_MASK);
             // Remove have-data flags.
-            pindexIter->nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO);
+            pindexIter->nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO | BLOCK_POW_VERIFIED);
             // Remove storage location.
             pindexIter->nFile = 0;
             pindexIter->nDataPos = 0;
@@ -4766,6 +5211,164 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
 
 static const uint64_t MEMPOOL_DUMP_VERSION = 1;
 
+/** Number of mempool.dat transactions looked up, verified and accepted together */
+static const size_t MEMPOOL_LOAD_BATCH = 1000;
+
+/**
+ * Order the transactions so that each comes after the ones it spends from,
+ * keeping the order of the file otherwise. DumpMempool() writes them sorted
+ * this way already, but the result of loading should not depend on it.
+ */
+static std::vector<size_t> SortMempoolTransactions(const std::vector<CTransactionRef>& vtx)
+{
+    std::unordered_map<uint256, size_t, SaltedTxidHasher> mapIndex;
+    for (size_t i = 0; i < vtx.size(); i++)
+        mapIndex.emplace(vtx[i]->GetHash(), i);
+
+    // Depth of each transaction in its chain of in-file parents
+    std::vector<int> vDepth(vtx.size(), -1);
+    std::vector<size_t> vStack;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        vStack.push_back(i);
+        while (!vStack.empty()) {
+            const size_t j = vStack.back();
+            if (vDepth[j] >= 0) {
+                vStack.pop_back();
+                continue;
+            }
+            int nDepth = 0;
+            bool fReady = true;
+            for (const CTxIn& txin : vtx[j]->vin) {
+                auto it = mapIndex.find(txin.prevout.hash);
+                if (it == mapIndex.end())
+                    continue;
+                if (vDepth[it->second] < 0) {
+                    vStack.push_back(it->second);
+                    fReady = false;
+                } else {
+                    nDepth = std::max(nDepth, vDepth[it->second] + 1);
+                }
+            }
+            if (fReady) {
+                vDepth[j] = nDepth;
+                vStack.pop_back();
+            }
+        }
+    }
+
+    std::vector<size_t> vOrder(vtx.size());
+    for (size_t i = 0; i < vOrder.size(); i++)
+        vOrder[i] = i;
+    std::stable_sort(vOrder.begin(), vOrder.end(), [&vDepth](size_t a, size_t b) { return vDepth[a] < vDepth[b]; });
+    return vOrder;
+}
+
+/**
+ * Verify the scripts of the transactions [nBegin, nEnd) of a mempool.dat
+ * batch on the script check queue, clearing vValid for those that fail;
+ * transactions whose vValid is not set are left out. The queue only tells
+ * whether all checks passed, so a range that fails is split in halves until
+ * the failing transactions are found. The signatures of the ones that passed
+ * are in the signature cache by then, so checking them again is cheap.
+ */
+static void VerifyMempoolBatchScripts(const std::vector<CTransactionRef>& vBatch, const std::vector<std::vector<Coin>>& vCoins,
+                                      std::vector<PrecomputedTransactionData>& vTxData, unsigned int nBlockFlags,
+                                      size_t nBegin, size_t nEnd, std::vector<char>& vValid)
+{
+    std::vector<CScriptCheck> vChecks;
+    for (size_t i = nBegin; i < nEnd; i++) {
+        if (!vValid[i])
+            continue;
+        // As in PreVerifyMempoolTransaction(), with both sets of flags that
+        // AcceptToMemoryPool() checks.
+        const CTransaction& tx = *vBatch[i];
+        for (const unsigned int flags : {STANDARD_SCRIPT_VERIFY_FLAGS, nBlockFlags}) {
+            for (unsigned int j = 0; j < tx.vin.size(); j++)
+                vChecks.emplace_back(vCoins[i][j].out, tx, j, flags, true, &vTxData[i]);
+        }
+    }
+    if (vChecks.empty())
+        return;
+
+    bool fAllValid;
+    {
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        control.Add(vChecks);
+        fAllValid = control.Wait();
+    }
+    if (fAllValid)
+        return;
+    if (nEnd - nBegin == 1) {
+        vValid[nBegin] = false;
+        return;
+    }
+    const size_t nMid = nBegin + (nEnd - nBegin) / 2;
+    VerifyMempoolBatchScripts(vBatch, vCoins, vTxData, nBlockFlags, nBegin, nMid, vValid);
+    VerifyMempoolBatchScripts(vBatch, vCoins, vTxData, nBlockFlags, nMid, nEnd, vValid);
+}
+
+/**
+ * Look up the coins spent by a batch of transactions loaded from
+ * mempool.dat under a single hold of cs_main, reading those not in the coins
+ * cache in key order. Coins created by earlier transactions of the batch are
+ * taken from them. A transaction whose inputs are not all found gets no
+ * coins. vUncache receives, for each transaction, the outpoints that were
+ * brought into the coins cache for it.
+ */
+static unsigned int LookupMempoolBatchCoins(const std::vector<CTransactionRef>& vBatch, std::vector<std::vector<Coin>>& vCoins,
+                                            std::vector<std::vector<COutPoint>>& vUncache)
+{
+    std::unordered_map<uint256, size_t, SaltedTxidHasher> mapBatch;
+    for (size_t i = 0; i < vBatch.size(); i++)
+        mapBatch.emplace(vBatch[i]->GetHash(), i);
+
+    LOCK2(cs_main, mempool.cs);
+    CCoinsViewMemPool viewMemPool(pcoinsTip.get(), mempool);
+
+    std::vector<COutPoint> vPrevouts;
+    for (const CTransactionRef& tx : vBatch) {
+        for (const CTxIn& txin : tx->vin) {
+            if (!mapBatch.count(txin.prevout.hash) && !pcoinsTip->HaveCoinInCache(txin.prevout))
+                vPrevouts.push_back(txin.prevout);
+        }
+    }
+    std::sort(vPrevouts.begin(), vPrevouts.end());
+    vPrevouts.erase(std::unique(vPrevouts.begin(), vPrevouts.end()), vPrevouts.end());
+    std::set<COutPoint> setFetched;
+    for (const COutPoint& prevout : vPrevouts) {
+        Coin coin;
+        viewMemPool.GetCoin(prevout, coin);
+        if (pcoinsTip->HaveCoinInCache(prevout))
+            setFetched.insert(prevout);
+    }
+
+    vCoins.assign(vBatch.size(), std::vector<Coin>());
+    vUncache.assign(vBatch.size(), std::vector<COutPoint>());
+    for (size_t i = 0; i < vBatch.size(); i++) {
+        std::vector<Coin>& coins = vCoins[i];
+        coins.reserve(vBatch[i]->vin.size());
+        for (const CTxIn& txin : vBatch[i]->vin) {
+            if (setFetched.count(txin.prevout))
+                vUncache[i].push_back(txin.prevout);
+            Coin coin;
+            auto it = mapBatch.find(txin.prevout.hash);
+            if (it != mapBatch.end()) {
+                const CTransaction& parent = *vBatch[it->second];
+                if (it->second < i && txin.prevout.n < parent.vout.size())
+                    coin = Coin(parent.vout[txin.prevout.n], MEMPOOL_HEIGHT, false);
+            } else {
+                viewMemPool.GetCoin(txin.prevout, coin);
+            }
+            if (coin.IsSpent()) {
+                coins.clear();
+                break;
+            }
+            coins.push_back(std::move(coin));
+        }
+    }
+    return GetMempoolBlockScriptFlags();
+}
+
 bool LoadMempool(void)
 {
     const CChainParams& chainparams = Params();
@@ -4782,7 +5385,14 @@ bool LoadMempool(void)
     int64_t failed = 0;
     int64_t already_there = 0;
     int64_t nNow = GetTime();
+    int64_t nStart = GetTimeMicros();
 
+    // Read the whole file first, so that the transactions can be looked up,
+    // verified and accepted in batches.
+    std::vector<CTransactionRef> vtx;
+    std::vector<int64_t> vTime;
+    std::map<uint256, CAmount> mapDeltas;
+    bool fComplete = true;
     try {
         uint64_t version;
         file >> version;
@@ -4803,10 +5413,72 @@ bool LoadMempool(void)
             if (amountdelta) {
                 mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
             }
-            CValidationState state;
             if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, nTime,
+                vtx.push_back(tx);
+                vTime.push_back(nTime);
+            } else {
+                ++expired;
+            }
+            if (ShutdownRequested())
+                return false;
+        }
+        file >> mapDeltas;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        // Still load the transactions read so far, as was done when they
+        // were accepted while reading.
+        fComplete = false;
+        mapDeltas.clear();
+    }
+
+    const std::vector<size_t> vOrder = SortMempoolTransactions(vtx);
+    LogPrintf("Loading %u mempool transactions from disk...\n", vOrder.size());
+    uiInterface.ShowProgress(_("Loading mempool..."), 0, false);
+    int nReportedPercent = 0;
+
+    for (size_t nBatchStart = 0; nBatchStart < vOrder.size(); nBatchStart += MEMPOOL_LOAD_BATCH) {
+        const size_t nBatchEnd = std::min(nBatchStart + MEMPOOL_LOAD_BATCH, vOrder.size());
+        std::vector<CTransactionRef> vBatch;
+        vBatch.reserve(nBatchEnd - nBatchStart);
+        for (size_t i = nBatchStart; i < nBatchEnd; i++)
+            vBatch.push_back(vtx[vOrder[i]]);
+
+        std::vector<std::vector<Coin>> vCoins;
+        std::vector<std::vector<COutPoint>> vUncache;
+        const unsigned int nBlockFlags = LookupMempoolBatchCoins(vBatch, vCoins, vUncache);
+
+        // Verify the scripts of the batch on the script check queue, which
+        // has nothing else to do while the mempool loads, without cs_main.
+        // No transaction is dropped here: AcceptToMemoryPool() checks them
+        // again below and rejects the bad ones with the usual reason.
+        std::vector<char> vValid(vBatch.size(), 0);
+        for (size_t i = 0; i < vBatch.size(); i++)
+            vValid[i] = !vCoins[i].empty() && CheckLooseTransaction(*vBatch[i]);
+        if (nScriptCheckThreads) {
+            std::vector<PrecomputedTransactionData> vTxData;
+            vTxData.reserve(vBatch.size());
+            for (const CTransactionRef& tx : vBatch)
+                vTxData.emplace_back(*tx);
+            VerifyMempoolBatchScripts(vBatch, vCoins, vTxData, nBlockFlags, 0, vBatch.size(), vValid);
+        } else {
+            for (size_t i = 0; i < vBatch.size(); i++) {
+                if (vValid[i])
+                    vValid[i] = PreVerifyMempoolTransaction(*vBatch[i], vCoins[i], nBlockFlags);
+            }
+        }
+        vCoins.clear();
+
+        // Accept the batch in order. The parents of each transaction are in
+        // the mempool before it, so adding it only updates the state of its
+        // ancestors, and never has to go back over descendants.
+        {
+            LOCK(cs_main);
+            for (size_t i = 0; i < vBatch.size(); i++) {
+                const CTransactionRef& tx = vBatch[i];
+                if (vValid[i])
+                    CachePreVerifiedTransaction(*tx, nBlockFlags);
+                CValidationState state;
+                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, vTime[vOrder[nBatchStart + i]],
                                            nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
                                            false /* test_accept */);
                 if (state.IsValid()) {
@@ -4820,27 +5492,32 @@ bool LoadMempool(void)
                         ++already_there;
                     } else {
                         ++failed;
+                        for (const COutPoint& prevout : vUncache[i])
+                            pcoinsTip->Uncache(prevout);
                     }
                 }
-            } else {
-                ++expired;
             }
-            if (ShutdownRequested())
-                return false;
         }
-        std::map<uint256, CAmount> mapDeltas;
-        file >> mapDeltas;
 
-        for (const auto& i : mapDeltas) {
-            mempool.PrioritiseTransaction(i.first, i.second);
+        const int nPercent = nBatchEnd * 100 / vOrder.size();
+        uiInterface.ShowProgress(_("Loading mempool..."), nPercent, false);
+        if (nPercent >= nReportedPercent + 10 && nBatchEnd < vOrder.size()) {
+            LogPrintf("Loading mempool: %u of %u transactions (%d%%)\n", nBatchEnd, vOrder.size(), nPercent);
+            nReportedPercent = nPercent;
+        }
+        if (ShutdownRequested()) {
+            uiInterface.ShowProgress("", 100, false);
+            return false;
         }
-    } catch (const std::exception& e) {
-        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
-        return false;
     }
+    uiInterface.ShowProgress("", 100, false);
 
-    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there\n", count, failed, expired, already_there);
-    return true;
+    for (const auto& i : mapDeltas) {
+        mempool.PrioritiseTransaction(i.first, i.second);
+    }
+
+    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there (%.2fs)\n", count, failed, expired, already_there, (GetTimeMicros() - nStart) * MICRO);
+    return fComplete;
 }
 
 bool DumpMempool(void)
@@ -4893,6 +5570,172 @@ bool DumpMempool(void)
     return true;
 }
 
+bool DumpTxOutSet(const fs::path& path, CCoinsStats& stats)
+{
+    int64_t nStart = GetTimeMicros();
+
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    unsigned int nChainTx;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        // The cursor keeps seeing the database as it is now, so the rest
+        // can be done without cs_main.
+        pcursor.reset(pcoinsdbview->Cursor());
+        const CBlockIndex* pindex = LookupBlockIndex(pcursor->GetBestBlock());
+        assert(pindex);
+        stats.nHeight = pindex->nHeight;
+        nChainTx = pindex->nChainTx;
+    }
+
+    const fs::path pathTemp = path.string() + ".incomplete";
+    FILE* filestr = fsbridge::fopen(pathTemp, "wb");
+    if (!filestr) {
+        return error("%s: unable to open %s", __func__, pathTemp.string());
+    }
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (!WriteTxOutSet(*pcursor, nChainTx, file, stats) || !FileCommit(file.Get())) {
+        file.fclose();
+        fs::remove(pathTemp);
+        return error("%s: unable to write %s", __func__, pathTemp.string());
+    }
+    file.fclose();
+    if (!RenameOver(pathTemp, path)) {
+        return error("%s: unable to rename %s", __func__, pathTemp.string());
+    }
+    LogPrintf("Dumped %u coins as of block %s to %s in %.2fs\n", stats.nTransactionOutputs, stats.hashBlock.ToString(), path.string(), (GetTimeMicros() - nStart) * MICRO);
+    return true;
+}
+
+//! Compute the statistics of the UTXO set from the flushed chainstate, and store them with it
+static bool ComputeRollingStatsAtTip() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    int64_t nStart = GetTimeMicros();
+    LogPrintf("Computing the UTXO set statistics at block %s...\n", pcoinsdbview->GetBestBlock().ToString());
+    if (!ComputeCoinsRollingStats(pcoinsdbview.get(), coinsRollingStats)) {
+        return false;
+    }
+    if (!pcoinsdbview->WriteRollingStats(coinsRollingStats)) {
+        return error("%s: unable to write the UTXO set statistics", __func__);
+    }
+    fCoinsRollingStats = true;
+    LogPrintf("Computed the statistics of %u coins in %.2fs\n", coinsRollingStats.nTransactionOutputs, (GetTimeMicros() - nStart) * MICRO);
+    return true;
+}
+
+bool LoadCoinsRollingStats()
+{
+    LOCK(cs_main);
+    fCoinsRollingStats = false;
+    if (pcoinsTip->GetBestBlock().IsNull()) {
+        // Not even the genesis block is connected yet.
+        coinsRollingStats = CCoinsRollingStats();
+        fCoinsRollingStats = true;
+        return true;
+    }
+    FlushStateToDisk();
+    if (pcoinsdbview->ReadRollingStats(coinsRollingStats) && coinsRollingStats.hashBlock == pcoinsdbview->GetBestBlock()) {
+        fCoinsRollingStats = true;
+        return true;
+    }
+    return ComputeRollingStatsAtTip();
+}
+
+bool GetCoinsRollingStats(CCoinsRollingStats& stats)
+{
+    LOCK(cs_main);
+    if (!fCoinsRollingStats) {
+        return false;
+    }
+    stats = coinsRollingStats;
+    return true;
+}
+
+//! Whether the UTXO set described by header can be loaded, setting pindex to its block
+static bool CheckTxOutSetBase(const CTxOutSetHeader& header, CBlockIndex*& pindex, std::string& strError) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (!fPruneMode) {
+        strError = "Loading a UTXO set requires -prune, as the blocks before it are never downloaded";
+        return false;
+    }
+    if (chainActive.Height() != 0) {
+        strError = strprintf("The chainstate is not fresh: its tip is at height %d", chainActive.Height());
+        return false;
+    }
+    pindex = LookupBlockIndex(header.hashBlock);
+    if (!pindex) {
+        strError = strprintf("Block %s of the UTXO set is not known yet; wait for the headers to sync", header.hashBlock.ToString());
+        return false;
+    }
+    if (pindex->nHeight == 0 || (pindex->nStatus & BLOCK_FAILED_MASK) || header.nChainTx <= (unsigned int)pindex->nHeight) {
+        strError = strprintf("Block %s cannot be the base of a UTXO set", header.hashBlock.ToString());
+        return false;
+    }
+    return true;
+}
+
+bool LoadTxOutSet(const fs::path& path, const uint256& hashExpected, CCoinsStats& stats, std::string& strError)
+{
+    const CChainParams& chainparams = Params();
+    int64_t nStart = GetTimeMicros();
+
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    CTxOutSetHeader header;
+    if (file.IsNull() || !ReadTxOutSetHeader(file, header)) {
+        strError = "Unable to read " + path.string();
+        return false;
+    }
+    CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        if (!CheckTxOutSetBase(header, pindex, strError))
+            return false;
+    }
+
+    // Check the whole file against the trusted hash before writing anything.
+    if (!ReadTxOutSet(file, header, nullptr, stats)) {
+        strError = "Unable to read " + path.string();
+        return false;
+    }
+    if (stats.hashSerialized3 != hashExpected) {
+        strError = strprintf("The UTXO set has hash %s, not the expected one", stats.hashSerialized3.ToString());
+        return false;
+    }
+    LogPrintf("Checked %u coins as of block %s in %.2fs\n", stats.nTransactionOutputs, header.hashBlock.ToString(), (GetTimeMicros() - nStart) * MICRO);
+
+    LOCK(cs_main);
+    if (!CheckTxOutSetBase(header, pindex, strError))
+        return false;
+    FlushStateToDisk();
+    if (std::unique_ptr<CCoinsViewCursor>(pcoinsdbview->Cursor())->Valid()) {
+        strError = "The chainstate already has coins";
+        return false;
+    }
+
+    // Write the coins straight to the database, which stays marked as in
+    // transition to the block of the UTXO set until the flush below. Were the
+    // node to stop halfway, it would refuse to start from it.
+    CCoinsStats statsLoaded;
+    if (fseek(file.Get(), 0, SEEK_SET) != 0 || !ReadTxOutSetHeader(file, header) ||
+        !ReadTxOutSet(file, header, pcoinsdbview.get(), statsLoaded) || statsLoaded.hashSerialized3 != hashExpected) {
+        strError = "The UTXO set could not be loaded after it was checked; restart with -reindex-chainstate";
+        return false;
+    }
+    const bool fKeepRollingStats = fCoinsRollingStats;
+    fCoinsRollingStats = false;
+    g_chainstate.ActivateTxOutSet(pindex, header.nChainTx, chainparams);
+    pcoinsTip->SetBestBlock(header.hashBlock);
+    FlushStateToDisk();
+    if (fKeepRollingStats && !ComputeRollingStatsAtTip()) {
+        LogPrintf("%s: unable to compute the UTXO set statistics\n", __func__);
+    }
+
+    stats.nHeight = pindex->nHeight;
+    stats.nDiskSize = pcoinsdbview->EstimateSize();
+    LogPrintf("Loaded %u coins as of block %s in %.2fs\n", stats.nTransactionOutputs, header.hashBlock.ToString(), (GetTimeMicros() - nStart) * MICRO);
+    return true;
+}
+
 //! Guess how far we are in the verification process at the given block index
 //! require cs_main if pindex has not been validated yet (because nChainTx might be unset)
 double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pindex) {
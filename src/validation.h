@@ -34,13 +34,18 @@
 class CBlockIndex;
 class CBlockTreeDB;
 class CChainParams;
+class CCoinsRollingStats;
 class CCoinsViewDB;
+class CCoinsViewPrefetch;
+class CCoinsViewWriter;
+class CConnectPipeline;
 class CInv;
 class CConnman;
 class CScriptCheck;
 class CBlockPolicyEstimator;
 class CTxMemPool;
 class CValidationState;
+struct CCoinsStats;
 struct ChainTxData;
 
 struct PrecomputedTransactionData;
@@ -81,6 +86,10 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of header proof-of-work checking threads, on top of the thread processing the headers */
+static const int MAX_POWCHECK_THREADS = 4;
+/** Maximum number of block transaction checking threads, on top of the caller of CheckBlock() */
+static const int MAX_TXCHECK_THREADS = 2;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -117,6 +126,8 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+/** Default for -coinstatsindex */
+static const bool DEFAULT_COINSTATSINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
@@ -163,6 +174,8 @@ extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
+/** Percentage of nCoinCacheUsage that unmodified coins may keep occupying after a chainstate flush (0 = empty the cache) */
+extern int nCoinCacheRetain;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
 /** Absolute maximum transaction fee (in satoshis) used by wallet and mempool (rejects high fee in sendrawtransaction) */
@@ -263,6 +276,10 @@ bool LoadChainTip(const CChainParams& chainparams);
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the header proof-of-work checking thread */
+void ThreadPowCheck();
+/** Run an instance of the block transaction checking thread */
+void ThreadTxCheck();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -388,9 +405,35 @@ public:
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
+/** Script flags of the block after the tip, which AcceptToMemoryPool() also checks against */
+unsigned int GetMempoolBlockScriptFlags();
+
+/**
+ * Run the checks of AcceptToMemoryPool() that only depend on the transaction
+ * and the coins it spends: CheckTransaction(), IsStandardTx() and the scripts
+ * under the standard and the given block flags. Takes no lock; the signatures
+ * that pass are stored in the signature cache.
+ */
+bool PreVerifyMempoolTransaction(const CTransaction& tx, const std::vector<Coin>& vCoins, unsigned int nBlockFlags);
+
+/**
+ * Record in the script execution cache that tx passed
+ * PreVerifyMempoolTransaction(), so AcceptToMemoryPool() does not run its
+ * scripts again.
+ */
+void CachePreVerifiedTransaction(const CTransaction& tx, unsigned int nBlockFlags);
+
+/**
+ * Run the checks AcceptToMemoryPool() does before the scripts, with vCoins as
+ * the coins tx spends: the standardness, finality, input and fee checks.
+ * Whatever fails here, AcceptToMemoryPool() rejects too, unless the tip or
+ * the mempool changes in between.
+ */
+bool PreCheckMempoolTransaction(const CTransaction& tx, const std::vector<Coin>& vCoins, const CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 
 /** Functions for disk access for blocks */
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPOW = true);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
@@ -459,6 +502,15 @@ extern CChain& chainActive;
 /** Global variable that points to the coins database (protected by cs_main) */
 extern std::unique_ptr<CCoinsViewDB> pcoinsdbview;
 
+/** Global variable that points to the coins prefetch layer below pcoinsTip (protected by cs_main) */
+extern std::unique_ptr<CCoinsViewPrefetch> pcoinsprefetch;
+
+/** Global variable that points to the background chainstate writer below the prefetch layer (protected by cs_main) */
+extern std::unique_ptr<CCoinsViewWriter> pcoinswriter;
+
+/** Reads and checks the blocks about to be connected ahead of ConnectTip() (null if disabled) */
+extern std::unique_ptr<CConnectPipeline> g_connect_pipeline;
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern std::unique_ptr<CCoinsViewCache> pcoinsTip;
 
@@ -496,6 +548,25 @@ bool DumpMempool();
 /** Load the mempool from disk. */
 bool LoadMempool();
 
+/**
+ * Start keeping the UTXO set statistics up to date with the chain tip, from
+ * those stored with the chainstate, or by computing them if they are stale.
+ * Only called with -coinstatsindex, as it slows down connecting blocks.
+ */
+bool LoadCoinsRollingStats();
+
+/** Get the UTXO set statistics at the chain tip, if they are being kept. */
+bool GetCoinsRollingStats(CCoinsRollingStats& stats);
+
+/** Dump the UTXO set, as of the chain tip, to path. stats gets its statistics. */
+bool DumpTxOutSet(const fs::path& path, CCoinsStats& stats);
+
+/**
+ * Load a UTXO set written by DumpTxOutSet() into a fresh chainstate, provided
+ * its hash_serialized_3 is hashExpected, making its block the chain tip.
+ */
+bool LoadTxOutSet(const fs::path& path, const uint256& hashExpected, CCoinsStats& stats, std::string& strError);
+
 //! Check whether the block associated with this index entry is pruned or not.
 inline bool IsBlockPruned(const CBlockIndex* pblockindex)
 {
@@ -10,7 +10,10 @@
 #include <script/standard.h>
 #include <util.h>
 
+#include <algorithm>
+#include <atomic>
 #include <string>
+#include <thread>
 #include <vector>
 
 int CCrypter::BytesToKeySHA512AES(const std::vector<unsigned char>& chSalt, const SecureString& strKeyData, int count, unsigned char *key,unsigned char *iv) const
@@ -175,6 +178,35 @@ bool CCryptoKeyStore::Lock()
     return true;
 }
 
+/** Minimum number of keys per thread when checking that all keys decrypt. */
+static const size_t MIN_KEYS_PER_DECRYPT_THREAD = 1000;
+
+/**
+ * Check that all the given crypted keys decrypt to their public key, splitting
+ * them over up to GetNumCores() threads. The threads stop at the first failure.
+ */
+static bool DecryptAllKeys(const CKeyingMaterial& vMasterKey, const std::vector<const std::pair<CPubKey, std::vector<unsigned char>>*>& vKeys)
+{
+    const size_t nThreads = std::max<size_t>(1, std::min<size_t>(GetNumCores(), vKeys.size() / MIN_KEYS_PER_DECRYPT_THREAD));
+    const size_t nChunk = (vKeys.size() + nThreads - 1) / nThreads;
+    std::atomic<bool> fFail(false);
+    auto check = [&](size_t nBegin) {
+        const size_t nEnd = std::min(vKeys.size(), nBegin + nChunk);
+        for (size_t i = nBegin; i < nEnd && !fFail; i++) {
+            CKey key;
+            if (!DecryptKey(vMasterKey, vKeys[i]->second, vKeys[i]->first, key))
+                fFail = true;
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < nThreads; t++)
+        threads.emplace_back(check, t * nChunk);
+    check(0);
+    for (std::thread& thread : threads)
+        thread.join();
+    return !fFail;
+}
+
 bool CCryptoKeyStore::Unlock(const CKeyingMaterial& vMasterKeyIn)
 {
     {
@@ -185,19 +217,24 @@ bool CCryptoKeyStore::Unlock(const CKeyingMaterial& vMasterKeyIn)
         bool keyPass = false;
         bool keyFail = false;
         CryptedKeyMap::const_iterator mi = mapCryptedKeys.begin();
-        for (; mi != mapCryptedKeys.end(); ++mi)
+        if (mi != mapCryptedKeys.end())
         {
-            const CPubKey &vchPubKey = (*mi).second.first;
-            const std::vector<unsigned char> &vchCryptedSecret = (*mi).second.second;
+            // The first key tells a wrong passphrase apart from a corrupted wallet.
             CKey key;
-            if (!DecryptKey(vMasterKeyIn, vchCryptedSecret, vchPubKey, key))
+            if (DecryptKey(vMasterKeyIn, mi->second.second, mi->second.first, key))
             {
-                keyFail = true;
-                break;
+                keyPass = true;
+                if (!fDecryptionThoroughlyChecked)
+                {
+                    std::vector<const CryptedKeyMap::mapped_type*> vKeys;
+                    vKeys.reserve(mapCryptedKeys.size() - 1);
+                    for (++mi; mi != mapCryptedKeys.end(); ++mi)
+                        vKeys.push_back(&mi->second);
+                    keyFail = !DecryptAllKeys(vMasterKeyIn, vKeys);
+                }
             }
-            keyPass = true;
-            if (fDecryptionThoroughlyChecked)
-                break;
+            else
+                keyFail = true;
         }
         if (keyPass && keyFail)
         {
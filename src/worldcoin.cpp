@@ -6,9 +6,12 @@
 #include <boost/random/mersenne_twister.hpp>
 
 #include <arith_uint256.h>
+#include <auxpow.h>
+#include <crypto/scrypt.h>
 #include <worldcoin.h>
 #include <pow.h>
 #include <util.h>
+#include <utilstrencodings.h>
 
 // As Worldcoin calculate block reward using trigonometric functions to follow the Earth rotation ...
 #ifndef M_PI
@@ -70,6 +73,46 @@ bool CheckAuxPowProofOfWork(const CBlockHeader& block, const Consensus::Params&
     return true;	
 }
 
+void CheckAuxPowProofOfWorkMulti(const std::vector<const CBlockHeader*>& headers, const Consensus::Params& params, std::vector<bool>& vValid)
+{
+    vValid.assign(headers.size(), false);
+
+    // Run the cheap checks of CheckAuxPowProofOfWork() first, and collect the
+    // 80-byte header whose scrypt hash has to meet the target for each block
+    // that passed them: the block itself, or the parent block for auxpow.
+    std::vector<char> vInput;
+    std::vector<size_t> vIndex;
+    vInput.reserve(headers.size() * 80);
+    vIndex.reserve(headers.size());
+    for (size_t i = 0; i < headers.size(); i++) {
+        const CBlockHeader& block = *headers[i];
+        const CPureBlockHeader* pheader;
+        if (block.IsLegacy() || !block.IsAuxpow()) {
+            if (block.auxpow)
+                continue;
+            pheader = &block;
+        } else {
+            if (!block.auxpow)
+                continue;
+            if (params.fStrictChainId && (block.GetChainId() != params.nAuxpowChainId))
+                continue;
+            if (!block.auxpow->check(block.GetHash(), block.GetChainId(), params))
+                continue;
+            pheader = &block.auxpow->getParentBlock();
+        }
+        const char* begin = BEGIN(pheader->nVersion);
+        vInput.insert(vInput.end(), begin, begin + 80);
+        vIndex.push_back(i);
+    }
+    if (vIndex.empty())
+        return;
+
+    std::vector<uint256> vHash(vIndex.size());
+    scrypt_1024_1_1_256_multi(vInput.data(), (char*)vHash.data(), vIndex.size());
+    for (size_t j = 0; j < vIndex.size(); j++)
+        vValid[vIndex[j]] = CheckProofOfWork(vHash[j], headers[vIndex[j]]->nBits, params);
+}
+
 
 
 unsigned int CalculateWorldcoinNextWorkRequired(const CBlockIndex* pindexLast, int64_t nFirstBlockTime, const Consensus::Params& params)
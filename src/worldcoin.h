@@ -17,3 +17,13 @@ unsigned int CalculateWorldcoinNextWorkRequired(const CBlockIndex* pindexLast, i
  * @return True iff the PoW is correct.
  */
 bool CheckAuxPowProofOfWork(const CBlockHeader& block, const Consensus::Params& params);
+
+/**
+ * Check proof-of-work of several block headers at once, with the same rules
+ * as CheckAuxPowProofOfWork(). The scrypt hashes are computed together using
+ * the multi-lane kernels where available.
+ * @param headers The block headers.
+ * @param params Consensus parameters.
+ * @param vValid Set to whether the PoW of each header is correct.
+ */
+void CheckAuxPowProofOfWorkMulti(const std::vector<const CBlockHeader*>& headers, const Consensus::Params& params, std::vector<bool>& vValid);
@@ -52,7 +52,7 @@ class BlockchainTest(WorldcoinTestFramework):
         self.skip_if_no_wallet()
 
     def run_test(self):
-        self.restart_node(0, extra_args=['-stopatheight=207', '-prune=1'])  # Set extra args with pruning after rescan is complete
+        self.restart_node(0, extra_args=['-stopatheight=207', '-prune=1', '-coinstatsindex'])  # Set extra args with pruning after rescan is complete
 
         self._test_getblockchaininfo()
         self._test_getchaintxstats()
@@ -203,6 +203,20 @@ class BlockchainTest(WorldcoinTestFramework):
         del res['disk_size'], res3['disk_size']
         assert_equal(res, res3)
 
+        self.log.info("Test that gettxoutsetinfo() with muhash agrees with the full scan")
+        res4 = node.gettxoutsetinfo("muhash")
+        for field in ['total_amount', 'height', 'txouts', 'bogosize', 'bestblock']:
+            assert_equal(res4[field], res[field])
+        assert_equal(len(res4['muhash']), 64)
+        assert 'transactions' not in res4
+        node.invalidateblock(b1hash)
+        assert_equal(node.gettxoutsetinfo("muhash")['txouts'], 0)
+        node.reconsiderblock(b1hash)
+        res5 = node.gettxoutsetinfo("muhash")
+        del res4['disk_size'], res5['disk_size']
+        assert_equal(res4, res5)
+        assert_raises_rpc_error(-8, "Unknown hash_type", node.gettxoutsetinfo, "sha256")
+
     def _test_getblockheader(self):
         node = self.nodes[0]
 